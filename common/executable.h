@@ -0,0 +1,61 @@
+#pragma once
+#include <cstdint>
+
+//ME88 executable, written by the compiler and loaded by the emulator. A Header, then Header::sectionCount
+//SectionHeaders, then the content of the sections. Code, data and interrupt sections start at a multiple
+//of EXECUTABLE_ALIGNMENT, the page size of the emulator memory, so that they can be mapped from the file
+//as they are. Everything is little endian.
+
+#define EXECUTABLE_MAGIC "ME88EXE"
+#define EXECUTABLE_VERSION 1
+#define EXECUTABLE_ALIGNMENT 4096
+#define EXECUTABLE_SYMBOL_LENGTH 28
+
+namespace Executable
+{
+	enum class SectionType : uint32_t
+	{
+		Code = 0,		//instructions, loaded at address
+		Data,				//initialized memory, loaded at address
+		Interrupts, //interrupt vector table loaded at address, 4 bytes per type: IP high, IP low, CS high, CS low
+		Symbols,		//Symbol entries, address is not used
+		Lines				//Line entries sorted by address, address is not used
+	};
+
+	struct Header
+	{
+		char magic[8];
+		uint32_t version;
+		uint32_t sectionCount;
+		//CS:IP of the first instruction, the processor resets to F000:0000
+		uint16_t entryCS;
+		uint16_t entryIP;
+		uint32_t reserved;
+	};
+
+	struct SectionHeader
+	{
+		uint32_t type;
+		//physical address of the first byte
+		uint32_t address;
+		//from the start of the file
+		uint32_t offset;
+		uint32_t size;
+	};
+
+	struct Symbol
+	{
+		uint32_t address;
+		//nul terminated
+		char name[EXECUTABLE_SYMBOL_LENGTH];
+	};
+
+	//the instructions from address up to the next entry come from line of the source
+	struct Line
+	{
+		uint32_t address;
+		uint32_t line;
+	};
+
+	static_assert(sizeof(Header) == 24 && sizeof(SectionHeader) == 16 && sizeof(Symbol) == 32 && sizeof(Line) == 8, "the layout is the file format, change EXECUTABLE_VERSION with it");
+} // namespace Executable
@@ -1,3 +1,5 @@
+#pragma once
+
 enum class Opcode
 {
 	//F0
@@ -0,0 +1,384 @@
+#pragma once
+#include "opcode.h"
+#include "star.h"
+#include <array>
+#include <cstdint>
+
+//Everything the compiler and the emulator need to know about an opcode, in one table indexed by the opcode byte.
+
+enum class InstructionFormat
+{
+	F0 = 0b000,
+	F1 = 0b001,
+	F2 = 0b010,
+	F3 = 0b011,
+	F4 = 0b100,
+	F5 = 0b101,
+	F6 = 0b110,
+	F7 = 0b111
+};
+
+enum class OperandKind
+{
+	None,				//F0
+	DsDi,				//F1 byte read at DS:(DI), F2 destination DS:(DI)
+	Immediate,	//F3 one byte
+	Offset,			//F4, F5 two bytes offset in DS
+	Port,				//in, out two bytes offset in selector 0
+	NearTarget, //F6 two bytes offset in CS
+	FarTarget		//F7 two bytes selector and two bytes offset
+};
+
+enum class AluOperation
+{
+	None,
+	ADD,
+	SUB,
+	CMP,
+	AND,
+	OR,
+	NOT,
+	SHL,
+	SAL,
+	SHR,
+	SAR
+};
+
+struct OpcodeInfo
+{
+	const char *mnemonic; //nullptr for the bytes that are not in Opcode
+	InstructionFormat format;
+	uint8_t length; //bytes, opcode included
+	OperandKind operand;
+	AluOperation alu;
+	Star fetchState; //first state after fetch3
+	Star executionState;
+	//microcycles from fetch0 to the next fetch0, or to the state looping on itself when halts is set
+	uint8_t cycles;
+	bool halts;
+};
+
+namespace OpcodeTable
+{
+	//fetch0 .. fetch3
+	constexpr uint8_t FETCH_CYCLES = 4;
+
+	constexpr InstructionFormat GetFormat(uint8_t code)
+	{
+		return (InstructionFormat)(code >> 5);
+	}
+
+	constexpr uint8_t GetLength(InstructionFormat format)
+	{
+		switch (format)
+		{
+		case InstructionFormat::F0:
+		case InstructionFormat::F1:
+		case InstructionFormat::F2:
+			return 1;
+		case InstructionFormat::F3:
+			return 2;
+		case InstructionFormat::F4:
+		case InstructionFormat::F5:
+		case InstructionFormat::F6:
+			return 3;
+		case InstructionFormat::F7:
+			return 5;
+		}
+		return 1;
+	}
+
+	constexpr Star GetFetchState(InstructionFormat format)
+	{
+		switch (format)
+		{
+		case InstructionFormat::F0:
+			return Star::fetchF0_0;
+		case InstructionFormat::F1:
+			return Star::fetchF1_0;
+		case InstructionFormat::F2:
+			return Star::fetchF2_0;
+		case InstructionFormat::F3:
+			return Star::fetchF3_0;
+		case InstructionFormat::F4:
+			return Star::fetchF4_0;
+		case InstructionFormat::F5:
+			return Star::fetchF5_0;
+		case InstructionFormat::F6:
+			return Star::fetchF6_0;
+		case InstructionFormat::F7:
+			return Star::fetchF7_0;
+		}
+		return Star::fetchF0_0;
+	}
+
+	//fetchFx_0 .. the state jumping to the execution phase
+	constexpr uint8_t GetFetchCycles(uint8_t code)
+	{
+		switch (GetFormat(code))
+		{
+		case InstructionFormat::F0:
+		case InstructionFormat::F2:
+			return 1;
+		case InstructionFormat::F1:
+		case InstructionFormat::F3:
+			return 3;
+		case InstructionFormat::F4:
+			//in goes through fetchF4_5 as well
+			return code == (uint8_t)Opcode::in_offset_al ? 8 : 7;
+		case InstructionFormat::F5:
+		case InstructionFormat::F6:
+			return 5;
+		case InstructionFormat::F7:
+			return 9;
+		}
+		return 1;
+	}
+
+	constexpr OperandKind GetOperandKind(uint8_t code)
+	{
+		switch (GetFormat(code))
+		{
+		case InstructionFormat::F0:
+			return OperandKind::None;
+		case InstructionFormat::F1:
+		case InstructionFormat::F2:
+			return OperandKind::DsDi;
+		case InstructionFormat::F3:
+			return OperandKind::Immediate;
+		case InstructionFormat::F4:
+			return code == (uint8_t)Opcode::in_offset_al ? OperandKind::Port : OperandKind::Offset;
+		case InstructionFormat::F5:
+			return code == (uint8_t)Opcode::out_al_offset ? OperandKind::Port : OperandKind::Offset;
+		case InstructionFormat::F6:
+			return OperandKind::NearTarget;
+		case InstructionFormat::F7:
+			return OperandKind::FarTarget;
+		}
+		return OperandKind::None;
+	}
+
+	constexpr AluOperation GetAluOperation(Opcode opcode)
+	{
+		switch (opcode)
+		{
+		case Opcode::add_ds$di_al:
+		case Opcode::add_operand_al:
+		case Opcode::add_ds$offset_al:
+			return AluOperation::ADD;
+		case Opcode::sub_ds$di_al:
+		case Opcode::sub_operand_al:
+		case Opcode::sub_ds$offset_al:
+			return AluOperation::SUB;
+		case Opcode::cmp_ds$di_al:
+		case Opcode::cmp_operand_al:
+		case Opcode::cmp_ds$offset_al:
+			return AluOperation::CMP;
+		case Opcode::and_ds$di_al:
+		case Opcode::and_operand_al:
+		case Opcode::and_ds$offset_al:
+			return AluOperation::AND;
+		case Opcode::or_ds$di_al:
+		case Opcode::or_operand_al:
+		case Opcode::or_ds$offset_al:
+			return AluOperation::OR;
+		case Opcode::not_al:
+			return AluOperation::NOT;
+		case Opcode::shl_al:
+			return AluOperation::SHL;
+		case Opcode::sal_al:
+			return AluOperation::SAL;
+		case Opcode::shr_al:
+			return AluOperation::SHR;
+		case Opcode::sar_al:
+			return AluOperation::SAR;
+		default:
+			return AluOperation::None;
+		}
+	}
+
+	//mnemonic, first execution state and microcycles of the execution phase.
+	//retf takes the same path of retn because ret3 compares the opcode with Instructions::RETF_OPCODE,
+	//which is the nop opcode. callf pushes CS as well (call6 .. call11).
+	constexpr OpcodeInfo GetExecution(Opcode opcode)
+	{
+		switch (opcode)
+		{
+		case Opcode::mov_al_ah:
+			return {"mov al,ah", {}, 0, {}, {}, {}, Star::ldah0, 1, false};
+		case Opcode::mov_ah_al:
+			return {"mov ah,al", {}, 0, {}, {}, {}, Star::ldal0, 1, false};
+		case Opcode::mov_ds_ax:
+			return {"mov ds,ax", {}, 0, {}, {}, {}, Star::ldax0, 1, false};
+		case Opcode::mov_ss_ax:
+			return {"mov ss,ax", {}, 0, {}, {}, {}, Star::ldax1, 1, false};
+		case Opcode::mov_sp_ax:
+			return {"mov sp,ax", {}, 0, {}, {}, {}, Star::ldax2, 1, false};
+		case Opcode::mov_di_ax:
+			return {"mov di,ax", {}, 0, {}, {}, {}, Star::ldax3, 1, false};
+		case Opcode::mov_ax_ds:
+			return {"mov ax,ds", {}, 0, {}, {}, {}, Star::ldds0, 1, false};
+		case Opcode::mov_ax_ss:
+			return {"mov ax,ss", {}, 0, {}, {}, {}, Star::ldss0, 1, false};
+		case Opcode::mov_ax_sp:
+			return {"mov ax,sp", {}, 0, {}, {}, {}, Star::ldsp0, 1, false};
+		case Opcode::mov_ax_di:
+			return {"mov ax,di", {}, 0, {}, {}, {}, Star::lddi0, 1, false};
+		case Opcode::push_al:
+			return {"push al", {}, 0, {}, {}, {}, Star::push0, 3, false};
+		case Opcode::pop_al:
+			return {"pop al", {}, 0, {}, {}, {}, Star::pop0, 3, false};
+		case Opcode::shl_al:
+			return {"shl al", {}, 0, {}, {}, {}, Star::arit_log0, 1, false};
+		case Opcode::sal_al:
+			return {"sal al", {}, 0, {}, {}, {}, Star::arit_log0, 1, false};
+		case Opcode::shr_al:
+			return {"shr al", {}, 0, {}, {}, {}, Star::arit_log0, 1, false};
+		case Opcode::sar_al:
+			return {"sar al", {}, 0, {}, {}, {}, Star::arit_log0, 1, false};
+		case Opcode::not_al:
+			return {"not al", {}, 0, {}, {}, {}, Star::arit_log0, 1, false};
+		case Opcode::retn:
+			return {"retn", {}, 0, {}, {}, {}, Star::ret0, 5, false};
+		case Opcode::retf:
+			return {"retf", {}, 0, {}, {}, {}, Star::ret0, 5, false};
+		case Opcode::nop:
+			return {"nop", {}, 0, {}, {}, {}, Star::nop0, 1, false};
+		case Opcode::htl:
+			return {"hlt", {}, 0, {}, {}, {}, Star::hlt0, 0, true};
+		case Opcode::iret:
+			return {"iret", {}, 0, {}, {}, {}, Star::iret0, 12, false};
+		case Opcode::cli:
+			return {"cli", {}, 0, {}, {}, {}, Star::cli0, 1, false};
+		case Opcode::sti:
+			return {"sti", {}, 0, {}, {}, {}, Star::sti0, 1, false};
+		case Opcode::ldpsr:
+			return {"ldpsr", {}, 0, {}, {}, {}, Star::ldpsr0, 1, false};
+		case Opcode::stum:
+			return {"stum", {}, 0, {}, {}, {}, Star::stum0, 1, false};
+		case Opcode::mov_ds$di_al:
+			return {"mov ds:(di),al", {}, 0, {}, {}, {}, Star::ldal1, 1, false};
+		case Opcode::cmp_ds$di_al:
+			return {"cmp ds:(di),al", {}, 0, {}, {}, {}, Star::arit_log0, 1, false};
+		case Opcode::add_ds$di_al:
+			return {"add ds:(di),al", {}, 0, {}, {}, {}, Star::arit_log0, 1, false};
+		case Opcode::sub_ds$di_al:
+			return {"sub ds:(di),al", {}, 0, {}, {}, {}, Star::arit_log0, 1, false};
+		case Opcode::and_ds$di_al:
+			return {"and ds:(di),al", {}, 0, {}, {}, {}, Star::arit_log0, 1, false};
+		case Opcode::or_ds$di_al:
+			return {"or ds:(di),al", {}, 0, {}, {}, {}, Star::arit_log0, 1, false};
+		case Opcode::mov_al_ds$di:
+			return {"mov al,ds:(di)", {}, 0, {}, {}, {}, Star::ld0, 3, false};
+		case Opcode::mov_operand_al:
+			return {"mov operand,al", {}, 0, {}, {}, {}, Star::ldal1, 1, false};
+		case Opcode::cmp_operand_al:
+			return {"cmp operand,al", {}, 0, {}, {}, {}, Star::arit_log0, 1, false};
+		case Opcode::add_operand_al:
+			return {"add operand,al", {}, 0, {}, {}, {}, Star::arit_log0, 1, false};
+		case Opcode::sub_operand_al:
+			return {"sub operand,al", {}, 0, {}, {}, {}, Star::arit_log0, 1, false};
+		case Opcode::and_operand_al:
+			return {"and operand,al", {}, 0, {}, {}, {}, Star::arit_log0, 1, false};
+		case Opcode::or_operand_al:
+			return {"or operand,al", {}, 0, {}, {}, {}, Star::arit_log0, 1, false};
+		case Opcode::int_operand:
+			//int3 never moves on to int4
+			return {"int operand", {}, 0, {}, {}, {}, Star::int0, 3, true};
+		case Opcode::mov_ds$offset_al:
+			return {"mov ds:offset,al", {}, 0, {}, {}, {}, Star::ldal1, 1, false};
+		case Opcode::cmp_ds$offset_al:
+			return {"cmp ds:offset,al", {}, 0, {}, {}, {}, Star::arit_log0, 1, false};
+		case Opcode::add_ds$offset_al:
+			return {"add ds:offset,al", {}, 0, {}, {}, {}, Star::arit_log0, 1, false};
+		case Opcode::sub_ds$offset_al:
+			return {"sub ds:offset,al", {}, 0, {}, {}, {}, Star::arit_log0, 1, false};
+		case Opcode::and_ds$offset_al:
+			return {"and ds:offset,al", {}, 0, {}, {}, {}, Star::arit_log0, 1, false};
+		case Opcode::or_ds$offset_al:
+			return {"or ds:offset,al", {}, 0, {}, {}, {}, Star::arit_log0, 1, false};
+		case Opcode::in_offset_al:
+			return {"in offset,al", {}, 0, {}, {}, {}, Star::ldal1, 1, false};
+		case Opcode::mov_al_ds$offset:
+			return {"mov al,ds:offset", {}, 0, {}, {}, {}, Star::ld0, 3, false};
+		case Opcode::out_al_offset:
+			return {"out al,offset", {}, 0, {}, {}, {}, Star::out0, 3, false};
+		case Opcode::jmp_cs_offset:
+			return {"jmp cs:offset", {}, 0, {}, {}, {}, Star::jmp0, 1, false};
+		case Opcode::ja_cs_offset:
+			return {"ja cs:offset", {}, 0, {}, {}, {}, Star::jmp0, 1, false};
+		case Opcode::jae_cs_offset:
+			return {"jae cs:offset", {}, 0, {}, {}, {}, Star::jmp0, 1, false};
+		case Opcode::jb_cs_offset:
+			return {"jb cs:offset", {}, 0, {}, {}, {}, Star::jmp0, 1, false};
+		case Opcode::jbe_cs_offset:
+			return {"jbe cs:offset", {}, 0, {}, {}, {}, Star::jmp0, 1, false};
+		case Opcode::jc_cs_offset:
+			return {"jc cs:offset", {}, 0, {}, {}, {}, Star::jmp0, 1, false};
+		case Opcode::je_cs_offset:
+			return {"je cs:offset", {}, 0, {}, {}, {}, Star::jmp0, 1, false};
+		case Opcode::jg_cs_offset:
+			return {"jg cs:offset", {}, 0, {}, {}, {}, Star::jmp0, 1, false};
+		case Opcode::jge_cs_offset:
+			return {"jge cs:offset", {}, 0, {}, {}, {}, Star::jmp0, 1, false};
+		case Opcode::jl_cs_offset:
+			return {"jl cs:offset", {}, 0, {}, {}, {}, Star::jmp0, 1, false};
+		case Opcode::jle_cs_offset:
+			return {"jle cs:offset", {}, 0, {}, {}, {}, Star::jmp0, 1, false};
+		case Opcode::jnc_cs_offset:
+			return {"jnc cs:offset", {}, 0, {}, {}, {}, Star::jmp0, 1, false};
+		case Opcode::jne_cs_offset:
+			return {"jne cs:offset", {}, 0, {}, {}, {}, Star::jmp0, 1, false};
+		case Opcode::jno_cs_offset:
+			return {"jno cs:offset", {}, 0, {}, {}, {}, Star::jmp0, 1, false};
+		case Opcode::jns_cs_offset:
+			return {"jns cs:offset", {}, 0, {}, {}, {}, Star::jmp0, 1, false};
+		case Opcode::jnz_cs_offset:
+			return {"jnz cs:offset", {}, 0, {}, {}, {}, Star::jmp0, 1, false};
+		case Opcode::jo_cs_offset:
+			return {"jo cs:offset", {}, 0, {}, {}, {}, Star::jmp0, 1, false};
+		case Opcode::js_cs_offset:
+			return {"js cs:offset", {}, 0, {}, {}, {}, Star::jmp0, 1, false};
+		case Opcode::jz_cs_offset:
+			return {"jz cs:offset", {}, 0, {}, {}, {}, Star::jmp0, 1, false};
+		case Opcode::call_cs_offset:
+			return {"call cs:offset", {}, 0, {}, {}, {}, Star::call0, 7, false};
+		case Opcode::jmp_selector$offset:
+			return {"jmp selector:offset", {}, 0, {}, {}, {}, Star::jmp0, 1, false};
+		case Opcode::call_selector$offsett:
+			return {"call selector:offset", {}, 0, {}, {}, {}, Star::call0, 13, false};
+		}
+
+		//unknown opcodes are executed as nop
+		return {nullptr, {}, 0, {}, {}, {}, Star::nop0, 1, false};
+	}
+
+	constexpr OpcodeInfo Build(uint8_t code)
+	{
+		auto info = GetExecution((Opcode)code);
+		info.format = GetFormat(code);
+		info.length = GetLength(info.format);
+		info.operand = GetOperandKind(code);
+		info.alu = GetAluOperation((Opcode)code);
+		info.fetchState = GetFetchState(info.format);
+		info.cycles += FETCH_CYCLES + GetFetchCycles(code);
+		return info;
+	}
+
+	constexpr std::array<OpcodeInfo, 256> BuildAll()
+	{
+		std::array<OpcodeInfo, 256> table = {};
+		for (int code = 0; code < 256; code++)
+		{
+			table[code] = Build(code);
+		}
+		return table;
+	}
+} // namespace OpcodeTable
+
+constexpr std::array<OpcodeInfo, 256> OPCODE_INFO = OpcodeTable::BuildAll();
+
+constexpr const OpcodeInfo &GetOpcodeInfo(uint8_t code)
+{
+	return OPCODE_INFO[code];
+}
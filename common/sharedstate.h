@@ -0,0 +1,75 @@
+#pragma once
+#include <cstdint>
+
+//Live state of a running emulator, exported with --share name as a POSIX shared memory object (shm_open)
+//holding a Segment. Monitors map it read only and sample it whenever they want, the emulator never
+//waits for them.
+//Registers and Video are each preceded by a sequence number. The emulator makes it odd, writes the
+//block and makes it even again, so a reader copies the block when the sequence is even and keeps the
+//copy when the sequence did not change in the meantime, like this:
+//  do { before = sequence (acquire); copy; fence (acquire); } while (before odd || sequence != before)
+//The sequence divided by 2 is the generation, the number of times the block was written.
+//Header::magic is written last, a reader that finds it can trust the rest of the header.
+//Everything is in the byte order of the host.
+
+#define SHARED_STATE_MAGIC "ME88SHM"
+#define SHARED_STATE_VERSION 2
+//the whole video memory, 0xA0000 to 0xAFFFF
+#define SHARED_STATE_VIDEO_SIZE 0x10000
+
+namespace SharedState
+{
+	struct Header
+	{
+		char magic[8];
+		uint32_t version;
+		//of the whole Segment
+		uint32_t size;
+		//physical address of Video::data[0]
+		uint32_t videoAddress;
+		uint32_t videoSize;
+		//of the emulator
+		uint32_t pid;
+		uint32_t reserved;
+	};
+
+	//the fields of CPU::Status, written every 256 steps of the processor (clock cycles, or whole
+	//instructions with --fast, --jit and --aot) and when the emulator stops
+	struct Registers
+	{
+		uint64_t cycles;
+		uint64_t instructions;
+		uint32_t mar;
+		uint16_t cs, ip, ss, sp, ds, di, destSel, destOff;
+		//the microstate and the state register
+		uint8_t star, mjr;
+		uint8_t d7d0, opcode, source, al, ah, mbr;
+		//the flag register, bit 0 CF, 1 ZF, 2 SF, 3 OF, 4 IF, 5 user mode, see pc/src/registers.h
+		uint8_t flags;
+		//the bus control lines, active low like on the bus
+		uint8_t mr_, mw_, ior_, iow_;
+		//1 once the processor is stuck in a state looping on itself: hlt0 after a HLT, or the nvi0 and int3
+		//lockups, star tells which
+		uint8_t halted;
+		uint8_t reserved[6];
+	};
+
+	//written every 65536 steps and when the emulator stops
+	struct Video
+	{
+		//one bit per byte, bit (i & 63) of initialized[i >> 6], 0 for the bytes never written
+		uint64_t initialized[SHARED_STATE_VIDEO_SIZE / 64];
+		uint8_t data[SHARED_STATE_VIDEO_SIZE];
+	};
+
+	struct Segment
+	{
+		Header header;
+		uint64_t registersSequence;
+		Registers registers;
+		uint64_t videoSequence;
+		Video video;
+	};
+
+	static_assert(sizeof(Header) == 32 && sizeof(Registers) == 56 && sizeof(Video) == 73728 && sizeof(Segment) == 73832, "the layout is what monitors read, change SHARED_STATE_VERSION with it");
+} // namespace SharedState
@@ -1,5 +1,5 @@
 #include "codegenerator.h"
-#include "../../common/opcode.h"
+#include "../../common/opcodeinfo.h"
 #include <bitset>
 #include <iostream>
 #include <unordered_map>
@@ -205,18 +205,49 @@ void CodeGenerator::ReplaceJumpPlaceholder(int index) {
 }
 
 void CodeGenerator::Hlt() { m_code.push_back((int)Opcode::htl); }
+
+void CodeGenerator::MarkLine(int line) {
+  // a statement without code, like a declaration, leaves nothing to mark
+  if (!m_lines.empty() && m_lines.back().offset == Size()) {
+    m_lines.pop_back();
+  }
+  if (m_lines.empty() || m_lines.back().line != line) {
+    m_lines.push_back({Size(), line});
+  }
+}
+
 std::vector<std::bitset<8>> CodeGenerator::GetCode() { return m_code; }
+std::vector<SourceLine> CodeGenerator::GetLines() { return m_lines; }
 void CodeGenerator::Print() {
   std::cout << "££££££££££££££££ Code Debug ££££££££££££££££" << std::endl;
-  int count = 0;
-  for (const auto &st : m_code) {
-    std::cout << count << "\t" << st << "\t" << st.to_ulong() << std::endl;
-    count++;
+  std::size_t count = 0;
+  while (count < m_code.size()) {
+    // operands follow the opcode, the table knows how many there are
+    const auto &info = GetOpcodeInfo(m_code[count].to_ulong());
+    std::cout << count << "\t" << m_code[count] << "\t"
+              << (info.mnemonic != nullptr ? info.mnemonic : "???");
+    for (int i = 1; i < info.length && count + i < m_code.size(); i++) {
+      std::cout << " " << m_code[count + i].to_ulong();
+    }
+    std::cout << "\t" << (int)info.cycles << " cycles" << std::endl;
+    count += info.length;
   }
 
+  std::cout << "Size: " << Size() << " bytes, " << Cycles()
+            << " cycles without jumps" << std::endl;
   std::cout << "££££££££££££££££££££££££££££££££££££££££££££" << std::endl;
 }
 
+std::size_t CodeGenerator::Cycles() {
+  std::size_t cycles = 0;
+  for (std::size_t i = 0; i < m_code.size();) {
+    const auto &info = GetOpcodeInfo(m_code[i].to_ulong());
+    cycles += info.cycles;
+    i += info.length;
+  }
+  return cycles;
+}
+
 void ParseExpression8Bits(const std::shared_ptr<Node> &node,
                           CodeGenerator &code) {
   // expressions leave the result in al
@@ -306,6 +337,8 @@ void ParseWhile(const std::shared_ptr<Node> &node, const SymbolsTable &symbols,
     ParseScope(whilebody, symbols, code);
   }
 
+  // the jump back belongs to the while, not to the last line of its body
+  code.MarkLine(node->GetLine());
   code.Jmp(preconditionAddr);
   code.ReplaceJumpPlaceholder(whileblockPlaceholder);
 }
@@ -348,6 +381,7 @@ void ParseIf(const std::shared_ptr<Node> &node, const SymbolsTable &symbols,
 
 void ParseNode(const std::shared_ptr<Node> &node, const SymbolsTable &symbols,
                CodeGenerator &code) {
+  code.MarkLine(node->GetLine());
   switch (node->GetType()) {
   case NodeType::Variable:
     // var declaration ignore
@@ -393,7 +427,8 @@ void ParseScope(const std::shared_ptr<Tree> &tree, const SymbolsTable &symbols,
 }
 
 std::vector<std::bitset<8>> GenerateCode(const Tree &ast,
-                                         const SymbolsTable &symbols) {
+                                         const SymbolsTable &symbols,
+                                         std::vector<SourceLine> &lines) {
 
   CodeGenerator code;
   ParseScope(std::make_shared<Tree>(ast), symbols, code);
@@ -403,5 +438,6 @@ std::vector<std::bitset<8>> GenerateCode(const Tree &ast,
   code.Print();
 #endif
 
+  lines = code.GetLines();
   return code.GetCode();
 }
@@ -7,6 +7,12 @@
 #include <unordered_map>
 #include <vector>
 
+// the code generated for line of the source starts at offset
+struct SourceLine {
+  std::size_t offset;
+  int line;
+};
+
 class CodeGenerator {
 public:
   void Push();
@@ -39,9 +45,15 @@ public:
   void Sub(int op);
   void Cmp(int op);
   void Hlt();
+  // the code generated from now on comes from line
+  void MarkLine(int line);
   std::vector<std::bitset<8>> GetCode();
+  // sorted by offset, one entry per change of line
+  std::vector<SourceLine> GetLines();
   void Print();
   std::size_t Size();
+  // microcycles of the code executed from the first to the last byte
+  std::size_t Cycles();
 
 private:
   void LoadVariableDSDI(const std::string &variable);
@@ -50,10 +62,11 @@ private:
   void ParseALEval();
   void LoadOffset(int off);
   std::vector<std::bitset<8>> m_code;
+  std::vector<SourceLine> m_lines;
   std::unordered_map<std::string, std::bitset<16>> m_varToAddr;
   std::bitset<16> m_sp;
 };
 
 std::vector<std::bitset<8>> GenerateCode(const Tree &program,
-                                         const SymbolsTable &symbols);
-                                         bool debug = false);
+                                         const SymbolsTable &symbols,
+                                         std::vector<SourceLine> &lines);
@@ -1,18 +1,127 @@
 #include "lexy.h"
 
 //#include "codegenerator.h"
+#include "../../common/executable.h"
 #include "ast.h"
 #include "codegenerator.h"
 #include "semantic.h"
 #include "spdlog/sinks/basic_file_sink.h"
 #include "spdlog/spdlog.h"
 #include "token.h"
+#include <cstring>
 #include <fstream>
 #include <iostream>
 #include <memory>
+#include <vector>
 
 #include <unistd.h>
 
+// the processor resets to F000:0000, the start of the EPROM
+#define ENTRY_CS 0xF000
+#define ENTRY_IP 0x0000
+#define ROM_ADDRESS 0xF0000
+// the interrupt vector table at the start of the RAM, 4 bytes per type
+#define INTERRUPT_TABLE_ADDRESS 0x00000
+#define INTERRUPT_TYPES 256
+
+namespace {
+struct Section {
+  Executable::SectionType type;
+  uint32_t address;
+  std::vector<uint8_t> content;
+};
+
+std::size_t Align(std::size_t offset, std::size_t alignment) {
+  return (offset + alignment - 1) / alignment * alignment;
+}
+
+template <typename T>
+void Append(std::vector<uint8_t> &content, const T &value) {
+  auto bytes = (const uint8_t *)&value;
+  content.insert(content.end(), bytes, bytes + sizeof(value));
+}
+
+Executable::Symbol MakeSymbol(uint32_t address, const char *name) {
+  Executable::Symbol symbol = {};
+  symbol.address = address;
+  std::strncpy(symbol.name, name, sizeof(symbol.name) - 1);
+  return symbol;
+}
+
+// ME88 executable with the code at the start of the EPROM, the interrupt
+// vectors, the symbols and the line table, see common/executable.h. The
+// program keeps its variables on the stack, there is no data section
+bool WriteExecutable(const std::string &fileName,
+                     const std::vector<std::bitset<8>> &machinecode,
+                     const std::vector<SourceLine> &lines) {
+  Section code = {Executable::SectionType::Code, ROM_ADDRESS, {}};
+  for (auto byte : machinecode) {
+    code.content.push_back(byte.to_ulong());
+  }
+
+  // the code ends with a hlt, every interrupt the program does not handle
+  // stops there
+  uint16_t haltIP = ENTRY_IP + code.content.size() - 1;
+  Section interrupts = {Executable::SectionType::Interrupts,
+                        INTERRUPT_TABLE_ADDRESS, {}};
+  for (int type = 0; type < INTERRUPT_TYPES; type++) {
+    interrupts.content.push_back(haltIP >> 8);
+    interrupts.content.push_back(haltIP & 0xFF);
+    interrupts.content.push_back(ENTRY_CS >> 8);
+    interrupts.content.push_back(ENTRY_CS & 0xFF);
+  }
+
+  Section symbols = {Executable::SectionType::Symbols, 0, {}};
+  Append(symbols.content, MakeSymbol(ROM_ADDRESS, "_start"));
+  Append(symbols.content, MakeSymbol(ROM_ADDRESS + haltIP, "_halt"));
+
+  Section lineTable = {Executable::SectionType::Lines, 0, {}};
+  for (const auto &line : lines) {
+    Append(lineTable.content,
+           Executable::Line{(uint32_t)(ROM_ADDRESS + line.offset),
+                            (uint32_t)line.line});
+  }
+
+  std::vector<Section> sections = {code, interrupts, symbols, lineTable};
+  Executable::Header header = {};
+  std::memcpy(header.magic, EXECUTABLE_MAGIC, sizeof(EXECUTABLE_MAGIC));
+  header.version = EXECUTABLE_VERSION;
+  header.sectionCount = sections.size();
+  header.entryCS = ENTRY_CS;
+  header.entryIP = ENTRY_IP;
+
+  // the memory devices map code, data and interrupts straight from the file
+  std::vector<Executable::SectionHeader> headers;
+  auto headersSize = sections.size() * sizeof(Executable::SectionHeader);
+  auto offset = sizeof(header) + headersSize;
+  for (const auto &section : sections) {
+    auto loadable = section.type != Executable::SectionType::Symbols &&
+                    section.type != Executable::SectionType::Lines;
+    offset = Align(offset, loadable ? EXECUTABLE_ALIGNMENT : 4);
+    headers.push_back({(uint32_t)section.type, section.address,
+                       (uint32_t)offset, (uint32_t)section.content.size()});
+    offset += section.content.size();
+  }
+
+  std::ofstream file(fileName, std::ios::binary);
+  if (!file.is_open()) {
+    return false;
+  }
+
+  file.write((const char *)&header, sizeof(header));
+  file.write((const char *)headers.data(), headersSize);
+  auto written = sizeof(header) + headersSize;
+  for (std::size_t i = 0; i < sections.size(); i++) {
+    std::vector<char> padding(headers[i].offset - written, 0);
+    file.write(padding.data(), padding.size());
+    file.write((const char *)sections[i].content.data(),
+               sections[i].content.size());
+    written = headers[i].offset + sections[i].content.size();
+  }
+  return file.good();
+}
+} // namespace
+
 int main(int argc, char *argv[]) {
 #ifdef NDEBUG
   if (argc == 1) {
@@ -46,11 +155,22 @@ int main(int argc, char *argv[]) {
     return 0;
   }
 
-  std::ofstream outfile(std::string(fileName) + ".bin");
-  auto machinecode = GenerateCode(AST, symbols);
+  std::vector<SourceLine> lines;
+  auto machinecode = GenerateCode(AST, symbols, lines);
+  auto outName = std::string(fileName) + ".bin";
+
+  // one byte per line in binary, what the emulator used to read
+  if (argc > 2 && std::string(argv[2]) == "--text") {
+    std::ofstream outfile(outName);
+    for (auto code : machinecode) {
+      outfile << code << std::endl;
+    }
+    return 0;
+  }
 
-  for (auto code : machinecode) {
-    outfile << code << std::endl;
+  if (!WriteExecutable(outName, machinecode, lines)) {
+    spdlog::error("Cannot write {}.", outName);
+    return 1;
   }
 
   return 0;
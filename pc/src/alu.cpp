@@ -0,0 +1,238 @@
+#include "alu.h"
+#include "registers.h"
+#include <array>
+#include <immintrin.h>
+#include <vector>
+
+#define SIZE_ALU 8
+#define MSB (SIZE_ALU - 1)
+
+#define ARITHMETIC_FLAGS ((1 << FLAG_CF) | (1 << FLAG_ZF) | (1 << FLAG_SF) | (1 << FLAG_OF))
+#define LOGIC_FLAGS ((1 << FLAG_ZF) | (1 << FLAG_SF))
+
+namespace
+{
+	const int OPERATIONS = (int)ALU::Operation::SAR + 1;
+
+	//every entry holds the result in the low byte and the flags in the high one
+	struct Tables
+	{
+		std::array<uint8_t, OPERATIONS> masks;
+		//binary operations are indexed by AL and source, unary ones by AL only
+		std::array<uint8_t, OPERATIONS> alShifts;
+		std::array<uint8_t, OPERATIONS> sourceMasks;
+		std::array<std::vector<uint16_t>, OPERATIONS> results;
+	};
+
+	bool Bit(unsigned value, int index)
+	{
+		return (value >> index) & 1;
+	}
+
+	uint16_t Compute(ALU::Operation operation, uint8_t al, uint8_t source)
+	{
+		//  CF  is set if there is an overflow when the operands are
+		//      considered natural number
+		//  OF  is set if there is an overflow when the operands are
+		//      considered integers
+		//  ZF  is set when the result of the last operation is 0
+		//
+		//  SF  is set when the most significant bit is set to 1
+		//      for integers means the result is negative
+		bool cf = false, of = false, zf, sf;
+
+		switch (operation)
+		{
+		case ALU::Operation::ADD:
+		case ALU::Operation::SUB:
+		{
+			uint8_t localSource = operation == ALU::Operation::SUB ? -source : source;
+			bool sameSign = Bit(al, MSB) & Bit(source, MSB);
+			unsigned sum = al + localSource;
+			cf = Bit(sum, SIZE_ALU);
+			al = sum;
+			of = cf || (sameSign && (Bit(localSource, MSB) != Bit(al, MSB)));
+		}
+		break;
+		case ALU::Operation::AND:
+			al &= source;
+			break;
+		case ALU::Operation::OR:
+			al |= source;
+			break;
+		case ALU::Operation::NOT:
+			al = ~al;
+			break;
+		case ALU::Operation::SHL:
+		case ALU::Operation::SAL:
+			cf = Bit(al, MSB);
+			of = operation == ALU::Operation::SAL && Bit(al, MSB) != Bit(al, MSB - 1);
+			al <<= 1;
+			break;
+		case ALU::Operation::SHR:
+		case ALU::Operation::SAR:
+			cf = Bit(al, 0);
+			al = operation == ALU::Operation::SAR ? (al >> 1) | (al & (1 << MSB)) : al >> 1;
+			break;
+		default:
+			break;
+		}
+
+		sf = Bit(al, MSB); //TO DO should this be set in case of CMP?
+		zf = al == 0;
+
+		if (operation == ALU::Operation::CMP)
+		{
+			zf = al == source;
+			cf = al > source;
+			if (Bit(al, MSB) != Bit(source, MSB))
+			{
+				of = Bit(source, MSB);
+			}
+			else if (!Bit(al, MSB))
+			{
+				of = cf && !zf;
+			}
+			else
+			{
+				of = !cf && !zf;
+			}
+		}
+
+		uint8_t flags = (cf << FLAG_CF) | (zf << FLAG_ZF) | (sf << FLAG_SF) | (of << FLAG_OF);
+		return (flags << 8) | al;
+	}
+
+	bool IsBinary(ALU::Operation operation)
+	{
+		switch (operation)
+		{
+		case ALU::Operation::ADD:
+		case ALU::Operation::SUB:
+		case ALU::Operation::CMP:
+		case ALU::Operation::AND:
+		case ALU::Operation::OR:
+			return true;
+		default:
+			return false;
+		}
+	}
+
+	Tables BuildTables()
+	{
+		Tables tables;
+		for (int op = 0; op < OPERATIONS; op++)
+		{
+			auto operation = (ALU::Operation)op;
+			switch (operation)
+			{
+			case ALU::Operation::None:
+			case ALU::Operation::AND:
+			case ALU::Operation::OR:
+			case ALU::Operation::NOT:
+				tables.masks[op] = LOGIC_FLAGS;
+				break;
+			default:
+				tables.masks[op] = ARITHMETIC_FLAGS;
+				break;
+			}
+
+			bool binary = IsBinary(operation);
+			tables.alShifts[op] = binary ? 8 : 0;
+			tables.sourceMasks[op] = binary ? 0xFF : 0x00;
+
+			int sources = binary ? 256 : 1;
+			auto &results = tables.results[op];
+			//one more entry, the gathers of ExecuteLanes read 4 bytes for every entry
+			results.resize(256 * sources + 1);
+			for (int al = 0; al < 256; al++)
+			{
+				for (int source = 0; source < sources; source++)
+				{
+					results[(al << tables.alShifts[op]) | source] = Compute(operation, al, source);
+				}
+			}
+		}
+
+		return tables;
+	}
+
+	const Tables g_tables = BuildTables();
+	const bool g_avx2 = __builtin_cpu_supports("avx2");
+
+	__attribute__((target("avx2"))) __m128i PackBytes(__m256i values)
+	{
+		auto words = _mm_packus_epi32(_mm256_castsi256_si128(values), _mm256_extracti128_si256(values, 1));
+		return _mm_packus_epi16(words, words);
+	}
+
+	//8 lanes at a time: gather the entries, then blend the new AL and flags into the selected lanes
+	__attribute__((target("avx2"))) void ExecuteLanesAVX2(int op, uint8_t *al, const uint8_t *source, uint8_t *flags, uint32_t lanes)
+	{
+		auto table = (const int *)g_tables.results[op].data();
+		auto shift = _mm_cvtsi32_si128(g_tables.alShifts[op]);
+		auto sourceMask = _mm256_set1_epi32(g_tables.sourceMasks[op]);
+		auto flagMask = _mm256_set1_epi32(g_tables.masks[op]);
+		auto byteMask = _mm256_set1_epi32(0xFF);
+		auto bits = _mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, (char)128, 0, 0, 0, 0, 0, 0, 0, 0);
+
+		for (int group = 0; group < ALU::LANES; group += 8)
+		{
+			uint8_t selected = lanes >> group;
+			if (selected == 0)
+				continue;
+
+			auto oldAl = _mm_loadl_epi64((const __m128i *)(al + group));
+			auto oldFlags = _mm_loadl_epi64((const __m128i *)(flags + group));
+			auto a = _mm256_cvtepu8_epi32(oldAl);
+			auto s = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(source + group)));
+			auto f = _mm256_cvtepu8_epi32(oldFlags);
+
+			auto index = _mm256_or_si256(_mm256_sll_epi32(a, shift), _mm256_and_si256(s, sourceMask));
+			auto entry = _mm256_i32gather_epi32(table, index, 2);
+			auto result = _mm256_and_si256(entry, byteMask);
+			auto newFlags = _mm256_or_si256(_mm256_andnot_si256(flagMask, f), _mm256_and_si256(_mm256_srli_epi32(entry, 8), flagMask));
+
+			auto blend = _mm_cmpeq_epi8(_mm_and_si128(_mm_set1_epi8(selected), bits), bits);
+			_mm_storel_epi64((__m128i *)(al + group), _mm_blendv_epi8(oldAl, PackBytes(result), blend));
+			_mm_storel_epi64((__m128i *)(flags + group), _mm_blendv_epi8(oldFlags, PackBytes(newFlags), blend));
+		}
+	}
+} // namespace
+
+ALU::Operation ALU::GetOperation(uint8_t opcode)
+{
+	return GetOpcodeInfo(opcode).alu;
+}
+
+uint8_t ALU::Execute(Operation operation, uint8_t al, uint8_t source, uint8_t &flags)
+{
+	auto op = (int)operation;
+	auto entry = g_tables.results[op][(al << g_tables.alShifts[op]) | (source & g_tables.sourceMasks[op])];
+	auto mask = g_tables.masks[op];
+	flags = (flags & ~mask) | ((entry >> 8) & mask);
+	return entry;
+}
+
+ALU::Table ALU::GetTable(Operation operation)
+{
+	auto op = (int)operation;
+	return {g_tables.results[op].data(), g_tables.alShifts[op], g_tables.sourceMasks[op], g_tables.masks[op]};
+}
+
+void ALU::ExecuteLanes(Operation operation, uint8_t *al, const uint8_t *source, uint8_t *flags, uint32_t lanes)
+{
+	if (g_avx2)
+	{
+		ExecuteLanesAVX2((int)operation, al, source, flags, lanes);
+		return;
+	}
+
+	for (int lane = 0; lane < LANES; lane++)
+	{
+		if ((lanes >> lane) & 1)
+		{
+			al[lane] = Execute(operation, al[lane], source[lane], flags[lane]);
+		}
+	}
+}
@@ -0,0 +1,30 @@
+#pragma once
+#include "../../common/opcodeinfo.h"
+#include <cstdint>
+
+namespace ALU
+{
+	using Operation = AluOperation;
+
+	Operation GetOperation(uint8_t opcode);
+
+	//returns the new AL and updates CF, ZF, SF and OF in flags.
+	//Results and flags come from tables precomputed for every AL and source value.
+	uint8_t Execute(Operation operation, uint8_t al, uint8_t source, uint8_t &flags);
+
+	//the table behind Execute, for the code generated by JitProcessor:
+	//entry = results[(al << alShift) | (source & sourceMask)], flags = (flags & ~flagMask) | ((entry >> 8) & flagMask)
+	struct Table
+	{
+		const uint16_t *results;
+		uint8_t alShift;
+		uint8_t sourceMask;
+		uint8_t flagMask;
+	};
+	Table GetTable(Operation operation);
+
+	//Execute for the lanes set in lanes, every array has LANES entries. Uses AVX2 gathers from the
+	//same tables when the processor has them, so the results are the same of Execute.
+	constexpr int LANES = 32;
+	void ExecuteLanes(Operation operation, uint8_t *al, const uint8_t *source, uint8_t *flags, uint32_t lanes);
+} // namespace ALU
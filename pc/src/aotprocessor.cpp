@@ -0,0 +1,80 @@
+#include "aotprocessor.h"
+#include "registers.h"
+
+AotProcessor::AotProcessor(Bus &bus) : FastProcessor(bus), m_image(nullptr), m_imageStale(false)
+{
+}
+
+std::vector<AotProcessor::Image> &AotProcessor::GetImages()
+{
+	static std::vector<Image> images;
+	return images;
+}
+
+bool AotProcessor::Register(const Image &image)
+{
+	GetImages().push_back(image);
+	return true;
+}
+
+const AotProcessor::Image *AotProcessor::FindImage() const
+{
+	for (const auto &image : GetImages())
+	{
+		bool match = true;
+		for (std::size_t i = 0; match && i < image.size; i++)
+		{
+			auto device = m_Bus.GetDevice(image.base + i);
+			uint8_t data;
+			match = device != nullptr && device->IsReadOnly() && device->Peek(image.base + i, data) && data == image.rom[i];
+		}
+
+		if (match)
+			return &image;
+	}
+
+	return nullptr;
+}
+
+void AotProcessor::Step()
+{
+	if (m_imageStale)
+	{
+		m_image = FindImage();
+		m_imageStale = false;
+	}
+
+	//the generated code starts between two instructions, interrupts are only taken by FastProcessor
+	if (m_image != nullptr && m_STAR == Star::fetch0 && !GetFlag(FLAG_IF) && !IsObserved())
+	{
+		auto cycles = m_cycles;
+		StartNativeStep();
+		m_image->run(*this);
+		if (m_cycles != cycles)
+			return;
+	}
+
+	FastProcessor::Step();
+}
+
+void AotProcessor::OnReset()
+{
+	FastProcessor::OnReset();
+	m_image = FindImage();
+	m_imageStale = false;
+}
+
+bool AotProcessor::SetState(const State &state)
+{
+	if (!FastProcessor::SetState(state))
+		return false;
+
+	//a snapshot may bring another ROM, and Snapshot::Load restores its pages after the state
+	m_imageStale = true;
+	return true;
+}
+
+bool AotProcessor::HasProgram() const
+{
+	return m_imageStale ? FindImage() != nullptr : m_image != nullptr;
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include "fastprocessor.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+//Defined by the C++ that ME88Recompile generates from a ROM, at most one of them per binary.
+class AotProgram;
+
+//Runs the ROM as the native code ME88Recompile generated for it, when the binary was built with
+//ME88_AOT_ROM and the ROM on the bus is the one the code was generated from. Everything the
+//generated code does not cover (code in RAM, the targets it could not resolve, in/out, hlt, int,
+//iret, cli, sti, interrupts and tracing) goes through FastProcessor::Step.
+class AotProcessor : public FastProcessor
+{
+public:
+	//runs the blocks from CS:IP until the cycles would go past m_stepLimit or the next target is unknown
+	using Program = void (*)(AotProcessor &processor);
+
+	struct Image
+	{
+		const uint8_t *rom;
+		std::size_t size;
+		//physical address of the first byte of rom
+		uint32_t base;
+		Program run;
+	};
+
+	//called by the generated code before main
+	static bool Register(const Image &image);
+
+	AotProcessor() = delete;
+	AotProcessor(Bus &bus);
+	void Step() override;
+	void OnReset() override;
+	bool SetState(const State &state) override;
+	//false if no generated code matches the ROM on the bus, then it is just a FastProcessor
+	bool HasProgram() const;
+
+private:
+	const Image *m_image;
+	//set by SetState, m_image is matched again on the next Step
+	bool m_imageStale;
+
+	static std::vector<Image> &GetImages();
+	//the image matching the bytes on the bus, nullptr if none
+	const Image *FindImage() const;
+
+	friend class AotProgram;
+};
@@ -0,0 +1,201 @@
+#include "batch.h"
+#include "laneprocessor.h"
+#include "machine.h"
+#include "snapshot.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <unordered_map>
+
+bool Batch::LoadJobs(const std::string &filename, std::vector<Job> &jobs)
+{
+	std::ifstream file(filename);
+	if (!file.is_open())
+	{
+		std::cerr << "Cannot open the job list " << filename << "\n";
+		return false;
+	}
+
+	std::string line;
+	for (int number = 1; std::getline(file, line); number++)
+	{
+		line = line.substr(0, line.find('#'));
+		std::istringstream stream(line);
+		Job job = {"", 0, MemDevice::DEFAULT_FILL_SEED, ""};
+		std::string seed;
+		if (!(stream >> job.rom))
+			continue;
+
+		if (!(stream >> job.maxCycles))
+		{
+			std::cerr << filename << ":" << number << ": expected rom maxCycles [seed [snapshot]]\n";
+			return false;
+		}
+
+		if (stream >> seed)
+		{
+			char *end;
+			auto value = strtoull(seed.c_str(), &end, 0);
+			if (*end != 0 || value > UINT32_MAX)
+			{
+				std::cerr << filename << ":" << number << ": expected a 32 bits seed, not " << seed << "\n";
+				return false;
+			}
+			job.seed = value;
+			stream >> job.state;
+		}
+		jobs.push_back(job);
+	}
+
+	return true;
+}
+
+namespace
+{
+	//nullptr if the job cannot start
+	std::unique_ptr<Machine> CreateMachine(const Batch::Job &job, const std::shared_ptr<const RomImage> &program, Machine::Engine engine, const Machine::Timing &timing)
+	{
+		if (program == nullptr)
+			return nullptr;
+
+		auto machine = std::make_unique<Machine>(program, engine, job.seed, timing);
+		if (!machine->IsValid())
+			return nullptr;
+
+		if (!job.state.empty())
+		{
+			uint32_t seed;
+			if (!Snapshot::Load(job.state, machine->GetCPU(), machine->GetDevices(), seed))
+				return nullptr;
+
+			machine->SetFillSeed(seed);
+		}
+
+		return machine;
+	}
+
+	Batch::Result GetResult(Machine &machine, double seconds)
+	{
+		auto &processor = machine.GetCPU();
+		auto status = processor.GetStatus();
+		Batch::Result result;
+		result.valid = true;
+		result.halted = processor.IsHalted();
+		result.cycles = status.cycles;
+		result.instructions = status.instructions;
+		result.cs = status.cs;
+		result.ip = status.ip;
+		result.registerDigest = machine.GetRegisterDigest();
+		result.memoryDigest = machine.GetMemoryDigest();
+		result.seconds = seconds;
+		return result;
+	}
+} // namespace
+
+std::vector<Batch::Result> Batch::Run(const std::vector<Job> &jobs, Machine::Engine engine, const Machine::Timing &timing, int lanes, WorkStealingPool &pool)
+{
+	//jobs usually share a few ROMs, load every one of them once and map it into every machine
+	std::unordered_map<std::string, std::shared_ptr<const RomImage>> roms;
+	for (const auto &job : jobs)
+	{
+		if (roms.count(job.rom) == 0)
+		{
+			roms[job.rom] = RomImage::Load(job.rom);
+			if (roms[job.rom] == nullptr)
+			{
+				std::cerr << "Cannot read the ROM " << job.rom << "\n";
+			}
+		}
+	}
+
+	std::vector<Result> results(jobs.size(), Result{});
+	if (lanes <= 1)
+	{
+		pool.Run(jobs.size(), [&](std::size_t index) {
+			const auto &job = jobs[index];
+			auto start = std::chrono::steady_clock::now();
+			auto machine = CreateMachine(job, roms.at(job.rom), engine, timing);
+			if (!machine)
+				return;
+
+			machine->Run(job.maxCycles);
+			std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+			results[index] = GetResult(*machine, elapsed.count());
+		});
+
+		return results;
+	}
+
+	//every task runs lanes consecutive jobs in lockstep, the machines only provide buses and memory
+	lanes = std::min(lanes, LaneProcessor::LANES);
+	pool.Run((jobs.size() + lanes - 1) / lanes, [&](std::size_t chunk) {
+		auto start = std::chrono::steady_clock::now();
+		std::vector<std::size_t> indices;
+		std::vector<std::unique_ptr<Machine>> machines;
+		std::vector<Bus *> buses;
+		std::vector<uint64_t> maxCycles;
+		for (std::size_t index = chunk * lanes; index < std::min(jobs.size(), (chunk + 1) * lanes); index++)
+		{
+			auto machine = CreateMachine(jobs[index], roms.at(jobs[index].rom), Machine::Engine::Fast, Machine::Timing());
+			if (!machine)
+				continue;
+
+			indices.push_back(index);
+			buses.push_back(&machine->GetBus());
+			maxCycles.push_back(jobs[index].maxCycles);
+			machines.push_back(std::move(machine));
+		}
+
+		LaneProcessor processor(buses);
+		for (std::size_t lane = 0; lane < machines.size(); lane++)
+		{
+			processor.SetState(lane, machines[lane]->GetCPU().GetState());
+		}
+
+		processor.Run(maxCycles);
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+		for (std::size_t lane = 0; lane < machines.size(); lane++)
+		{
+			machines[lane]->GetCPU().SetState(processor.GetState(lane));
+			results[indices[lane]] = GetResult(*machines[lane], elapsed.count());
+		}
+	});
+
+	return results;
+}
+
+void Batch::PrintReport(const std::vector<Job> &jobs, const std::vector<Result> &results, std::size_t threads, double seconds)
+{
+	uint64_t cycles = 0;
+	std::size_t failed = 0;
+	printf("%6s %-8s %12s %10s %9s %16s %16s %12s  %s\n", "job", "end", "cycles", "instr", "CS:IP", "registers", "memory", "cycles/s", "rom");
+	for (std::size_t i = 0; i < jobs.size(); i++)
+	{
+		const auto &result = results[i];
+		if (!result.valid)
+		{
+			failed++;
+			printf("%6zu %-8s %12s %10s %9s %16s %16s %12s  %s\n", i, "error", "-", "-", "-", "-", "-", "-", jobs[i].rom.c_str());
+			continue;
+		}
+
+		cycles += result.cycles;
+		printf("%6zu %-8s %12llu %10llu %04X:%04X %016llx %016llx %12llu  %s\n", i, result.halted ? "halted" : "budget",
+					 (unsigned long long)result.cycles, (unsigned long long)result.instructions, result.cs, result.ip,
+					 (unsigned long long)result.registerDigest, (unsigned long long)result.memoryDigest,
+					 (unsigned long long)(result.seconds > 0 ? result.cycles / result.seconds : 0), jobs[i].rom.c_str());
+	}
+
+	printf("jobs = %zu failed = %zu threads = %zu cycles = %llu seconds = %g", jobs.size(), failed, threads,
+				 (unsigned long long)cycles, seconds);
+	if (seconds > 0)
+	{
+		printf(" cycles/s = %llu", (unsigned long long)(cycles / seconds));
+	}
+	printf("\n");
+}
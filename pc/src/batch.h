@@ -0,0 +1,42 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include "machine.h"
+#include "threadpool.h"
+#include <string>
+#include <vector>
+
+//Runs many independent machines, each one with its own ROM, seed and cycle budget.
+namespace Batch
+{
+	struct Job
+	{
+		std::string rom;
+		//0 means until the processor halts
+		uint64_t maxCycles;
+		uint32_t seed;
+		//snapshot to restore after the reset, optional
+		std::string state;
+	};
+
+	struct Result
+	{
+		bool valid;
+		bool halted;
+		uint64_t cycles;
+		uint64_t instructions;
+		uint16_t cs;
+		uint16_t ip;
+		uint64_t registerDigest;
+		uint64_t memoryDigest;
+		//with lanes, the time of the whole group of lanes
+		double seconds;
+	};
+
+	//one job per line: rom maxCycles [seed [snapshot]], everything after # is a comment
+	bool LoadJobs(const std::string &filename, std::vector<Job> &jobs);
+	//lanes > 1 runs that many jobs in lockstep on a LaneProcessor, with the results of Engine::Fast,
+	//only with the default latency
+	std::vector<Result> Run(const std::vector<Job> &jobs, Machine::Engine engine, const Machine::Timing &timing, int lanes, WorkStealingPool &pool);
+	void PrintReport(const std::vector<Job> &jobs, const std::vector<Result> &results, std::size_t threads, double seconds);
+} // namespace Batch
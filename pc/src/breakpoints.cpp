@@ -0,0 +1,93 @@
+#include "breakpoints.h"
+
+#define PAGE_WORDS (Breakpoints::PAGE_SIZE / 64)
+
+Breakpoints::Breakpoints() : m_counts{}, m_hit(false), m_first{Kind::Execute, 0}
+{
+}
+
+void Breakpoints::Set(Kind kind, uint32_t address)
+{
+	if (IsSet(kind, address))
+		return;
+
+	auto index = (address >> PAGE_BITS) & (PAGE_COUNT - 1);
+	auto &page = m_pages[(int)kind][index];
+	if (!page)
+	{
+		page.reset(new uint64_t[PAGE_WORDS]());
+	}
+
+	auto offset = address & (PAGE_SIZE - 1);
+	page[offset >> 6] |= (uint64_t)1 << (offset & 63);
+	m_counts[(int)kind][index]++;
+}
+
+void Breakpoints::Clear(Kind kind, uint32_t address)
+{
+	if (!IsSet(kind, address))
+		return;
+
+	auto index = (address >> PAGE_BITS) & (PAGE_COUNT - 1);
+	auto &page = m_pages[(int)kind][index];
+	auto offset = address & (PAGE_SIZE - 1);
+	page[offset >> 6] &= ~((uint64_t)1 << (offset & 63));
+	if (--m_counts[(int)kind][index] == 0)
+	{
+		page.reset();
+	}
+}
+
+void Breakpoints::ClearAll()
+{
+	for (int kind = 0; kind < (int)Kind::Count; kind++)
+	{
+		for (int index = 0; index < PAGE_COUNT; index++)
+		{
+			m_pages[kind][index].reset();
+			m_counts[kind][index] = 0;
+		}
+	}
+}
+
+bool Breakpoints::IsEmpty() const
+{
+	for (const auto &pages : m_pages)
+	{
+		for (const auto &page : pages)
+		{
+			if (page)
+				return false;
+		}
+	}
+
+	return true;
+}
+
+std::vector<uint32_t> Breakpoints::GetAddresses(Kind kind) const
+{
+	std::vector<uint32_t> addresses;
+	for (int index = 0; index < PAGE_COUNT; index++)
+	{
+		const auto &page = m_pages[(int)kind][index];
+		for (int word = 0; page && word < PAGE_WORDS; word++)
+		{
+			for (auto bits = page[word]; bits != 0; bits &= bits - 1)
+			{
+				addresses.push_back((index << PAGE_BITS) + word * 64 + __builtin_ctzll(bits));
+			}
+		}
+	}
+
+	return addresses;
+}
+
+const Breakpoints::Hit &Breakpoints::GetHit() const
+{
+	return m_first;
+}
+
+void Breakpoints::ClearHit()
+{
+	m_hit = false;
+}
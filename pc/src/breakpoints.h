@@ -0,0 +1,84 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+//Execution breakpoints and read and write watchpoints over the 20 bits physical address space. Every
+//kind has a bitmap per page of 4 KB, allocated with the first address set in the page, so a check is a
+//pointer test for the pages without any. The engines report what they run and what they read and write,
+//the first match is kept as the hit until the caller clears it, see CPU::SetBreakpoints
+class Breakpoints
+{
+public:
+	static const int PAGE_BITS = 12;
+	static const int PAGE_SIZE = 1 << PAGE_BITS;
+	static const int PAGE_COUNT = (1 << 20) >> PAGE_BITS;
+
+	enum class Kind
+	{
+		Execute, //before the instruction at the address runs
+		Read,		 //after a bus read of the address, instruction fetches too
+		Write,	 //after a bus write of the address
+		Count
+	};
+
+	struct Hit
+	{
+		Kind kind;
+		uint32_t address;
+	};
+
+	Breakpoints();
+	Breakpoints(const Breakpoints &) = delete;
+	Breakpoints &operator=(const Breakpoints &) = delete;
+
+	void Set(Kind kind, uint32_t address);
+	void Clear(Kind kind, uint32_t address);
+	void ClearAll();
+	bool IsSet(Kind kind, uint32_t address) const
+	{
+		const auto &page = m_pages[(int)kind][(address >> PAGE_BITS) & (PAGE_COUNT - 1)];
+		auto offset = address & (PAGE_SIZE - 1);
+		return page && ((page[offset >> 6] >> (offset & 63)) & 1);
+	}
+	//no address set of any kind
+	bool IsEmpty() const;
+	//the addresses set, in order
+	std::vector<uint32_t> GetAddresses(Kind kind) const;
+
+	void OnExecute(uint32_t address)
+	{
+		Check(Kind::Execute, address);
+	}
+	void OnRead(uint32_t address)
+	{
+		Check(Kind::Read, address);
+	}
+	void OnWrite(uint32_t address)
+	{
+		Check(Kind::Write, address);
+	}
+
+	bool IsHit() const
+	{
+		return m_hit;
+	}
+	const Hit &GetHit() const;
+	void ClearHit();
+
+private:
+	std::unique_ptr<uint64_t[]> m_pages[(int)Kind::Count][PAGE_COUNT];
+	//addresses set in every page, the bitmap is released at 0
+	uint16_t m_counts[(int)Kind::Count][PAGE_COUNT];
+	bool m_hit;
+	Hit m_first;
+
+	void Check(Kind kind, uint32_t address)
+	{
+		if (!m_hit && IsSet(kind, address))
+		{
+			m_hit = true;
+			m_first = {kind, address};
+		}
+	}
+};
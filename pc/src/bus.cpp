@@ -1,13 +1,38 @@
 #include "bus.h"
-#include <ctime>
+#include <algorithm>
 
-Bus::Bus()
+Bus::Bus() : m_fillSeed(MemDevice::DEFAULT_FILL_SEED)
 {
+	m_pageTable.fill(nullptr);
 }
 
-void Bus::RegisterDevice(MemDevice& device)
+bool Bus::RegisterDevice(MemDevice& device)
 {
+	for (auto dev : m_devices)
+	{
+		if (device.GetFrom() <= dev->GetTo() && dev->GetFrom() <= device.GetTo())
+			return false;
+	}
+
 	m_devices.push_back(&device);
+
+	auto firstPage = device.GetFrom() >> MemDevice::PAGE_BITS;
+	auto lastPage = device.GetTo() >> MemDevice::PAGE_BITS;
+	for (int page = firstPage; page <= lastPage && page < PAGE_COUNT; page++)
+	{
+		auto pageStart = page << MemDevice::PAGE_BITS;
+		auto pageEnd = pageStart + MemDevice::PAGE_SIZE - 1;
+		if (device.GetFrom() <= pageStart && device.GetTo() >= pageEnd)
+		{
+			m_pageTable[page] = &device;
+		}
+		else
+		{
+			m_partialPages[page] = true;
+		}
+	}
+
+	return true;
 }
 
 void Bus::Write(int to, std::bitset<8> data)
@@ -28,12 +53,59 @@ std::bitset<8> Bus::Read(int from)
 		return dev->Read(from);
 	}
 
-	std::srand(std::time(nullptr));
-	return std::rand() % 255;
+	//open bus
+	return MemDevice::GetFillValue(m_fillSeed, from);
+}
+
+void Bus::ReadBlock(int from, uint8_t *data, std::size_t size)
+{
+	while (size > 0)
+	{
+		auto dev = GetDevice(from);
+		std::size_t run = 1;
+		if (dev != nullptr)
+		{
+			run = std::min(size, (std::size_t)(dev->GetTo() - from + 1));
+			dev->ReadBlock(from, data, run);
+		}
+		else
+		{
+			//open bus
+			*data = MemDevice::GetFillValue(m_fillSeed, from);
+		}
+
+		from += run;
+		data += run;
+		size -= run;
+	}
+}
+
+void Bus::SetFillSeed(uint32_t seed)
+{
+	m_fillSeed = seed;
+}
+
+int Bus::GetDeviceIndex(int address)
+{
+	auto dev = GetDevice(address);
+	for (std::size_t i = 0; i < m_devices.size(); i++)
+	{
+		if (m_devices[i] == dev)
+			return (int)i;
+	}
+
+	return -1;
 }
 
 MemDevice* Bus::GetDevice(int address)
 {
+	if (address < 0 || address >= ADDRESS_SPACE)
+		return nullptr;
+
+	auto page = address >> MemDevice::PAGE_BITS;
+	if (!m_partialPages[page])
+		return m_pageTable[page];
+
 	for (auto dev : m_devices)
 	{
 		if (dev->IsAddressInRange(address))
@@ -42,3 +114,20 @@ MemDevice* Bus::GetDevice(int address)
 
 	return nullptr;
 }
+
+int Bus::GetReadLatency(int address)
+{
+	auto dev = GetDevice(address);
+	return dev != nullptr ? dev->GetLatency() : MemDevice::DEFAULT_LATENCY;
+}
+
+bool Bus::HasDefaultLatency() const
+{
+	for (auto dev : m_devices)
+	{
+		if (dev->GetLatency() != MemDevice::DEFAULT_LATENCY)
+			return false;
+	}
+
+	return true;
+}
@@ -1,17 +1,40 @@
 #pragma once
+#include <array>
 #include <bitset>
+#include <cstdint>
 #include "memdevice.h"
 #include <vector>
 
 class Bus
 {
 public:
+	//20 bits physical address space decoded in pages of MemDevice::PAGE_SIZE
+	static const int ADDRESS_BITS = 20;
+	static const int ADDRESS_SPACE = 1 << ADDRESS_BITS;
+	static const int PAGE_COUNT = ADDRESS_SPACE >> MemDevice::PAGE_BITS;
+
 	Bus();
-	void RegisterDevice(MemDevice &device);
+	//false if the device overlaps an already registered one, in that case it is not registered
+	bool RegisterDevice(MemDevice &device);
 	void Write(int to, std::bitset<8> data);
 	std::bitset<8> Read(int from);
+	//Read of size consecutive addresses, decoding the device once for every run of bytes it owns
+	void ReadBlock(int from, uint8_t *data, std::size_t size);
+	void SetFillSeed(uint32_t seed);
+	//index of the device in registration order, -1 if the address is not mapped
+	int GetDeviceIndex(int address);
+	//nullptr if the address is not mapped
+	MemDevice *GetDevice(int address);
+	//wait states of a read from address, MemDevice::DEFAULT_LATENCY for the open bus
+	int GetReadLatency(int address);
+	//true if every device has MemDevice::DEFAULT_LATENCY, the timing of OPCODE_INFO
+	bool HasDefaultLatency() const;
 
 private:
 	std::vector<MemDevice *> m_devices;
-	MemDevice *GetDevice(int address);
-};
\ No newline at end of file
+	//owner of every page fully covered by a single device
+	std::array<MemDevice *, PAGE_COUNT> m_pageTable;
+	//pages shared by more than one device or partially mapped, decoded by scanning m_devices
+	std::bitset<PAGE_COUNT> m_partialPages;
+	uint32_t m_fillSeed;
+};
@@ -0,0 +1,404 @@
+#include "console.h"
+#include "microcode.h"
+#include "registers.h"
+#include "../../common/opcodeinfo.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+
+namespace
+{
+	//hex, or selector:offset in hex
+	bool ParseAddress(const std::string &text, uint32_t &address)
+	{
+		char *end;
+		auto colon = text.find(':');
+		if (colon != std::string::npos)
+		{
+			auto selector = strtoul(text.c_str(), &end, 16);
+			if (end != text.c_str() + colon || selector > 0xFFFF)
+				return false;
+
+			auto offset = strtoul(text.c_str() + colon + 1, &end, 16);
+			if (*end != 0 || end == text.c_str() + colon + 1 || offset > 0xFFFF)
+				return false;
+
+			address = ComputePhysicalAddress(selector, offset);
+			return true;
+		}
+
+		auto value = strtoul(text.c_str(), &end, 16);
+		if (text.empty() || *end != 0 || value > PHYSICAL_ADDRESS_MASK)
+			return false;
+
+		address = value;
+		return true;
+	}
+
+	bool ParseCount(const std::string &text, uint64_t &count)
+	{
+		char *end;
+		count = strtoull(text.c_str(), &end, 0);
+		return !text.empty() && *end == 0;
+	}
+
+	const char *GetKindName(Breakpoints::Kind kind)
+	{
+		switch (kind)
+		{
+		case Breakpoints::Kind::Execute:
+			return "breakpoint";
+		case Breakpoints::Kind::Read:
+			return "read watchpoint";
+		default:
+			return "write watchpoint";
+		}
+	}
+} // namespace
+
+Console::Console(Machine &machine, uint64_t maxCycles, StateExport *stateExport)
+		: m_machine(machine), m_proc(machine.GetCPU()), m_maxCycles(maxCycles), m_stateExport(stateExport)
+{
+}
+
+void Console::Run()
+{
+	printf("ME88 debugger, h for help\n");
+	PrintRegisters();
+
+	std::string line;
+	while (true)
+	{
+		printf("> ");
+		fflush(stdout);
+		if (!std::getline(std::cin, line))
+			break;
+
+		if (line.find_first_not_of(" \t") == std::string::npos)
+		{
+			//enter alone steps a clock cycle, like -d always did
+			line = m_last.empty() ? "m" : m_last;
+		}
+		m_last = line;
+		if (!Execute(line))
+			break;
+	}
+
+	m_proc.SetBreakpoints(nullptr);
+}
+
+bool Console::Execute(const std::string &line)
+{
+	std::istringstream arguments(line);
+	std::string command, text;
+	arguments >> command;
+
+	uint64_t count = 1;
+	if (command == "q")
+		return false;
+
+	if (command == "c")
+	{
+		RunTo(0);
+	}
+	else if (command == "s" || command == "m")
+	{
+		if (arguments >> text && !ParseCount(text, count))
+		{
+			printf("not a count: %s\n", text.c_str());
+			return true;
+		}
+
+		if (command == "s")
+		{
+			StepInstructions(count);
+		}
+		else
+		{
+			StepCycles(count);
+		}
+	}
+	else if (command == "g")
+	{
+		if (!(arguments >> text) || !ParseCount(text, count))
+		{
+			printf("g cycle\n");
+			return true;
+		}
+		RunTo(count);
+	}
+	else if (command == "b" || command == "w" || command == "d")
+	{
+		SetBreakpoint(command, arguments);
+	}
+	else if (command == "l")
+	{
+		PrintBreakpoints();
+	}
+	else if (command == "p")
+	{
+		PrintRegisters();
+	}
+	else if (command == "x")
+	{
+		uint32_t address;
+		count = CONSOLE_DUMP_BYTES;
+		if (!(arguments >> text) || !ParseAddress(text, address) || (arguments >> text && !ParseCount(text, count)))
+		{
+			printf("x address [count]\n");
+			return true;
+		}
+		PrintMemory(address, (uint32_t)std::min<uint64_t>(count, Bus::ADDRESS_SPACE));
+	}
+	else
+	{
+		PrintHelp();
+	}
+
+	return true;
+}
+
+bool Console::SetBreakpoint(const std::string &command, std::istream &arguments)
+{
+	//b address, w r|w|rw address [size], d b|r|w|rw address [size], d all
+	std::string kind = "b";
+	if (command != "b")
+	{
+		arguments >> kind;
+	}
+
+	bool set = command != "d";
+	if (!set && kind == "all")
+	{
+		m_breakpoints.ClearAll();
+		UpdateBreakpoints();
+		return true;
+	}
+
+	std::string text, sizeText;
+	uint32_t address;
+	uint64_t size = 1;
+	bool execute = kind == "b" && command != "w";
+	bool read = kind == "r" || kind == "rw";
+	bool write = kind == "w" || kind == "rw";
+	if ((!execute && !read && !write) || !(arguments >> text) || !ParseAddress(text, address) ||
+			(arguments >> sizeText && !ParseCount(sizeText, size)))
+	{
+		printf(set ? "b address | w r|w|rw address [size]\n" : "d b|r|w|rw address [size] | d all\n");
+		return false;
+	}
+
+	for (uint64_t i = 0; i < size && address + i < Bus::ADDRESS_SPACE; i++)
+	{
+		auto target = (uint32_t)(address + i);
+		if (execute)
+		{
+			set ? m_breakpoints.Set(Breakpoints::Kind::Execute, target) : m_breakpoints.Clear(Breakpoints::Kind::Execute, target);
+		}
+		if (read)
+		{
+			set ? m_breakpoints.Set(Breakpoints::Kind::Read, target) : m_breakpoints.Clear(Breakpoints::Kind::Read, target);
+		}
+		if (write)
+		{
+			set ? m_breakpoints.Set(Breakpoints::Kind::Write, target) : m_breakpoints.Clear(Breakpoints::Kind::Write, target);
+		}
+	}
+
+	UpdateBreakpoints();
+	return true;
+}
+
+void Console::UpdateBreakpoints()
+{
+	//without any the engines keep their shortcuts, --jit still runs translated blocks
+	m_proc.SetBreakpoints(m_breakpoints.IsEmpty() ? nullptr : &m_breakpoints);
+}
+
+void Console::StartRun()
+{
+	m_breakpoints.ClearHit();
+	if (m_started)
+		return;
+
+	m_started = true;
+	auto state = m_proc.GetState();
+	if (state.star == (uint8_t)Star::fetch0)
+	{
+		m_breakpoints.OnExecute(ComputePhysicalAddress(state.cs, state.ip));
+	}
+}
+
+void Console::RunTo(uint64_t cycle)
+{
+	StartRun();
+	UpdateBreakpoints();
+
+	//the engines running more than one instruction per Step must not go past it
+	auto limit = m_maxCycles;
+	if (cycle != 0 && (limit == 0 || cycle < limit))
+	{
+		limit = cycle;
+	}
+	m_proc.SetCycleLimit(limit);
+
+	if (!IsStopped())
+	{
+		while (!Step() && (cycle == 0 || m_proc.GetCycles() < cycle))
+		{
+		}
+	}
+
+	m_proc.SetCycleLimit(m_maxCycles);
+	PrintStop();
+}
+
+void Console::StepCycles(uint64_t count)
+{
+	StartRun();
+	//one instruction at a time at most, even without breakpoints
+	m_proc.SetBreakpoints(&m_breakpoints);
+	for (uint64_t i = 0; i < count && !IsStopped(); i++)
+	{
+		Step();
+	}
+	PrintStop();
+}
+
+void Console::StepInstructions(uint64_t count)
+{
+	StartRun();
+	m_proc.SetBreakpoints(&m_breakpoints);
+	for (uint64_t i = 0; i < count && !IsStopped(); i++)
+	{
+		//Processor needs a Step per clock cycle, up to the fetch0 of the next instruction
+		while (!Step() && m_proc.GetState().star != (uint8_t)Star::fetch0)
+		{
+		}
+	}
+	PrintStop();
+}
+
+bool Console::Step()
+{
+	m_proc.Step();
+	if (m_stateExport)
+	{
+		m_stateExport->Publish();
+	}
+	return IsStopped();
+}
+
+bool Console::IsStopped() const
+{
+	return m_breakpoints.IsHit() || m_proc.IsHalted() || (m_maxCycles != 0 && m_proc.GetCycles() >= m_maxCycles);
+}
+
+void Console::PrintStop()
+{
+	if (m_breakpoints.IsHit())
+	{
+		const auto &hit = m_breakpoints.GetHit();
+		printf("%s at %05X\n", GetKindName(hit.kind), hit.address);
+	}
+	else if (m_proc.IsHalted())
+	{
+		printf("halted\n");
+	}
+	else if (m_maxCycles != 0 && m_proc.GetCycles() >= m_maxCycles)
+	{
+		printf("reached --cycles\n");
+	}
+	PrintRegisters();
+}
+
+void Console::PrintRegisters() const
+{
+	auto state = m_proc.GetState();
+	auto mnemonic = GetOpcodeInfo(state.opcode).mnemonic;
+	printf("cycle %llu instructions %llu state %s CS:IP %04X:%04X (%05X) opcode %02X %s\n",
+				 (unsigned long long)state.cycles, (unsigned long long)state.instructions, GetMicroInstruction((Star)state.star).name,
+				 state.cs, state.ip, ComputePhysicalAddress(state.cs, state.ip), state.opcode, mnemonic ? mnemonic : "?");
+
+	const char letters[] = "CZSOIU";
+	char flags[sizeof(letters)] = {};
+	for (int i = 0; i < (int)sizeof(letters) - 1; i++)
+	{
+		flags[i] = (state.f >> i) & 1 ? letters[i] : '-';
+	}
+	printf("AL %02X AH %02X DS %04X DI %04X SS %04X SP %04X F %s MAR %05X MBR %02X d7_d0 %02X\n", state.al, state.ah,
+				 state.ds, state.di, state.ss, state.sp, flags, state.mar, state.mbr, state.d7d0);
+}
+
+void Console::PrintMemory(uint32_t address, uint32_t count) const
+{
+	auto &bus = m_machine.GetBus();
+	for (uint32_t row = address & ~15u; row < address + count && row < Bus::ADDRESS_SPACE; row += 16)
+	{
+		printf("%05X ", row);
+		for (uint32_t column = row; column < row + 16; column++)
+		{
+			uint8_t data;
+			auto device = bus.GetDevice(column);
+			if (column < address || column >= address + count)
+			{
+				printf("   ");
+			}
+			else if (device != nullptr && device->Peek(column, data))
+			{
+				printf(" %02X", data);
+			}
+			else
+			{
+				//never written or not mapped
+				printf(" ??");
+			}
+		}
+		printf("\n");
+	}
+}
+
+void Console::PrintBreakpoints() const
+{
+	for (int kind = 0; kind < (int)Breakpoints::Kind::Count; kind++)
+	{
+		auto addresses = m_breakpoints.GetAddresses((Breakpoints::Kind)kind);
+		//consecutive addresses as a range
+		for (std::size_t i = 0; i < addresses.size();)
+		{
+			auto end = i + 1;
+			while (end < addresses.size() && addresses[end] == addresses[end - 1] + 1)
+			{
+				end++;
+			}
+
+			if (end - i == 1)
+			{
+				printf("%s %05X\n", GetKindName((Breakpoints::Kind)kind), addresses[i]);
+			}
+			else
+			{
+				printf("%s %05X-%05X\n", GetKindName((Breakpoints::Kind)kind), addresses[i], addresses[end - 1]);
+			}
+			i = end;
+		}
+	}
+}
+
+void Console::PrintHelp() const
+{
+	printf("c                      continue until a breakpoint, a watchpoint, a halt or --cycles\n"
+				 "s [N]                  run N instructions\n"
+				 "m [N]                  run N clock cycles, N instructions with --fast, --jit and --aot\n"
+				 "g N                    run to cycle N\n"
+				 "b address              stop before the instruction at address runs\n"
+				 "w r|w|rw address [N]   stop after a read or a write of the N bytes from address\n"
+				 "d b|r|w|rw address [N] delete, d all deletes everything\n"
+				 "l                      list the breakpoints and watchpoints\n"
+				 "p                      print the registers\n"
+				 "x address [N]          dump N bytes of memory, ?? for the bytes never written\n"
+				 "q                      quit\n"
+				 "addresses are physical in hex or selector:offset, an empty line repeats the last command\n");
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include "breakpoints.h"
+#include "machine.h"
+#include "stateexport.h"
+#include <cstdint>
+#include <string>
+
+//bytes shown by x without a count
+#define CONSOLE_DUMP_BYTES 64
+
+//The debugger of -d: reads commands from stdin, one per line, and runs the machine at full speed
+//between two stops. An empty line repeats the last command, see PrintHelp for the others
+class Console
+{
+public:
+	//stops at maxCycles like the normal run, 0 means never. stateExport can be nullptr
+	Console(Machine &machine, uint64_t maxCycles, StateExport *stateExport);
+	//until q or the end of the input
+	void Run();
+
+private:
+	Machine &m_machine;
+	CPU &m_proc;
+	Breakpoints m_breakpoints;
+	uint64_t m_maxCycles;
+	StateExport *m_stateExport;
+	std::string m_last;
+	//false until the first command running the machine, see StartRun
+	bool m_started = false;
+
+	//false for q
+	bool Execute(const std::string &line);
+	//b, w and d, false if the arguments are not valid
+	bool SetBreakpoint(const std::string &command, std::istream &arguments);
+	void UpdateBreakpoints();
+
+	//clears the last hit. Before the first run it checks the instruction the machine starts at, the
+	//engines only check the ones they move on to
+	void StartRun();
+	//every step until a breakpoint, a watchpoint, a halt or --cycles, or until cycle when it is not 0
+	void RunTo(uint64_t cycle);
+	//count clock cycles with Processor, steps with the other engines
+	void StepCycles(uint64_t count);
+	void StepInstructions(uint64_t count);
+	//true when Step should not be called again
+	bool Step();
+	bool IsStopped() const;
+	void PrintStop();
+
+	void PrintRegisters() const;
+	void PrintMemory(uint32_t address, uint32_t count) const;
+	void PrintBreakpoints() const;
+	void PrintHelp() const;
+};
@@ -0,0 +1,101 @@
+#pragma once
+#include <cstdint>
+#include "breakpoints.h"
+#include "trace.h"
+#include <string>
+
+//common interface of the execution engines
+class CPU
+{
+public:
+	struct Status
+	{
+		int star;
+		int mjr;
+		int d7d0;
+		int cs;
+		int ip;
+		int opcode;
+		int source;
+		int ss;
+		int sp;
+		int ds;
+		int di;
+		int destSel;
+		int destOff;
+		int al;
+		bool cf;
+		bool of;
+		bool sf;
+		bool zf;
+
+		std::string mar;
+		int mbr;
+		int mr_;
+		int mw_;
+
+		uint64_t cycles;
+		uint64_t instructions;
+	};
+
+	//complete register state, enough to continue the execution exactly where it was
+	struct State
+	{
+		uint64_t cycles;
+		uint64_t instructions;
+		uint32_t mar;
+		uint16_t di, ds, cs, ip, ss, sp, destOff, destSel, prevSs, prevSp;
+		uint8_t star, mjr, d7d0, f, al, ah, mbr, opcode, source;
+		uint8_t mr_, mw_, ior_, iow_, inta, dir, intr;
+		//cycles spent in a wait state longer than one cycle, see MemDevice::SetLatency
+		uint8_t wait;
+	};
+
+	virtual ~CPU() = default;
+	//advances the engine by one clock cycle or by one whole instruction, depending on the engine
+	virtual void Step() = 0;
+	virtual void OnReset() = 0;
+	virtual Status GetStatus() const = 0;
+	//true when the processor is stuck in a state looping on itself (HLT)
+	virtual bool IsHalted() const = 0;
+	virtual uint64_t GetCycles() const = 0;
+	virtual State GetState() const = 0;
+	//false if the engine cannot continue from the state, e.g. FastProcessor in the middle of an instruction
+	virtual bool SetState(const State &state) = 0;
+	//the caller stops stepping once the cycles reach limit, 0 means never. Engines running more than one
+	//instruction per Step use it not to go past it, see JitProcessor
+	virtual void SetCycleLimit(uint64_t limit)
+	{
+	}
+
+	//records every bus transaction in the trace ring buffer, off by default.
+	//FastProcessor stamps the records with the cycle its instruction started at.
+	void SetTracing(bool enabled)
+	{
+		m_tracing = enabled;
+	}
+	const Trace &GetTrace() const
+	{
+		return m_trace;
+	}
+
+	//reports the instructions and the bus transactions to breakpoints, nullptr to stop. Only set them
+	//when some address is set: like the tracing it makes every engine run one instruction at a time,
+	//every byte through the bus. Processor stops checking in the cycle of the hit, the other engines at
+	//the end of the instruction
+	void SetBreakpoints(Breakpoints *breakpoints)
+	{
+		m_breakpoints = breakpoints;
+	}
+
+protected:
+	bool m_tracing = false;
+	Trace m_trace;
+	Breakpoints *m_breakpoints = nullptr;
+
+	//the engines skip their shortcuts, decode cache, blocks and block reads, to show every bus transaction
+	bool IsObserved() const
+	{
+		return m_tracing || m_breakpoints != nullptr;
+	}
+};
@@ -0,0 +1,38 @@
+#include "decodecache.h"
+#include <algorithm>
+
+bool DecodeCache::Insert(uint32_t address, const Entry &entry)
+{
+	auto offset = address & (MemDevice::PAGE_SIZE - 1);
+	if (offset + entry.length > MemDevice::PAGE_SIZE)
+		return false;
+
+	auto &page = m_pages[address >> MemDevice::PAGE_BITS];
+	if (page == nullptr)
+	{
+		page = std::make_unique<Page>();
+	}
+
+	(*page)[offset] = entry;
+	return true;
+}
+
+void DecodeCache::InvalidateEntries(Page &page, int offset)
+{
+	//the instructions starting up to MAX_LENGTH - 1 bytes before can include the byte
+	for (int start = std::max(0, offset - (MAX_LENGTH - 1)); start <= offset; start++)
+	{
+		if (start + page[start].length > offset)
+		{
+			page[start].length = 0;
+		}
+	}
+}
+
+void DecodeCache::Clear()
+{
+	for (auto &page : m_pages)
+	{
+		page.reset();
+	}
+}
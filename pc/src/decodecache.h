@@ -0,0 +1,52 @@
+#pragma once
+#include "bus.h"
+#include "memdevice.h"
+#include <array>
+#include <cstdint>
+#include <memory>
+
+//Instructions already fetched, keyed by the physical address of the opcode.
+//Pages get their entries the first time an instruction is stored in them. An instruction never
+//crosses a page, so a write only has to drop the few entries that can cover the written byte.
+class DecodeCache
+{
+public:
+	static const int MAX_LENGTH = 5;
+
+	struct Entry
+	{
+		uint8_t length; //0 for no instruction
+		uint8_t opcode;
+		uint8_t operands[MAX_LENGTH - 1];
+	};
+
+	//nullptr if there is no instruction at address
+	const Entry *Find(uint32_t address) const
+	{
+		auto &page = m_pages[address >> MemDevice::PAGE_BITS];
+		if (page == nullptr)
+			return nullptr;
+
+		auto &entry = (*page)[address & (MemDevice::PAGE_SIZE - 1)];
+		return entry.length != 0 ? &entry : nullptr;
+	}
+
+	//false if the instruction crosses a page and cannot be stored
+	bool Insert(uint32_t address, const Entry &entry);
+
+	//called on every write
+	void Invalidate(uint32_t address)
+	{
+		auto &page = m_pages[address >> MemDevice::PAGE_BITS];
+		if (page != nullptr)
+			InvalidateEntries(*page, address & (MemDevice::PAGE_SIZE - 1));
+	}
+
+	void Clear();
+
+private:
+	using Page = std::array<Entry, MemDevice::PAGE_SIZE>;
+	std::array<std::unique_ptr<Page>, Bus::PAGE_COUNT> m_pages;
+
+	void InvalidateEntries(Page &page, int offset);
+};
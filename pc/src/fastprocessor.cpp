@@ -0,0 +1,575 @@
+#include "fastprocessor.h"
+#include "alu.h"
+#include "instruction.h"
+#include "registers.h"
+#include "../../common/opcodeinfo.h"
+#include <algorithm>
+#include <bitset>
+
+//the native code of JitProcessor and AotProcessor gives the control back to Step at least this often
+#define MAX_STEP_CYCLES (1 << 16)
+
+FastProcessor::FastProcessor(Bus &bus) : m_Bus(bus), m_cycles(0), m_instructions(0)
+{
+}
+
+void FastProcessor::SetCycleLimit(uint64_t limit)
+{
+	m_cycleLimit = limit == 0 ? UINT64_MAX : limit;
+}
+
+void FastProcessor::StartNativeStep()
+{
+	m_stepLimit = std::min<uint64_t>(m_cycleLimit, m_cycles + MAX_STEP_CYCLES);
+}
+
+uint8_t FastProcessor::Read(uint32_t address)
+{
+	if (!m_defaultLatency)
+	{
+		m_waitCycles += m_Bus.GetReadLatency(address) - MemDevice::DEFAULT_LATENCY;
+	}
+	m_d7_d0 = m_Bus.Read(address).to_ulong();
+	if (m_breakpoints)
+	{
+		m_breakpoints->OnRead(address);
+	}
+	if (m_tracing)
+	{
+		m_trace.Add({m_cycles, address, m_d7_d0, Trace::Direction::Read, (int8_t)m_Bus.GetDeviceIndex(address)});
+	}
+	return m_d7_d0;
+}
+
+void FastProcessor::ReadBlock(uint32_t address, uint8_t *data, int size)
+{
+	//the trace has a line per byte
+	if (IsObserved())
+	{
+		for (int i = 0; i < size; i++)
+		{
+			data[i] = Read(address + i);
+		}
+		return;
+	}
+
+	m_Bus.ReadBlock(address, data, size);
+	for (int i = 0; !m_defaultLatency && i < size; i++)
+	{
+		m_waitCycles += m_Bus.GetReadLatency(address + i) - MemDevice::DEFAULT_LATENCY;
+	}
+	m_d7_d0 = data[size - 1];
+}
+
+void FastProcessor::Write(uint32_t address, uint8_t data)
+{
+	m_Bus.Write(address, data);
+	m_decodeCache.Invalidate(address);
+	if (m_breakpoints)
+	{
+		m_breakpoints->OnWrite(address);
+	}
+	if (m_tracing)
+	{
+		m_trace.Add({m_cycles, address, data, Trace::Direction::Write, (int8_t)m_Bus.GetDeviceIndex(address)});
+	}
+}
+
+uint8_t FastProcessor::FetchByte()
+{
+	m_MAR = ComputePhysicalAddress(m_CS, m_IP);
+	m_IP++;
+	return Read(m_MAR);
+}
+
+void FastProcessor::Step()
+{
+	switch (m_STAR)
+	{
+	case Star::fetch0:
+		Fetch();
+		Execute();
+		m_cycles += GetOpcodeInfo(m_OPCODE).cycles + m_waitCycles;
+		m_waitCycles = 0;
+		break;
+	case Star::pre_tipo0:
+		//pre_tipo0
+		m_DIR = false;
+		m_INTA = true;
+		m_cycles += 1;
+		if (m_intr)
+			break;
+
+		//pre_tipo1, int0 .. int2
+		m_SOURCE = m_d7_d0;
+		m_INTA = false;
+		Interrupt();
+		m_cycles += 4;
+		break;
+	default:
+		//the processor is halted, every cycle goes back to the same state
+		m_cycles++;
+		if (m_STAR == Star::int3)
+		{
+			m_MW_ = true;
+			m_F = 0;
+		}
+		break;
+	}
+
+	if (m_breakpoints && m_STAR == Star::fetch0)
+	{
+		m_breakpoints->OnExecute(ComputePhysicalAddress(m_CS, m_IP));
+	}
+}
+
+DecodeCache::Entry FastProcessor::Decode()
+{
+	//leaves IP, MAR and d7_d0 as the bus fetch of the last byte would
+	auto address = ComputePhysicalAddress(m_CS, m_IP);
+	auto cached = IsObserved() ? nullptr : m_decodeCache.Find(address);
+	if (cached != nullptr && (uint16_t)(m_IP + cached->length - 1) >= m_IP)
+	{
+		m_IP += cached->length;
+		m_MAR = address + cached->length - 1;
+		m_d7_d0 = cached->length == 1 ? cached->opcode : cached->operands[cached->length - 2];
+		for (int i = 0; !m_defaultLatency && i < cached->length; i++)
+		{
+			m_waitCycles += m_Bus.GetReadLatency(address + i) - MemDevice::DEFAULT_LATENCY;
+		}
+		return *cached;
+	}
+
+	DecodeCache::Entry instruction = {};
+	instruction.opcode = FetchByte();
+	instruction.length = GetOpcodeInfo(instruction.opcode).length;
+	int operands = instruction.length - 1;
+	if (operands > 0 && (uint16_t)(m_IP + operands - 1) >= m_IP && m_MAR + operands <= PHYSICAL_ADDRESS_MASK)
+	{
+		//one bus access for all the operands
+		ReadBlock(m_MAR + 1, instruction.operands, operands);
+		m_IP += operands;
+		m_MAR += operands;
+	}
+	else
+	{
+		for (int i = 1; i < instruction.length; i++)
+		{
+			instruction.operands[i - 1] = FetchByte();
+		}
+	}
+
+	//IP wrapping around inside the instruction does not give consecutive addresses
+	if (!IsObserved() && m_MAR == address + instruction.length - 1)
+	{
+		m_decodeCache.Insert(address, instruction);
+	}
+
+	return instruction;
+}
+
+void FastProcessor::Fetch()
+{
+	//fetch0 .. fetch3
+	m_instructions++;
+	auto instruction = Decode();
+	auto operands = instruction.operands;
+	m_OPCODE = instruction.opcode;
+	m_MR_ = true;
+	m_MJR = GetOpcodeInfo(m_OPCODE).executionState;
+
+	switch (Instructions::GetFormatType(m_OPCODE))
+	{
+	case Instructions::Format::F0:
+		break;
+	case Instructions::Format::F1:
+		m_MAR = ComputePhysicalAddress(m_DS, m_DI);
+		m_SOURCE = Read(m_MAR);
+		break;
+	case Instructions::Format::F2:
+		m_DEST_SEL = m_DS;
+		m_DEST_OFF = m_DI;
+		break;
+	case Instructions::Format::F3:
+		m_SOURCE = operands[0];
+		break;
+	case Instructions::Format::F4:
+	{
+		m_MBR = operands[0];
+		auto offset = Concat(operands[1], m_MBR);
+		m_MAR = ComputePhysicalAddress(m_OPCODE == Instructions::IN_OPCODE ? 0x0000 : m_DS, offset);
+		m_SOURCE = Read(m_MAR);
+	}
+	break;
+	case Instructions::Format::F5:
+		m_MBR = operands[0];
+		m_DEST_SEL = m_OPCODE == Instructions::OUT_OPCODE ? 0x0000 : m_DS;
+		m_DEST_OFF = Concat(operands[1], m_MBR);
+		break;
+	case Instructions::Format::F6:
+		m_MBR = operands[0];
+		m_DEST_SEL = m_CS;
+		m_DEST_OFF = Concat(operands[1], m_MBR);
+		break;
+	case Instructions::Format::F7:
+		//the first word ends up overwritten, DEST_SEL is never loaded
+		m_MBR = operands[2];
+		m_DEST_OFF = Concat(operands[3], m_MBR);
+		break;
+	}
+}
+
+void FastProcessor::Execute()
+{
+	switch (m_MJR)
+	{
+	case Star::nop0:
+		break;
+	case Star::hlt0:
+		m_STAR = Star::hlt0;
+		return;
+	case Star::ldah0:
+		m_AH = m_AL;
+		break;
+	case Star::ldal0:
+		m_AL = m_AH;
+		break;
+	case Star::ldds0:
+		m_DS = Concat(m_AH, m_AL);
+		break;
+	case Star::ldss0:
+		m_SS = Concat(m_AH, m_AL);
+		break;
+	case Star::ldsp0:
+		m_SP = Concat(m_AH, m_AL);
+		break;
+	case Star::lddi0:
+		m_DI = Concat(m_AH, m_AL);
+		break;
+	case Star::ldax0:
+		m_AH = m_DS >> 8;
+		m_AL = m_DS;
+		break;
+	case Star::ldax1:
+		m_AH = m_SS >> 8;
+		m_AL = m_SS;
+		break;
+	case Star::ldax2:
+		m_AH = m_SP >> 8;
+		m_AL = m_SP;
+		break;
+	case Star::ldax3:
+		m_AH = m_DI >> 8;
+		m_AL = m_DI;
+		break;
+	case Star::ld0:
+	case Star::out0:
+		//ld0 .. ld2, out0 .. out2
+		m_MAR = ComputePhysicalAddress(m_DEST_SEL, m_DEST_OFF);
+		m_MBR = m_AL;
+		m_DIR = true;
+		Write(m_MAR, m_MBR);
+		break;
+	case Star::arit_log0:
+		ExecuteALU();
+		break;
+	case Star::ldal1:
+		m_AL = m_SOURCE;
+		break;
+	case Star::jmp0:
+		m_CS = m_DEST_SEL;
+		m_IP = IsConditionMatch() ? m_DEST_OFF : m_IP;
+		break;
+	case Star::push0:
+		//push0 .. push2
+		m_MAR = ComputePhysicalAddress(m_SS, m_SP - 1);
+		m_MBR = m_AL;
+		m_DIR = true;
+		Write(m_MAR, m_MBR);
+		m_SP--;
+		break;
+	case Star::pop0:
+		//pop0 .. pop2
+		m_MAR = ComputePhysicalAddress(m_SS, m_SP);
+		m_SP++;
+		m_AL = Read(m_MAR);
+		break;
+	case Star::call0:
+		//call0 .. call5
+		m_DIR = true;
+		m_MAR = ComputePhysicalAddress(m_SS, m_SP - 1);
+		m_MBR = m_IP >> 8;
+		Write(m_MAR, m_MBR);
+		m_SP--;
+		m_MAR = ComputePhysicalAddress(m_SS, m_SP - 1);
+		m_MBR = m_IP;
+		Write(m_MAR, m_MBR);
+		m_SP--;
+		m_IP = m_DEST_OFF;
+		if (m_OPCODE == Instructions::CALLF_OPCODE)
+		{
+			//call6 .. call11
+			m_MAR = ComputePhysicalAddress(m_SS, m_SP - 1);
+			m_MBR = m_CS >> 8;
+			Write(m_MAR, m_MBR);
+			m_SP--;
+			m_MAR = ComputePhysicalAddress(m_SS, m_SP - 1);
+			m_MBR = m_CS;
+			Write(m_MAR, m_MBR);
+			m_SP--;
+			m_CS = m_DEST_SEL;
+		}
+		break;
+	case Star::ret0:
+		//ret0 .. ret3, ret8. retf takes the same path, see opcodeinfo.h
+		m_MAR = ComputePhysicalAddress(m_SS, m_SP);
+		m_SP++;
+		m_MBR = Read(m_MAR);
+		m_MAR = ComputePhysicalAddress(m_SS, m_SP);
+		m_SP++;
+		m_IP = Concat(Read(m_MAR), m_MBR);
+		break;
+	case Star::int0:
+		Interrupt();
+		return;
+	case Star::iret0:
+		//iret0 .. iret11
+		m_MAR = ComputePhysicalAddress(m_SS, m_SP);
+		m_SP++;
+		m_MBR = Read(m_MAR);
+		m_MAR = ComputePhysicalAddress(m_SS, m_SP);
+		m_SP++;
+		m_CS = Concat(Read(m_MAR), m_MBR);
+		m_MAR = ComputePhysicalAddress(m_SS, m_SP);
+		m_SP++;
+		m_MBR = Read(m_MAR);
+		m_MAR = ComputePhysicalAddress(m_SS, m_SP);
+		m_SP++;
+		m_IP = Concat(Read(m_MAR), m_MBR);
+		m_MAR = ComputePhysicalAddress(m_SS, m_SP);
+		m_SP++;
+		m_F = Read(m_MAR) & 0b111111;
+		SwapStacks();
+		m_STAR = Star::fetch0;
+		return;
+	case Star::cli0:
+		SetFlag(FLAG_IF, false);
+		m_STAR = Star::fetch0;
+		return;
+	case Star::sti0:
+		SetFlag(FLAG_IF, true);
+		m_STAR = m_intr ? Star::pre_tipo0 : Star::fetch0;
+		return;
+	case Star::ldpsr0:
+		m_PREV_SS = m_SS;
+		m_PREV_SP = m_SP;
+		break;
+	case Star::stum0:
+	{
+		SetFlag(FLAG_US, true);
+		auto tmp = m_SS;
+		m_SS = m_PREV_SS;
+		m_PREV_SS = tmp;
+		tmp = m_SP;
+		m_SP = m_PREV_SP;
+		m_PREV_SP = tmp;
+	}
+	break;
+	default:
+		m_STAR = Star::hlt0;
+		return;
+	}
+
+	m_STAR = GetNextState();
+}
+
+void FastProcessor::Interrupt()
+{
+	//int0 .. int2
+	SwapStacks();
+	m_SP--;
+	m_MAR = ComputePhysicalAddress(m_SS, m_SP);
+	m_DIR = true;
+	m_MBR = m_F;
+	Write(m_MAR, m_MBR);
+
+	//int3 never moves on to int4, it ends the write of int2 and clears the flags every cycle
+	m_MW_ = false;
+	m_STAR = Star::int3;
+}
+
+void FastProcessor::SwapStacks()
+{
+	if (!GetFlag(FLAG_US))
+		return;
+
+	auto ss = m_SS;
+	m_SS = m_PREV_SS;
+	m_PREV_SS = ss;
+	auto sp = m_SP;
+	m_SP = m_PREV_SP;
+	m_PREV_SP = sp;
+}
+
+Star FastProcessor::GetNextState() const
+{
+	return GetFlag(FLAG_IF) ? Star::pre_tipo0 : Star::fetch0;
+}
+
+void FastProcessor::OnReset()
+{
+	m_DIR = false;
+	m_MR_ = true;
+	m_MW_ = true;
+	m_IOR_ = true;
+	m_IOW_ = true;
+	m_INTA = false;
+	m_intr = false;
+	m_F = 0b000000;
+	m_CS = 0xF000;
+	m_IP = 0x0000;
+	m_STAR = Star::fetch0;
+	m_cycles = 0;
+	m_instructions = 0;
+	m_defaultLatency = m_Bus.HasDefaultLatency();
+	m_waitCycles = 0;
+	m_trace.Clear();
+	m_decodeCache.Clear();
+}
+
+CPU::Status FastProcessor::GetStatus() const
+{
+	Status status;
+	status.star = (int)m_STAR;
+	status.mjr = (int)m_MJR;
+	status.d7d0 = m_d7_d0;
+	status.cs = m_CS;
+	status.ip = m_IP;
+	status.opcode = m_OPCODE;
+	status.source = m_SOURCE;
+	status.ss = m_SS;
+	status.sp = m_SP;
+	status.ds = m_DS;
+	status.di = m_DI;
+	status.destSel = m_DEST_SEL;
+	status.destOff = m_DEST_OFF;
+	status.al = m_AL;
+	status.cf = GetFlag(FLAG_CF);
+	status.of = GetFlag(FLAG_OF);
+	status.sf = GetFlag(FLAG_SF);
+	status.zf = GetFlag(FLAG_ZF);
+	status.mar = std::bitset<20>(m_MAR).to_string();
+	status.mbr = m_MBR;
+	status.mr_ = m_MR_;
+	status.mw_ = m_MW_;
+	status.cycles = m_cycles;
+	status.instructions = m_instructions;
+	return status;
+}
+
+CPU::State FastProcessor::GetState() const
+{
+	State state = {};
+	state.cycles = m_cycles;
+	state.instructions = m_instructions;
+	state.mar = m_MAR;
+	state.di = m_DI;
+	state.ds = m_DS;
+	state.cs = m_CS;
+	state.ip = m_IP;
+	state.ss = m_SS;
+	state.sp = m_SP;
+	state.destOff = m_DEST_OFF;
+	state.destSel = m_DEST_SEL;
+	state.prevSs = m_PREV_SS;
+	state.prevSp = m_PREV_SP;
+	state.star = (uint8_t)m_STAR;
+	state.mjr = (uint8_t)m_MJR;
+	state.d7d0 = m_d7_d0;
+	state.f = m_F;
+	state.al = m_AL;
+	state.ah = m_AH;
+	state.mbr = m_MBR;
+	state.opcode = m_OPCODE;
+	state.source = m_SOURCE;
+	state.mr_ = m_MR_;
+	state.mw_ = m_MW_;
+	state.ior_ = m_IOR_;
+	state.iow_ = m_IOW_;
+	state.inta = m_INTA;
+	state.dir = m_DIR;
+	state.intr = m_intr;
+	return state;
+}
+
+bool FastProcessor::SetState(const State &state)
+{
+	//only the states between two instructions, see Step
+	auto star = (Star)state.star;
+	if (star != Star::fetch0 && star != Star::pre_tipo0 && star != Star::hlt0 && star != Star::nvi0 && star != Star::int3)
+		return false;
+
+	m_cycles = state.cycles;
+	m_instructions = state.instructions;
+	m_MAR = state.mar;
+	m_DI = state.di;
+	m_DS = state.ds;
+	m_CS = state.cs;
+	m_IP = state.ip;
+	m_SS = state.ss;
+	m_SP = state.sp;
+	m_DEST_OFF = state.destOff;
+	m_DEST_SEL = state.destSel;
+	m_PREV_SS = state.prevSs;
+	m_PREV_SP = state.prevSp;
+	m_STAR = (Star)state.star;
+	m_MJR = (Star)state.mjr;
+	m_d7_d0 = state.d7d0;
+	m_F = state.f;
+	m_AL = state.al;
+	m_AH = state.ah;
+	m_MBR = state.mbr;
+	m_OPCODE = state.opcode;
+	m_SOURCE = state.source;
+	m_MR_ = state.mr_;
+	m_MW_ = state.mw_;
+	m_IOR_ = state.ior_;
+	m_IOW_ = state.iow_;
+	m_INTA = state.inta;
+	m_DIR = state.dir;
+	m_intr = state.intr;
+	m_trace.Clear();
+	//the memory may have changed as well
+	m_decodeCache.Clear();
+	return true;
+}
+
+bool FastProcessor::IsHalted() const
+{
+	return m_STAR == Star::hlt0 || m_STAR == Star::nvi0 || m_STAR == Star::int3;
+}
+
+uint64_t FastProcessor::GetCycles() const
+{
+	return m_cycles;
+}
+
+bool FastProcessor::GetFlag(int index) const
+{
+	return (m_F >> index) & 1;
+}
+
+void FastProcessor::SetFlag(int index, bool val)
+{
+	m_F = (m_F & ~(1 << index)) | (val << index);
+}
+
+bool FastProcessor::IsConditionMatch() const
+{
+	return Instructions::IsConditionMatch(m_OPCODE, m_F);
+}
+
+void FastProcessor::ExecuteALU()
+{
+	m_AL = ALU::Execute(ALU::GetOperation(m_OPCODE), m_AL, m_SOURCE, m_F);
+}
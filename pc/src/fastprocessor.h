@@ -0,0 +1,79 @@
+#pragma once
+#include "bus.h"
+#include "cpu.h"
+#include "decodecache.h"
+#include "processor.h"
+#include <cstdint>
+
+//Executes a whole instruction per Step with the same register and flag semantics of Processor.
+//The bus transactions are the same, but every location is read only once, and the cycles are
+//counted as the microstates Processor would have gone through.
+//Fetched instructions are kept in a DecodeCache and fetched again from the bus only after a write
+//to their bytes, or while tracing so that the trace has every fetch.
+class FastProcessor : public CPU
+{
+public:
+	FastProcessor() = delete;
+	FastProcessor(Bus &bus);
+	void Step() override;
+	void OnReset() override;
+	Status GetStatus() const override;
+	bool IsHalted() const override;
+	uint64_t GetCycles() const override;
+	State GetState() const override;
+	bool SetState(const State &state) override;
+	void SetCycleLimit(uint64_t limit) override;
+
+protected:
+	Bus &m_Bus;
+	DecodeCache m_decodeCache;
+	uint64_t m_cycles;
+	uint64_t m_instructions;
+	//false when a device has a latency other than MemDevice::DEFAULT_LATENCY, then every read of the
+	//instruction adds its wait states beyond the default to m_waitCycles, added with the instruction
+	bool m_defaultLatency = true;
+	int64_t m_waitCycles = 0;
+	//UINT64_MAX when there is no limit
+	uint64_t m_cycleLimit = UINT64_MAX;
+	//m_cycles the native code of JitProcessor and AotProcessor must not go past in the current Step
+	uint64_t m_stepLimit = 0;
+
+	uint8_t m_d7_d0 = 0;
+	bool m_intr;
+
+	//Registers
+	uint32_t m_MAR = 0;
+	bool m_MR_;
+	bool m_MW_;
+	bool m_IOR_;
+	bool m_IOW_;
+	bool m_INTA;
+
+	bool m_DIR;
+	uint8_t m_F = 0;
+	uint8_t m_AL = 0, m_AH = 0, m_MBR = 0, m_OPCODE = 0, m_SOURCE = 0;
+	uint16_t m_DI = 0, m_DS = 0, m_CS = 0, m_IP = 0, m_SS = 0, m_SP = 0, m_DEST_OFF = 0, m_DEST_SEL = 0, m_PREV_SS = 0, m_PREV_SP = 0;
+
+	//only fetch0, pre_tipo0 or one of the states looping on themselves
+	Star m_STAR = Star::fetch0, m_MJR = Star::fetch0;
+
+	//sets m_stepLimit before running native code, which gives the control back at least every
+	//MAX_STEP_CYCLES and never goes past the cycle limit
+	void StartNativeStep();
+	uint8_t Read(uint32_t address);
+	//Read of size consecutive addresses
+	void ReadBlock(uint32_t address, uint8_t *data, int size);
+	void Write(uint32_t address, uint8_t data);
+	uint8_t FetchByte();
+	DecodeCache::Entry Decode();
+	void Fetch();
+	void Execute();
+	void Interrupt();
+	void SwapStacks();
+	Star GetNextState() const;
+
+	bool GetFlag(int index) const;
+	void SetFlag(int index, bool val);
+	bool IsConditionMatch() const;
+	void ExecuteALU();
+};
@@ -0,0 +1,130 @@
+#include "histograms.h"
+#include "../../common/opcodeinfo.h"
+#include <cstdio>
+#include <numeric>
+
+#define FORMATS 8
+
+namespace
+{
+	double Divide(uint64_t cycles, uint64_t count)
+	{
+		return count != 0 ? (double)cycles / count : 0;
+	}
+} // namespace
+
+Histograms::Histograms()
+		: m_starEntries{}, m_starCycles{}, m_opcodeInstructions{}, m_opcodeCycles{}, m_interrupts(0), m_interruptCycles(0),
+			m_started(false), m_state(Star::fetch0), m_stateStart(0), m_instructionStart(0), m_interruptStart(0)
+{
+}
+
+void Histograms::OnClock(uint64_t cycle, Star state, uint8_t opcode)
+{
+	if (m_started)
+	{
+		m_starCycles[(int)m_state] += cycle - m_stateStart;
+	}
+	if (!m_started || state != m_state)
+	{
+		m_starEntries[(int)state]++;
+	}
+	m_started = true;
+	m_state = state;
+	m_stateStart = cycle;
+
+	if (state == Star::fetch0)
+	{
+		CloseInstruction(cycle, opcode);
+		m_instructionStart = cycle;
+	}
+	else if (state == Star::pre_tipo0 && m_interruptStart == 0)
+	{
+		m_interruptStart = cycle;
+	}
+}
+
+void Histograms::OnStop(uint64_t cycle, uint8_t opcode)
+{
+	if (!m_started)
+		return;
+
+	//the cycle after the last one counted, like a fetch0 would be
+	m_starCycles[(int)m_state] += cycle + 1 - m_stateStart;
+	CloseInstruction(cycle + 1, opcode);
+}
+
+void Histograms::CloseInstruction(uint64_t cycle, uint8_t opcode)
+{
+	//0 when the run started in the middle of the instruction, from a snapshot
+	if (m_instructionStart != 0)
+	{
+		m_opcodeInstructions[opcode]++;
+		m_opcodeCycles[opcode] += (m_interruptStart != 0 ? m_interruptStart : cycle) - m_instructionStart;
+	}
+
+	if (m_interruptStart != 0)
+	{
+		m_interrupts++;
+		m_interruptCycles += cycle - m_interruptStart;
+	}
+
+	m_instructionStart = 0;
+	m_interruptStart = 0;
+}
+
+bool Histograms::Write(const std::string &path) const
+{
+	auto file = fopen(path.c_str(), "w");
+	if (file == nullptr)
+		return false;
+
+	auto cycles = std::accumulate(m_starCycles, m_starCycles + Microcode::STATES, (uint64_t)0);
+	auto instructions = std::accumulate(m_opcodeInstructions, m_opcodeInstructions + 256, (uint64_t)0);
+	fprintf(file, "cycles = %llu instructions = %llu CPI = %.3f\n", (unsigned long long)cycles,
+					(unsigned long long)instructions, Divide(cycles, instructions));
+	fprintf(file, "hardware interrupts = %llu cycles = %llu cycles/interrupt = %.3f\n", (unsigned long long)m_interrupts,
+					(unsigned long long)m_interruptCycles, Divide(m_interruptCycles, m_interrupts));
+
+	uint64_t formatInstructions[FORMATS] = {};
+	uint64_t formatCycles[FORMATS] = {};
+	for (int opcode = 0; opcode < 256; opcode++)
+	{
+		auto format = (int)GetOpcodeInfo(opcode).format;
+		formatInstructions[format] += m_opcodeInstructions[opcode];
+		formatCycles[format] += m_opcodeCycles[opcode];
+	}
+
+	fprintf(file, "\n%-6s %12s %14s %7s %7s\n", "format", "instructions", "cycles", "%", "CPI");
+	for (int format = 0; format < FORMATS; format++)
+	{
+		fprintf(file, "F%-5d %12llu %14llu %6.2f%% %7.3f\n", format, (unsigned long long)formatInstructions[format],
+						(unsigned long long)formatCycles[format], cycles != 0 ? 100.0 * formatCycles[format] / cycles : 0,
+						Divide(formatCycles[format], formatInstructions[format]));
+	}
+
+	fprintf(file, "\n%-6s %12s %14s %7s %7s  %s\n", "opcode", "instructions", "cycles", "%", "CPI", "mnemonic");
+	for (int opcode = 0; opcode < 256; opcode++)
+	{
+		if (m_opcodeInstructions[opcode] == 0)
+			continue;
+
+		auto mnemonic = GetOpcodeInfo(opcode).mnemonic;
+		fprintf(file, "%02X     %12llu %14llu %6.2f%% %7.3f  %s\n", opcode, (unsigned long long)m_opcodeInstructions[opcode],
+						(unsigned long long)m_opcodeCycles[opcode], cycles != 0 ? 100.0 * m_opcodeCycles[opcode] / cycles : 0,
+						Divide(m_opcodeCycles[opcode], m_opcodeInstructions[opcode]), mnemonic ? mnemonic : "?");
+	}
+
+	fprintf(file, "\n%-12s %12s %14s %7s %13s\n", "state", "entries", "cycles", "%", "cycles/entry");
+	for (int state = 0; state < Microcode::STATES; state++)
+	{
+		if (m_starEntries[state] == 0)
+			continue;
+
+		fprintf(file, "%-12s %12llu %14llu %6.2f%% %13.3f\n", MICROCODE[state].name, (unsigned long long)m_starEntries[state],
+						(unsigned long long)m_starCycles[state], cycles != 0 ? 100.0 * m_starCycles[state] / cycles : 0,
+						Divide(m_starCycles[state], m_starEntries[state]));
+	}
+
+	return fclose(file) == 0;
+}
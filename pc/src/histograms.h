@@ -0,0 +1,45 @@
+#pragma once
+#include "microcode.h"
+#include "../../common/star.h"
+#include <cstdint>
+#include <string>
+
+//Counts where the clock cycles of Processor go: entries and cycles of every microstate, instructions and
+//cycles of every opcode, and the cycles of the hardware interrupt entries, pre_tipo0 up to the next
+//fetch0, which are not charged to any opcode. The cycles of an opcode run from its fetch0 to the next
+//fetch0 or pre_tipo0, wait states included. A microstate repeating itself, a wait state longer than one
+//cycle or hlt0, is entered once. With --fast-bus the skipped wait cycles go to the state before them
+class Histograms
+{
+public:
+	Histograms();
+	Histograms(const Histograms &) = delete;
+	Histograms &operator=(const Histograms &) = delete;
+
+	//every clock cycle, before the processor executes state, with the cycle count already incremented
+	//and the opcode of the previous cycle
+	void OnClock(uint64_t cycle, Star state, uint8_t opcode);
+	//closes the state and the instruction running at cycle, once when the run stops
+	void OnStop(uint64_t cycle, uint8_t opcode);
+
+	//cycles per instruction of every format and opcode, then every microstate
+	bool Write(const std::string &path) const;
+
+private:
+	uint64_t m_starEntries[Microcode::STATES];
+	uint64_t m_starCycles[Microcode::STATES];
+	uint64_t m_opcodeInstructions[256];
+	uint64_t m_opcodeCycles[256];
+	uint64_t m_interrupts;
+	uint64_t m_interruptCycles;
+
+	bool m_started;
+	//the state of the previous cycle and its first cycle
+	Star m_state;
+	uint64_t m_stateStart;
+	//fetch0 of the running instruction, and pre_tipo0 of the interrupt entry following it, 0 if none
+	uint64_t m_instructionStart;
+	uint64_t m_interruptStart;
+
+	void CloseInstruction(uint64_t cycle, uint8_t opcode);
+};
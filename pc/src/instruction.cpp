@@ -1,57 +1,112 @@
 #include "instruction.h"
-#include "../../common/opcode.h"
+#include "registers.h"
+#include <array>
+#include <immintrin.h>
 
-Instructions::Format Instructions::GetFormatType(const std::bitset<8>& opcode)
+namespace
 {
-	return (Format) (opcode[7]*4 + opcode[6]*2 + opcode[5]);
-}
-
-bool Instructions::IsADD(const std::bitset<8>& code)
-{
-	return code == (int)Opcode::add_ds$di_al || code == (int)Opcode::add_operand_al || code == (int)Opcode::add_ds$offset_al;
-}
+	//the conditions depend only on CF, ZF, SF and OF, the 4 low bits of F.
+	//Every opcode gets the 16 possible answers, 0xFF when the jump is taken.
+	using ConditionTable = std::array<std::array<uint8_t, 16>, 256>;
 
-bool Instructions::IsSUB(const std::bitset<8>& code)
-{
-	return code == (int)Opcode::sub_ds$di_al || code == (int)Opcode::sub_operand_al || code == (int)Opcode::sub_ds$offset_al;
-}
+	static_assert(FLAG_CF < 4 && FLAG_ZF < 4 && FLAG_SF < 4 && FLAG_OF < 4, "the condition tables are indexed by the 4 low bits of F");
 
-bool Instructions::IsAND(const std::bitset<8>& code)
-{
-	return code == (int)Opcode::and_ds$di_al || code == (int)Opcode::and_operand_al || code == (int)Opcode::and_ds$offset_al;
-}
+	ConditionTable BuildConditionTable()
+	{
+		ConditionTable table;
+		for (int opcode = 0; opcode < 256; opcode++)
+		{
+			for (int flags = 0; flags < 16; flags++)
+			{
+				table[opcode][flags] = Instructions::IsConditionMatch(opcode, flags) ? 0xFF : 0x00;
+			}
+		}
+		return table;
+	}
 
-bool Instructions::IsOR(const std::bitset<8>& code)
-{
-	return code == (int)Opcode::or_ds$di_al || code == (int)Opcode::or_operand_al || code == (int)Opcode::or_ds$offset_al;
-}
+	const ConditionTable g_conditions = BuildConditionTable();
+	const bool g_avx2 = __builtin_cpu_supports("avx2");
 
-bool Instructions::IsCMP(const std::bitset<8>& code)
-{
-	return code == (int)Opcode::cmp_ds$di_al || code == (int)Opcode::cmp_operand_al || code == (int)Opcode::cmp_ds$offset_al;
-}
+	//one byte shuffle looks up the answer of all the 32 lanes
+	__attribute__((target("avx2"))) uint32_t GetConditionLanesAVX2(uint8_t opcode, const uint8_t *flags, uint32_t lanes)
+	{
+		auto answers = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)g_conditions[opcode].data()));
+		auto index = _mm256_and_si256(_mm256_loadu_si256((const __m256i *)flags), _mm256_set1_epi8(0x0F));
+		return (uint32_t)_mm256_movemask_epi8(_mm256_shuffle_epi8(answers, index)) & lanes;
+	}
+} // namespace
 
-bool Instructions::IsNOT(const std::bitset<8>& code)
+Instructions::Format Instructions::GetFormatType(uint8_t opcode)
 {
-	return code == (int)Opcode::not_al;
+	return GetOpcodeInfo(opcode).format;
 }
 
-bool Instructions::IsSHL(const std::bitset<8>& code)
+bool Instructions::IsConditionMatch(uint8_t opcode, uint8_t flags)
 {
-	return code == (int)Opcode::shl_al;
-}
+	bool cf = (flags >> FLAG_CF) & 1;
+	bool zf = (flags >> FLAG_ZF) & 1;
+	bool sf = (flags >> FLAG_SF) & 1;
+	bool of = (flags >> FLAG_OF) & 1;
 
-bool Instructions::IsSAL(const std::bitset<8>& code)
-{
-	return code == (int)Opcode::sal_al;
+	switch ((Opcode)opcode)
+	{
+	case Opcode::jmp_cs_offset:
+	case Opcode::jmp_selector$offset:
+		return true;
+	case Opcode::je_cs_offset:
+		return zf;
+	case Opcode::jne_cs_offset:
+		return !zf;
+	case Opcode::ja_cs_offset:
+		return !cf && !zf;
+	case Opcode::jae_cs_offset:
+		return !cf;
+	case Opcode::jb_cs_offset:
+		return cf;
+	case Opcode::jbe_cs_offset:
+		return cf && zf;
+	case Opcode::jg_cs_offset:
+		return !zf && (sf == of);
+	case Opcode::jge_cs_offset:
+		return sf == of;
+	case Opcode::jl_cs_offset:
+		return sf != of;
+	case Opcode::jle_cs_offset:
+		return zf || (sf != of);
+	case Opcode::jz_cs_offset:
+		return zf;
+	case Opcode::jnz_cs_offset:
+		return !zf;
+	case Opcode::jc_cs_offset:
+		return cf;
+	case Opcode::jnc_cs_offset:
+		return !cf;
+	case Opcode::jo_cs_offset:
+		return of;
+	case Opcode::jno_cs_offset:
+		return !of;
+	case Opcode::js_cs_offset:
+		return sf;
+	case Opcode::jns_cs_offset:
+		return !sf;
+	default:
+		//TO DO add some kind of errorlog
+		return false;
+	}
 }
 
-bool Instructions::IsSHR(const std::bitset<8>& code)
+uint32_t Instructions::GetConditionLanes(uint8_t opcode, const uint8_t *flags, uint32_t lanes)
 {
-	return code == (int)Opcode::shr_al;
-}
+	if (g_avx2)
+		return GetConditionLanesAVX2(opcode, flags, lanes);
 
-bool Instructions::IsSAR(const std::bitset<8>& code)
-{
-	return code == (int)Opcode::sar_al;
+	uint32_t taken = 0;
+	for (int lane = 0; lane < 32; lane++)
+	{
+		if (((lanes >> lane) & 1) && g_conditions[opcode][flags[lane] & 0x0F])
+		{
+			taken |= 1u << lane;
+		}
+	}
+	return taken;
 }
@@ -0,0 +1,781 @@
+#include "jitprocessor.h"
+#include "alu.h"
+#include "instruction.h"
+#include "registers.h"
+#include "../../common/opcodeinfo.h"
+#include <algorithm>
+#include <sys/mman.h>
+
+//generated code of every processor
+#define CODE_SIZE (4 << 20)
+//a block is translated only with this much room left, otherwise all the blocks are thrown away
+#define MAX_BLOCK_CODE (32 << 10)
+#define MAX_BLOCK_INSTRUCTIONS 64
+
+//host registers holding the ME88 state inside the generated code, all callee saved
+#define REG_THIS X86Emitter::RBX
+#define REG_AL X86Emitter::R12
+#define REG_AH X86Emitter::R13
+#define REG_F X86Emitter::R14
+#define REG_CYCLES X86Emitter::R15
+
+namespace
+{
+	struct Instruction
+	{
+		uint16_t ip;
+		uint8_t opcode;
+		uint8_t length;
+		uint8_t operands[DecodeCache::MAX_LENGTH - 1];
+	};
+
+	bool IsTranslated(uint8_t opcode)
+	{
+		const auto &info = GetOpcodeInfo(opcode);
+		if (info.mnemonic == nullptr || opcode == Instructions::IN_OPCODE)
+			return false;
+
+		switch (info.executionState)
+		{
+		case Star::nop0:
+		case Star::ldah0:
+		case Star::ldal0:
+		case Star::ldds0:
+		case Star::ldss0:
+		case Star::ldsp0:
+		case Star::lddi0:
+		case Star::ldax0:
+		case Star::ldax1:
+		case Star::ldax2:
+		case Star::ldax3:
+		case Star::ld0:
+		case Star::arit_log0:
+		case Star::ldal1:
+		case Star::jmp0:
+		case Star::push0:
+		case Star::pop0:
+		case Star::call0:
+		case Star::ret0:
+		case Star::ldpsr0:
+		case Star::stum0:
+			return true;
+		default:
+			return false;
+		}
+	}
+
+	bool IsTerminator(uint8_t opcode)
+	{
+		auto state = GetOpcodeInfo(opcode).executionState;
+		return state == Star::jmp0 || state == Star::call0 || state == Star::ret0;
+	}
+} // namespace
+
+//Emits the code of one block. The fields written with a value known at translation time are only
+//stored at the exits of the block, the last value wins.
+class JitProcessor::Translator
+{
+public:
+	Translator(JitProcessor &processor, uint16_t cs) : m_processor(processor), m_e(processor.m_emitter), m_cs(cs)
+	{
+		std::fill(std::begin(m_pending), std::end(m_pending), false);
+	}
+
+	void Emit(const std::vector<Instruction> &instructions, uint32_t cycles)
+	{
+		//not enough cycles left in this Step, nothing has been executed yet
+		m_e.Lea64(X86Emitter::RAX, REG_CYCLES, cycles);
+		m_e.Cmp64(X86Emitter::RAX, REG_THIS, m_processor.m_stepLimitOffset);
+		m_e.Jcc(X86Emitter::ABOVE, m_processor.m_exit);
+		m_e.Mov64(REG_CYCLES, X86Emitter::RAX);
+		m_e.AddImm64(REG_THIS, m_processor.m_instructionsOffset, instructions.size());
+
+		for (const auto &instruction : instructions)
+		{
+			Fetch(instruction);
+			Execute(instruction);
+		}
+
+		const auto &last = instructions.back();
+		if (!IsTerminator(last.opcode))
+		{
+			StaticExit(m_cs, last.ip + last.length);
+		}
+	}
+
+private:
+	JitProcessor &m_processor;
+	X86Emitter &m_e;
+	uint16_t m_cs;
+	bool m_pending[FIELDS];
+	uint32_t m_values[FIELDS];
+
+	void Set(Field field, uint32_t value)
+	{
+		m_pending[field] = true;
+		m_values[field] = value;
+	}
+
+	void Store(Field field, int reg)
+	{
+		const auto &info = m_processor.m_fields[field];
+		switch (info.size)
+		{
+		case 1:
+			m_e.Store8(REG_THIS, info.offset, reg);
+			break;
+		case 2:
+			m_e.Store16(REG_THIS, info.offset, reg);
+			break;
+		default:
+			m_e.Store32(REG_THIS, info.offset, reg);
+			break;
+		}
+		m_pending[field] = false;
+	}
+
+	void Load(int reg, Field field)
+	{
+		const auto &info = m_processor.m_fields[field];
+		if (m_pending[field])
+		{
+			m_e.MovImm32(reg, m_values[field]);
+			return;
+		}
+
+		switch (info.size)
+		{
+		case 1:
+			m_e.Load8(reg, REG_THIS, info.offset);
+			break;
+		case 2:
+			m_e.Load16(reg, REG_THIS, info.offset);
+			break;
+		default:
+			m_e.Load32(reg, REG_THIS, info.offset);
+			break;
+		}
+	}
+
+	//the pending fields are left pending, every exit stores them again
+	void Flush()
+	{
+		for (int field = 0; field < FIELDS; field++)
+		{
+			if (!m_pending[field])
+				continue;
+
+			const auto &info = m_processor.m_fields[field];
+			switch (info.size)
+			{
+			case 1:
+				m_e.StoreImm8(REG_THIS, info.offset, m_values[field]);
+				break;
+			case 2:
+				m_e.StoreImm16(REG_THIS, info.offset, m_values[field]);
+				break;
+			default:
+				m_e.StoreImm32(REG_THIS, info.offset, m_values[field]);
+				break;
+			}
+		}
+	}
+
+	//reg = ComputePhysicalAddress(selector, offset)
+	void Address(int reg, Field selector, int offset)
+	{
+		Load(reg, selector);
+		m_e.ShlImm32(reg, 4);
+		m_e.Add32(reg, offset);
+		m_e.AndImm32(reg, PHYSICAL_ADDRESS_MASK);
+	}
+
+	void Call(const void *function)
+	{
+		m_e.Mov64(X86Emitter::RDI, REG_THIS);
+		m_e.MovImm64(X86Emitter::RAX, (uint64_t)function);
+		m_e.Call(X86Emitter::RAX);
+	}
+
+	//EAX = Read(MAR), the address is in ESI and already in MAR
+	void Read()
+	{
+		Call((const void *)&JitProcessor::ReadHelper);
+		m_pending[D7D0] = false;
+	}
+
+	//Write(ESI, EDX)
+	void Write()
+	{
+		Call((const void *)&JitProcessor::WriteHelper);
+	}
+
+	//MAR = SS:(SP - 1), SP--, write EDX there
+	void Push()
+	{
+		Load(X86Emitter::RCX, SP);
+		m_e.SubImm32(X86Emitter::RCX, 1);
+		m_e.AndImm32(X86Emitter::RCX, 0xFFFF);
+		Store(SP, X86Emitter::RCX);
+		Address(X86Emitter::RSI, SS, X86Emitter::RCX);
+		Store(MAR, X86Emitter::RSI);
+		Write();
+	}
+
+	void PushConstant(uint8_t value)
+	{
+		Set(MBR, value);
+		m_e.MovImm32(X86Emitter::RDX, value);
+		Push();
+	}
+
+	//MAR = SS:SP, SP++, EAX = the byte there
+	void Pop()
+	{
+		Load(X86Emitter::RCX, SP);
+		Address(X86Emitter::RSI, SS, X86Emitter::RCX);
+		Store(MAR, X86Emitter::RSI);
+		m_e.AddImm32(X86Emitter::RCX, 1);
+		Store(SP, X86Emitter::RCX);
+		Read();
+	}
+
+	//AH:AL, used by the mov ds/ss/sp/di,ax
+	void StoreAX(Field field)
+	{
+		m_e.Mov32(X86Emitter::RAX, REG_AH);
+		m_e.ShlImm32(X86Emitter::RAX, 8);
+		m_e.Or32(X86Emitter::RAX, REG_AL);
+		Store(field, X86Emitter::RAX);
+	}
+
+	void LoadAX(Field field)
+	{
+		Load(X86Emitter::RAX, field);
+		m_e.Mov32(REG_AL, X86Emitter::RAX);
+		m_e.AndImm32(REG_AL, 0xFF);
+		m_e.ShrImm32(X86Emitter::RAX, 8);
+		m_e.Mov32(REG_AH, X86Emitter::RAX);
+	}
+
+	void Swap(Field one, Field two)
+	{
+		Load(X86Emitter::RAX, one);
+		Load(X86Emitter::RCX, two);
+		Store(one, X86Emitter::RCX);
+		Store(two, X86Emitter::RAX);
+	}
+
+	//goes on with the block at cs:ip, straight into its code once it is translated
+	void StaticExit(uint16_t cs, uint16_t ip)
+	{
+		Set(IP, ip);
+		if (cs != m_cs)
+		{
+			Set(CS, cs);
+		}
+		Flush();
+		m_pending[CS] = false;
+
+		auto key = ((uint32_t)cs << 16) | ip;
+		auto found = m_processor.m_blocks.find(key);
+		if (found != m_processor.m_blocks.end() && found->second.code != nullptr)
+		{
+			m_e.Jmp(found->second.code);
+			return;
+		}
+
+		auto displacement = m_e.Jmp(m_processor.m_exit);
+		if (found == m_processor.m_blocks.end())
+		{
+			m_processor.m_links.emplace(key, displacement);
+		}
+	}
+
+	//CS and IP already stored
+	void DynamicExit()
+	{
+		Flush();
+		m_e.Jmp(m_processor.m_exit);
+	}
+
+	void Fetch(const Instruction &instruction)
+	{
+		//fetch0 .. fetch3, as Decode leaves them
+		uint16_t ip = instruction.ip + instruction.length;
+		auto operands = instruction.operands;
+		Set(IP, ip);
+		Set(MAR, ComputePhysicalAddress(m_cs, ip - 1));
+		Set(D7D0, instruction.length == 1 ? instruction.opcode : operands[instruction.length - 2]);
+		Set(OPCODE, instruction.opcode);
+		Set(MR_, true);
+		Set(MJR, (uint32_t)GetOpcodeInfo(instruction.opcode).executionState);
+
+		switch (Instructions::GetFormatType(instruction.opcode))
+		{
+		case Instructions::Format::F0:
+			break;
+		case Instructions::Format::F1:
+			Load(X86Emitter::RCX, DI);
+			Address(X86Emitter::RSI, DS, X86Emitter::RCX);
+			Store(MAR, X86Emitter::RSI);
+			Read();
+			Store(SOURCE, X86Emitter::RAX);
+			break;
+		case Instructions::Format::F2:
+			Load(X86Emitter::RAX, DS);
+			Store(DEST_SEL, X86Emitter::RAX);
+			Load(X86Emitter::RAX, DI);
+			Store(DEST_OFF, X86Emitter::RAX);
+			break;
+		case Instructions::Format::F3:
+			Set(SOURCE, operands[0]);
+			break;
+		case Instructions::Format::F4:
+			//never IN, see IsTranslated
+			Set(MBR, operands[0]);
+			m_e.MovImm32(X86Emitter::RCX, Concat(operands[1], operands[0]));
+			Address(X86Emitter::RSI, DS, X86Emitter::RCX);
+			Store(MAR, X86Emitter::RSI);
+			Read();
+			Store(SOURCE, X86Emitter::RAX);
+			break;
+		case Instructions::Format::F5:
+			Set(MBR, operands[0]);
+			Load(X86Emitter::RAX, DS);
+			Store(DEST_SEL, X86Emitter::RAX);
+			Set(DEST_OFF, Concat(operands[1], operands[0]));
+			break;
+		case Instructions::Format::F6:
+			Set(MBR, operands[0]);
+			Set(DEST_SEL, m_cs);
+			Set(DEST_OFF, Concat(operands[1], operands[0]));
+			break;
+		case Instructions::Format::F7:
+			Set(MBR, operands[2]);
+			Set(DEST_OFF, Concat(operands[3], operands[2]));
+			break;
+		}
+	}
+
+	void Execute(const Instruction &instruction)
+	{
+		uint16_t ip = instruction.ip + instruction.length;
+		switch (GetOpcodeInfo(instruction.opcode).executionState)
+		{
+		case Star::ldah0:
+			m_e.Mov32(REG_AH, REG_AL);
+			break;
+		case Star::ldal0:
+			m_e.Mov32(REG_AL, REG_AH);
+			break;
+		case Star::ldds0:
+			StoreAX(DS);
+			break;
+		case Star::ldss0:
+			StoreAX(SS);
+			break;
+		case Star::ldsp0:
+			StoreAX(SP);
+			break;
+		case Star::lddi0:
+			StoreAX(DI);
+			break;
+		case Star::ldax0:
+			LoadAX(DS);
+			break;
+		case Star::ldax1:
+			LoadAX(SS);
+			break;
+		case Star::ldax2:
+			LoadAX(SP);
+			break;
+		case Star::ldax3:
+			LoadAX(DI);
+			break;
+		case Star::ld0:
+			Load(X86Emitter::RCX, DEST_OFF);
+			Address(X86Emitter::RSI, DEST_SEL, X86Emitter::RCX);
+			Store(MAR, X86Emitter::RSI);
+			Store(MBR, REG_AL);
+			Set(DIR, true);
+			m_e.Mov32(X86Emitter::RDX, REG_AL);
+			Write();
+			break;
+		case Star::arit_log0:
+			ExecuteALU(instruction.opcode);
+			break;
+		case Star::ldal1:
+			Load(REG_AL, SOURCE);
+			break;
+		case Star::jmp0:
+			Jump(instruction.opcode, ip);
+			break;
+		case Star::push0:
+			Store(MBR, REG_AL);
+			Set(DIR, true);
+			m_e.Mov32(X86Emitter::RDX, REG_AL);
+			Push();
+			break;
+		case Star::pop0:
+			Pop();
+			m_e.Mov32(REG_AL, X86Emitter::RAX);
+			break;
+		case Star::call0:
+			Set(DIR, true);
+			PushConstant(ip >> 8);
+			PushConstant(ip);
+			if (instruction.opcode != Instructions::CALLF_OPCODE)
+			{
+				StaticExit(m_cs, m_values[DEST_OFF]);
+				break;
+			}
+
+			PushConstant(m_cs >> 8);
+			PushConstant(m_cs);
+			Jump(instruction.opcode, m_values[DEST_OFF]);
+			break;
+		case Star::ret0:
+			//retf takes the same path, see opcodeinfo.h
+			Pop();
+			Store(MBR, X86Emitter::RAX);
+			Pop();
+			m_e.ShlImm32(X86Emitter::RAX, 8);
+			Load(X86Emitter::RCX, MBR);
+			m_e.Or32(X86Emitter::RAX, X86Emitter::RCX);
+			Store(IP, X86Emitter::RAX);
+			DynamicExit();
+			break;
+		case Star::ldpsr0:
+			Load(X86Emitter::RAX, SS);
+			Store(PREV_SS, X86Emitter::RAX);
+			Load(X86Emitter::RAX, SP);
+			Store(PREV_SP, X86Emitter::RAX);
+			break;
+		case Star::stum0:
+			m_e.OrImm32(REG_F, 1 << FLAG_US);
+			Swap(SS, PREV_SS);
+			Swap(SP, PREV_SP);
+			break;
+		default:
+			//nop0, IsTranslated lets nothing else through
+			break;
+		}
+	}
+
+	void ExecuteALU(uint8_t opcode)
+	{
+		auto table = ALU::GetTable(ALU::GetOperation(opcode));
+		m_e.Mov32(X86Emitter::RAX, REG_AL);
+		if (table.sourceMask != 0)
+		{
+			m_e.ShlImm32(X86Emitter::RAX, table.alShift);
+			Load(X86Emitter::RCX, SOURCE);
+			m_e.AndImm32(X86Emitter::RCX, table.sourceMask);
+			m_e.Or32(X86Emitter::RAX, X86Emitter::RCX);
+		}
+		m_e.MovImm64(X86Emitter::RCX, (uint64_t)table.results);
+		m_e.LoadTable16(X86Emitter::RAX, X86Emitter::RCX, X86Emitter::RAX);
+		m_e.Mov32(REG_AL, X86Emitter::RAX);
+		m_e.AndImm32(REG_AL, 0xFF);
+		m_e.ShrImm32(X86Emitter::RAX, 8);
+		m_e.AndImm32(X86Emitter::RAX, table.flagMask);
+		m_e.AndImm32(REG_F, ~(uint32_t)table.flagMask);
+		m_e.Or32(REG_F, X86Emitter::RAX);
+	}
+
+	//CS = DEST_SEL, IP = target when the condition holds, ip otherwise
+	void Jump(uint8_t opcode, uint16_t ip)
+	{
+		uint16_t target = m_values[DEST_OFF];
+		if (!m_pending[DEST_SEL])
+		{
+			//far jumps and calls never load DEST_SEL, the selector is only known at run time
+			Load(X86Emitter::RAX, DEST_SEL);
+			Store(CS, X86Emitter::RAX);
+			Set(IP, target);
+			DynamicExit();
+			return;
+		}
+
+		uint16_t cs = m_values[DEST_SEL];
+		uint32_t taken = 0;
+		for (int flags = 0; flags < 16; flags++)
+		{
+			taken |= Instructions::IsConditionMatch(opcode, flags) << flags;
+		}
+
+		if (opcode == Instructions::CALLF_OPCODE || taken == 0xFFFF)
+		{
+			StaticExit(cs, target);
+			return;
+		}
+		if (taken == 0)
+		{
+			StaticExit(cs, ip);
+			return;
+		}
+
+		m_e.Mov32(X86Emitter::RAX, REG_F);
+		m_e.AndImm32(X86Emitter::RAX, 0x0F);
+		m_e.MovImm32(X86Emitter::RCX, taken);
+		m_e.Bt32(X86Emitter::RCX, X86Emitter::RAX);
+		auto jump = m_e.Jcc(X86Emitter::BELOW, m_e.GetPosition());
+		StaticExit(cs, ip);
+		X86Emitter::Patch(jump, m_e.GetPosition());
+		StaticExit(cs, target);
+	}
+};
+
+JitProcessor::JitProcessor(Bus &bus) : FastProcessor(bus), m_enter(nullptr), m_exit(nullptr)
+{
+	auto offset = [this](const void *field) {
+		return (int32_t)((const char *)field - (const char *)this);
+	};
+	m_fields[IP] = {offset(&m_IP), sizeof(m_IP)};
+	m_fields[CS] = {offset(&m_CS), sizeof(m_CS)};
+	m_fields[MAR] = {offset(&m_MAR), sizeof(m_MAR)};
+	m_fields[D7D0] = {offset(&m_d7_d0), sizeof(m_d7_d0)};
+	m_fields[OPCODE] = {offset(&m_OPCODE), sizeof(m_OPCODE)};
+	m_fields[MR_] = {offset(&m_MR_), sizeof(m_MR_)};
+	m_fields[MJR] = {offset(&m_MJR), sizeof(m_MJR)};
+	m_fields[MBR] = {offset(&m_MBR), sizeof(m_MBR)};
+	m_fields[DEST_OFF] = {offset(&m_DEST_OFF), sizeof(m_DEST_OFF)};
+	m_fields[DEST_SEL] = {offset(&m_DEST_SEL), sizeof(m_DEST_SEL)};
+	m_fields[DIR] = {offset(&m_DIR), sizeof(m_DIR)};
+	m_fields[SOURCE] = {offset(&m_SOURCE), sizeof(m_SOURCE)};
+	m_fields[DS] = {offset(&m_DS), sizeof(m_DS)};
+	m_fields[DI] = {offset(&m_DI), sizeof(m_DI)};
+	m_fields[SS] = {offset(&m_SS), sizeof(m_SS)};
+	m_fields[SP] = {offset(&m_SP), sizeof(m_SP)};
+	m_fields[PREV_SS] = {offset(&m_PREV_SS), sizeof(m_PREV_SS)};
+	m_fields[PREV_SP] = {offset(&m_PREV_SP), sizeof(m_PREV_SP)};
+	m_cyclesOffset = offset(&m_cycles);
+	m_instructionsOffset = offset(&m_instructions);
+	m_stepLimitOffset = offset(&m_stepLimit);
+	m_alOffset = offset(&m_AL);
+	m_ahOffset = offset(&m_AH);
+	m_fOffset = offset(&m_F);
+
+	static_assert(sizeof(Star) == 4 && sizeof(bool) == 1, "the generated code stores the fields by size");
+
+	//never writable and executable at once, SetWritable switches it around every translation
+	m_code = (uint8_t *)mmap(nullptr, CODE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (m_code == MAP_FAILED)
+	{
+		//everything is interpreted
+		m_code = nullptr;
+		return;
+	}
+
+	m_emitter.SetBuffer(m_code, m_code + CODE_SIZE);
+	EmitStubs();
+	m_blocksStart = m_emitter.GetPosition();
+	SetWritable(false);
+}
+
+JitProcessor::~JitProcessor()
+{
+	ReleaseCode();
+}
+
+bool JitProcessor::SetWritable(bool writable)
+{
+	if (mprotect(m_code, CODE_SIZE, writable ? PROT_READ | PROT_WRITE : PROT_READ | PROT_EXEC) == 0)
+		return true;
+
+	//a kernel refusing executable pages that were writable, everything is interpreted from now on
+	ReleaseCode();
+	return false;
+}
+
+void JitProcessor::ReleaseCode()
+{
+	if (m_code == nullptr)
+		return;
+
+	munmap(m_code, CODE_SIZE);
+	m_code = nullptr;
+	m_blocks.clear();
+	m_links.clear();
+}
+
+void JitProcessor::EmitStubs()
+{
+	//Enter(this, code) loads the host registers and jumps to the block, 16 bytes aligned stack for the helpers
+	auto &e = m_emitter;
+	m_enter = (EnterFunction)e.GetPosition();
+	for (int reg : {X86Emitter::RBX, X86Emitter::RBP, X86Emitter::R12, X86Emitter::R13, X86Emitter::R14, X86Emitter::R15})
+	{
+		e.Push(reg);
+	}
+	e.AddImm64(X86Emitter::RSP, -8);
+	e.Mov64(REG_THIS, X86Emitter::RDI);
+	e.Load8(REG_AL, REG_THIS, m_alOffset);
+	e.Load8(REG_AH, REG_THIS, m_ahOffset);
+	e.Load8(REG_F, REG_THIS, m_fOffset);
+	e.Load64(REG_CYCLES, REG_THIS, m_cyclesOffset);
+	e.JmpRegister(X86Emitter::RSI);
+
+	//every block leaves through here with the fields of the exit already stored
+	m_exit = e.GetPosition();
+	e.Store8(REG_THIS, m_alOffset, REG_AL);
+	e.Store8(REG_THIS, m_ahOffset, REG_AH);
+	e.Store8(REG_THIS, m_fOffset, REG_F);
+	e.Store64(REG_THIS, m_cyclesOffset, REG_CYCLES);
+	e.AddImm64(X86Emitter::RSP, 8);
+	for (int reg : {X86Emitter::R15, X86Emitter::R14, X86Emitter::R13, X86Emitter::R12, X86Emitter::RBP, X86Emitter::RBX})
+	{
+		e.Pop(reg);
+	}
+	e.Ret();
+}
+
+void JitProcessor::ClearBlocks()
+{
+	m_blocks.clear();
+	m_links.clear();
+	if (m_code != nullptr)
+	{
+		m_emitter.SetBuffer(m_blocksStart, m_code + CODE_SIZE);
+	}
+}
+
+uint32_t JitProcessor::ReadHelper(JitProcessor *processor, uint32_t address)
+{
+	return processor->Read(address);
+}
+
+void JitProcessor::WriteHelper(JitProcessor *processor, uint32_t address, uint32_t data)
+{
+	processor->Write(address, data);
+}
+
+void JitProcessor::Step()
+{
+	//blocks start between two instructions, and interrupts are only taken by FastProcessor
+	const Block *block = nullptr;
+	if (m_STAR == Star::fetch0 && !GetFlag(FLAG_IF) && !IsObserved())
+	{
+		StartNativeStep();
+		block = GetBlock(m_CS, m_IP);
+	}
+
+	//the last instructions before the limit run one at a time, as FastProcessor would stop at the limit
+	if (block == nullptr || m_cycles + block->cycles > m_stepLimit)
+	{
+		FastProcessor::Step();
+		return;
+	}
+
+	m_enter(this, block->code);
+}
+
+const JitProcessor::Block *JitProcessor::GetBlock(uint16_t cs, uint16_t ip)
+{
+	auto found = m_blocks.find(((uint32_t)cs << 16) | ip);
+	if (found != m_blocks.end())
+		return found->second.code != nullptr ? &found->second : nullptr;
+
+	return Translate(cs, ip);
+}
+
+const JitProcessor::Block *JitProcessor::Translate(uint16_t cs, uint16_t ip)
+{
+	if (m_code == nullptr)
+		return nullptr;
+
+	//the instructions up to the first jump, call or ret, or up to anything left to FastProcessor
+	auto key = ((uint32_t)cs << 16) | ip;
+	std::vector<Instruction> instructions;
+	uint32_t cycles = 0;
+	//an uninitialized ROM byte can be translated once FastProcessor has read it
+	bool transient = false;
+	while (instructions.size() < MAX_BLOCK_INSTRUCTIONS)
+	{
+		Instruction instruction = {ip};
+		bool valid = true;
+		for (int i = 0; valid && (i == 0 || i < instruction.length); i++)
+		{
+			auto address = ComputePhysicalAddress(cs, ip + i);
+			auto device = m_Bus.GetDevice(address);
+			uint8_t data = 0;
+			valid = device != nullptr && device->IsReadOnly() && (uint16_t)(ip + i) >= ip;
+			if (valid && !device->Peek(address, data))
+			{
+				valid = false;
+				transient = true;
+			}
+
+			if (i == 0)
+			{
+				instruction.opcode = data;
+				instruction.length = GetOpcodeInfo(data).length;
+			}
+			else
+			{
+				instruction.operands[i - 1] = data;
+			}
+		}
+
+		if (!valid || !IsTranslated(instruction.opcode))
+			break;
+
+		instructions.push_back(instruction);
+		cycles += GetOpcodeInfo(instruction.opcode).cycles;
+		ip += instruction.length;
+		if (IsTerminator(instruction.opcode))
+			break;
+	}
+
+	if (instructions.empty())
+	{
+		if (!transient)
+		{
+			m_blocks[key] = {nullptr, 0};
+		}
+		return nullptr;
+	}
+
+	if (!SetWritable(true))
+		return nullptr;
+
+	if (m_emitter.GetRoom() < MAX_BLOCK_CODE)
+	{
+		ClearBlocks();
+	}
+
+	auto &block = m_blocks[key];
+	block = {m_emitter.GetPosition(), cycles};
+	Translator translator(*this, cs);
+	translator.Emit(instructions, cycles);
+	Link(key, block.code);
+	return SetWritable(false) ? &block : nullptr;
+}
+
+void JitProcessor::Link(uint32_t key, const uint8_t *code)
+{
+	auto links = m_links.equal_range(key);
+	for (auto link = links.first; link != links.second; link++)
+	{
+		X86Emitter::Patch(link->second, code);
+	}
+	m_links.erase(links.first, links.second);
+}
+
+void JitProcessor::OnReset()
+{
+	FastProcessor::OnReset();
+	ClearBlocks();
+}
+
+bool JitProcessor::SetState(const State &state)
+{
+	if (!FastProcessor::SetState(state))
+		return false;
+
+	//the ROM may have been restored as well
+	ClearBlocks();
+	return true;
+}
+
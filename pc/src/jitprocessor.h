@@ -0,0 +1,96 @@
+#pragma once
+#include "fastprocessor.h"
+#include "x86emitter.h"
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+//Translates the basic blocks of the ROM into x86-64 code and runs them, with the state of FastProcessor
+//at every block boundary. AL, AH, F and the cycle counter live in host registers inside the generated
+//code, and the blocks ending with a jump or a call to a known target jump straight into each other.
+//
+//Only code in read only devices is translated, so nothing ever has to be invalidated because of a write.
+//Code in RAM, I/O instructions, hlt, int, iret, cli, sti, any interrupt enabled state and tracing all
+//go through FastProcessor::Step.
+class JitProcessor : public FastProcessor
+{
+public:
+	JitProcessor() = delete;
+	JitProcessor(Bus &bus);
+	~JitProcessor();
+	JitProcessor(const JitProcessor &) = delete;
+	JitProcessor &operator=(const JitProcessor &) = delete;
+	void Step() override;
+	void OnReset() override;
+	bool SetState(const State &state) override;
+
+private:
+	//the fields of FastProcessor the generated code writes, see Translator
+	enum Field
+	{
+		IP,
+		CS,
+		MAR,
+		D7D0,
+		OPCODE,
+		MR_,
+		MJR,
+		MBR,
+		DEST_OFF,
+		DEST_SEL,
+		DIR,
+		SOURCE,
+		DS,
+		DI,
+		SS,
+		SP,
+		PREV_SS,
+		PREV_SP,
+		FIELDS
+	};
+
+	struct FieldInfo
+	{
+		int32_t offset;
+		int size;
+	};
+
+	struct Block
+	{
+		//nullptr when the first instruction can never be translated
+		const uint8_t *code;
+		uint32_t cycles;
+	};
+
+	using EnterFunction = void (*)(JitProcessor *processor, const uint8_t *code);
+
+	uint8_t *m_code;
+	X86Emitter m_emitter;
+	EnterFunction m_enter;
+	const uint8_t *m_exit;
+	//first byte after the stubs, where the blocks start
+	uint8_t *m_blocksStart;
+
+	FieldInfo m_fields[FIELDS];
+	int32_t m_cyclesOffset, m_instructionsOffset, m_stepLimitOffset, m_alOffset, m_ahOffset, m_fOffset;
+
+	//CS << 16 | IP of the first instruction
+	std::unordered_map<uint32_t, Block> m_blocks;
+	//jumps waiting for the translation of their target, they go to the exit until then
+	std::unordered_multimap<uint32_t, uint8_t *> m_links;
+
+	void EmitStubs();
+	void ClearBlocks();
+	//read and write for the emitter, or read and execute to run the blocks. false and no code left on failure
+	bool SetWritable(bool writable);
+	void ReleaseCode();
+	//nullptr if the instruction at CS:IP has to be interpreted
+	const Block *GetBlock(uint16_t cs, uint16_t ip);
+	const Block *Translate(uint16_t cs, uint16_t ip);
+	void Link(uint32_t key, const uint8_t *code);
+
+	static uint32_t ReadHelper(JitProcessor *processor, uint32_t address);
+	static void WriteHelper(JitProcessor *processor, uint32_t address, uint32_t data);
+
+	class Translator;
+};
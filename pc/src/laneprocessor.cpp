@@ -0,0 +1,548 @@
+#include "laneprocessor.h"
+#include "decodecache.h"
+#include "instruction.h"
+#include "registers.h"
+#include "../../common/opcodeinfo.h"
+
+namespace
+{
+	int LowestLane(uint32_t lanes)
+	{
+		return __builtin_ctz(lanes);
+	}
+} // namespace
+
+LaneProcessor::LaneProcessor(const std::vector<Bus *> &buses) : m_buses(buses), m_laneCount(std::min<int>(buses.size(), LANES)), m_running(0)
+{
+	OnReset();
+}
+
+int LaneProcessor::GetLaneCount() const
+{
+	return m_laneCount;
+}
+
+uint8_t LaneProcessor::Read(int lane, uint32_t address)
+{
+	m_d7_d0[lane] = m_buses[lane]->Read(address).to_ulong();
+	return m_d7_d0[lane];
+}
+
+void LaneProcessor::Write(int lane, uint32_t address, uint8_t data)
+{
+	m_buses[lane]->Write(address, data);
+}
+
+uint8_t LaneProcessor::FetchByte(int lane)
+{
+	m_MAR[lane] = ComputePhysicalAddress(m_CS[lane], m_IP[lane]);
+	m_IP[lane]++;
+	return Read(lane, m_MAR[lane]);
+}
+
+void LaneProcessor::FetchOperands(int lane, uint8_t *operands, int count)
+{
+	auto ip = m_IP[lane];
+	auto address = ComputePhysicalAddress(m_CS[lane], ip);
+	if (count == 0 || (uint16_t)(ip + count - 1) < ip || address + count - 1 > PHYSICAL_ADDRESS_MASK)
+	{
+		//IP or the physical address wrap around
+		for (int i = 0; i < count; i++)
+		{
+			operands[i] = FetchByte(lane);
+		}
+		return;
+	}
+
+	m_buses[lane]->ReadBlock(address, operands, count);
+	m_IP[lane] += count;
+	m_MAR[lane] = address + count - 1;
+	m_d7_d0[lane] = operands[count - 1];
+}
+
+void LaneProcessor::Step()
+{
+	uint32_t fetched = 0;
+	for (uint32_t lanes = m_running; lanes != 0; lanes &= lanes - 1)
+	{
+		auto lane = LowestLane(lanes);
+		switch (m_STAR[lane])
+		{
+		case Star::fetch0:
+			Fetch(lane);
+			fetched |= 1u << lane;
+			break;
+		case Star::pre_tipo0:
+			//pre_tipo0
+			m_DIR[lane] = false;
+			m_INTA[lane] = true;
+			m_cycles[lane] += 1;
+			if (m_intr[lane])
+				break;
+
+			//pre_tipo1, int0 .. int2
+			m_SOURCE[lane] = m_d7_d0[lane];
+			m_INTA[lane] = false;
+			Interrupt(lane);
+			m_cycles[lane] += 4;
+			break;
+		default:
+			//halted, see FastProcessor::Step
+			m_cycles[lane]++;
+			if (m_STAR[lane] == Star::int3)
+			{
+				m_MW_[lane] = true;
+				m_F[lane] = 0;
+			}
+			break;
+		}
+	}
+
+	//the lanes running the same opcode go together
+	while (fetched != 0)
+	{
+		auto opcode = m_OPCODE[LowestLane(fetched)];
+		uint32_t group = 0;
+		for (uint32_t lanes = fetched; lanes != 0; lanes &= lanes - 1)
+		{
+			auto lane = LowestLane(lanes);
+			if (m_OPCODE[lane] == opcode)
+			{
+				group |= 1u << lane;
+			}
+		}
+		fetched &= ~group;
+
+		ExecuteGroup(opcode, group);
+		auto cycles = GetOpcodeInfo(opcode).cycles;
+		for (uint32_t lanes = group; lanes != 0; lanes &= lanes - 1)
+		{
+			m_cycles[LowestLane(lanes)] += cycles;
+		}
+	}
+}
+
+void LaneProcessor::Run(const std::vector<uint64_t> &maxCycles)
+{
+	auto IsDone = [&](int lane) {
+		auto limit = lane < (int)maxCycles.size() ? maxCycles[lane] : 0;
+		return IsHalted(lane) || (limit != 0 && m_cycles[lane] >= limit);
+	};
+
+	m_running = 0;
+	for (int lane = 0; lane < m_laneCount; lane++)
+	{
+		if (!IsDone(lane))
+		{
+			m_running |= 1u << lane;
+		}
+	}
+
+	while (m_running != 0)
+	{
+		Step();
+		for (uint32_t lanes = m_running; lanes != 0; lanes &= lanes - 1)
+		{
+			auto lane = LowestLane(lanes);
+			if (IsDone(lane))
+			{
+				m_running &= ~(1u << lane);
+			}
+		}
+	}
+}
+
+void LaneProcessor::Fetch(int lane)
+{
+	//fetch0 .. fetch3, see FastProcessor::Fetch
+	m_instructions[lane]++;
+	auto opcode = FetchByte(lane);
+	m_OPCODE[lane] = opcode;
+	m_MR_[lane] = true;
+	m_MJR[lane] = GetOpcodeInfo(opcode).executionState;
+	uint8_t operands[DecodeCache::MAX_LENGTH - 1];
+	FetchOperands(lane, operands, GetOpcodeInfo(opcode).length - 1);
+
+	switch (Instructions::GetFormatType(opcode))
+	{
+	case Instructions::Format::F0:
+		break;
+	case Instructions::Format::F1:
+		m_MAR[lane] = ComputePhysicalAddress(m_DS[lane], m_DI[lane]);
+		m_SOURCE[lane] = Read(lane, m_MAR[lane]);
+		break;
+	case Instructions::Format::F2:
+		m_DEST_SEL[lane] = m_DS[lane];
+		m_DEST_OFF[lane] = m_DI[lane];
+		break;
+	case Instructions::Format::F3:
+		m_SOURCE[lane] = operands[0];
+		break;
+	case Instructions::Format::F4:
+	{
+		m_MBR[lane] = operands[0];
+		auto offset = Concat(operands[1], m_MBR[lane]);
+		m_MAR[lane] = ComputePhysicalAddress(opcode == Instructions::IN_OPCODE ? 0x0000 : m_DS[lane], offset);
+		m_SOURCE[lane] = Read(lane, m_MAR[lane]);
+	}
+	break;
+	case Instructions::Format::F5:
+		m_MBR[lane] = operands[0];
+		m_DEST_SEL[lane] = opcode == Instructions::OUT_OPCODE ? 0x0000 : m_DS[lane];
+		m_DEST_OFF[lane] = Concat(operands[1], m_MBR[lane]);
+		break;
+	case Instructions::Format::F6:
+		m_MBR[lane] = operands[0];
+		m_DEST_SEL[lane] = m_CS[lane];
+		m_DEST_OFF[lane] = Concat(operands[1], m_MBR[lane]);
+		break;
+	case Instructions::Format::F7:
+		m_MBR[lane] = operands[0];
+		m_DEST_OFF[lane] = Concat(operands[1], m_MBR[lane]);
+		m_MBR[lane] = operands[2];
+		m_DEST_OFF[lane] = Concat(operands[3], m_MBR[lane]);
+		break;
+	}
+}
+
+void LaneProcessor::ExecuteGroup(uint8_t opcode, uint32_t lanes)
+{
+	switch (GetOpcodeInfo(opcode).executionState)
+	{
+	case Star::arit_log0:
+		ALU::ExecuteLanes(ALU::GetOperation(opcode), m_AL, m_SOURCE, m_F, lanes);
+		break;
+	case Star::jmp0:
+	{
+		auto taken = Instructions::GetConditionLanes(opcode, m_F, lanes);
+		for (uint32_t group = lanes; group != 0; group &= group - 1)
+		{
+			auto lane = LowestLane(group);
+			m_CS[lane] = m_DEST_SEL[lane];
+			if ((taken >> lane) & 1)
+			{
+				m_IP[lane] = m_DEST_OFF[lane];
+			}
+		}
+	}
+	break;
+	default:
+		for (uint32_t group = lanes; group != 0; group &= group - 1)
+		{
+			Execute(LowestLane(group));
+		}
+		return;
+	}
+
+	for (uint32_t group = lanes; group != 0; group &= group - 1)
+	{
+		auto lane = LowestLane(group);
+		m_STAR[lane] = GetNextState(lane);
+	}
+}
+
+void LaneProcessor::Execute(int lane)
+{
+	//see FastProcessor::Execute
+	switch (m_MJR[lane])
+	{
+	case Star::nop0:
+		break;
+	case Star::hlt0:
+		m_STAR[lane] = Star::hlt0;
+		return;
+	case Star::ldah0:
+		m_AH[lane] = m_AL[lane];
+		break;
+	case Star::ldal0:
+		m_AL[lane] = m_AH[lane];
+		break;
+	case Star::ldds0:
+		m_DS[lane] = Concat(m_AH[lane], m_AL[lane]);
+		break;
+	case Star::ldss0:
+		m_SS[lane] = Concat(m_AH[lane], m_AL[lane]);
+		break;
+	case Star::ldsp0:
+		m_SP[lane] = Concat(m_AH[lane], m_AL[lane]);
+		break;
+	case Star::lddi0:
+		m_DI[lane] = Concat(m_AH[lane], m_AL[lane]);
+		break;
+	case Star::ldax0:
+		m_AH[lane] = m_DS[lane] >> 8;
+		m_AL[lane] = m_DS[lane];
+		break;
+	case Star::ldax1:
+		m_AH[lane] = m_SS[lane] >> 8;
+		m_AL[lane] = m_SS[lane];
+		break;
+	case Star::ldax2:
+		m_AH[lane] = m_SP[lane] >> 8;
+		m_AL[lane] = m_SP[lane];
+		break;
+	case Star::ldax3:
+		m_AH[lane] = m_DI[lane] >> 8;
+		m_AL[lane] = m_DI[lane];
+		break;
+	case Star::ld0:
+	case Star::out0:
+		m_MAR[lane] = ComputePhysicalAddress(m_DEST_SEL[lane], m_DEST_OFF[lane]);
+		m_MBR[lane] = m_AL[lane];
+		m_DIR[lane] = true;
+		Write(lane, m_MAR[lane], m_MBR[lane]);
+		break;
+	case Star::arit_log0:
+		m_AL[lane] = ALU::Execute(ALU::GetOperation(m_OPCODE[lane]), m_AL[lane], m_SOURCE[lane], m_F[lane]);
+		break;
+	case Star::ldal1:
+		m_AL[lane] = m_SOURCE[lane];
+		break;
+	case Star::jmp0:
+		m_CS[lane] = m_DEST_SEL[lane];
+		m_IP[lane] = Instructions::IsConditionMatch(m_OPCODE[lane], m_F[lane]) ? m_DEST_OFF[lane] : m_IP[lane];
+		break;
+	case Star::push0:
+		m_MAR[lane] = ComputePhysicalAddress(m_SS[lane], m_SP[lane] - 1);
+		m_MBR[lane] = m_AL[lane];
+		m_DIR[lane] = true;
+		Write(lane, m_MAR[lane], m_MBR[lane]);
+		m_SP[lane]--;
+		break;
+	case Star::pop0:
+		m_MAR[lane] = ComputePhysicalAddress(m_SS[lane], m_SP[lane]);
+		m_SP[lane]++;
+		m_AL[lane] = Read(lane, m_MAR[lane]);
+		break;
+	case Star::call0:
+		m_DIR[lane] = true;
+		m_MAR[lane] = ComputePhysicalAddress(m_SS[lane], m_SP[lane] - 1);
+		m_MBR[lane] = m_IP[lane] >> 8;
+		Write(lane, m_MAR[lane], m_MBR[lane]);
+		m_SP[lane]--;
+		m_MAR[lane] = ComputePhysicalAddress(m_SS[lane], m_SP[lane] - 1);
+		m_MBR[lane] = m_IP[lane];
+		Write(lane, m_MAR[lane], m_MBR[lane]);
+		m_SP[lane]--;
+		m_IP[lane] = m_DEST_OFF[lane];
+		if (m_OPCODE[lane] == Instructions::CALLF_OPCODE)
+		{
+			m_MAR[lane] = ComputePhysicalAddress(m_SS[lane], m_SP[lane] - 1);
+			m_MBR[lane] = m_CS[lane] >> 8;
+			Write(lane, m_MAR[lane], m_MBR[lane]);
+			m_SP[lane]--;
+			m_MAR[lane] = ComputePhysicalAddress(m_SS[lane], m_SP[lane] - 1);
+			m_MBR[lane] = m_CS[lane];
+			Write(lane, m_MAR[lane], m_MBR[lane]);
+			m_SP[lane]--;
+			m_CS[lane] = m_DEST_SEL[lane];
+		}
+		break;
+	case Star::ret0:
+		m_MAR[lane] = ComputePhysicalAddress(m_SS[lane], m_SP[lane]);
+		m_SP[lane]++;
+		m_MBR[lane] = Read(lane, m_MAR[lane]);
+		m_MAR[lane] = ComputePhysicalAddress(m_SS[lane], m_SP[lane]);
+		m_SP[lane]++;
+		m_IP[lane] = Concat(Read(lane, m_MAR[lane]), m_MBR[lane]);
+		break;
+	case Star::int0:
+		Interrupt(lane);
+		return;
+	case Star::iret0:
+		m_MAR[lane] = ComputePhysicalAddress(m_SS[lane], m_SP[lane]);
+		m_SP[lane]++;
+		m_MBR[lane] = Read(lane, m_MAR[lane]);
+		m_MAR[lane] = ComputePhysicalAddress(m_SS[lane], m_SP[lane]);
+		m_SP[lane]++;
+		m_CS[lane] = Concat(Read(lane, m_MAR[lane]), m_MBR[lane]);
+		m_MAR[lane] = ComputePhysicalAddress(m_SS[lane], m_SP[lane]);
+		m_SP[lane]++;
+		m_MBR[lane] = Read(lane, m_MAR[lane]);
+		m_MAR[lane] = ComputePhysicalAddress(m_SS[lane], m_SP[lane]);
+		m_SP[lane]++;
+		m_IP[lane] = Concat(Read(lane, m_MAR[lane]), m_MBR[lane]);
+		m_MAR[lane] = ComputePhysicalAddress(m_SS[lane], m_SP[lane]);
+		m_SP[lane]++;
+		m_F[lane] = Read(lane, m_MAR[lane]) & 0b111111;
+		SwapStacks(lane);
+		m_STAR[lane] = Star::fetch0;
+		return;
+	case Star::cli0:
+		SetFlag(lane, FLAG_IF, false);
+		m_STAR[lane] = Star::fetch0;
+		return;
+	case Star::sti0:
+		SetFlag(lane, FLAG_IF, true);
+		m_STAR[lane] = m_intr[lane] ? Star::pre_tipo0 : Star::fetch0;
+		return;
+	case Star::ldpsr0:
+		m_PREV_SS[lane] = m_SS[lane];
+		m_PREV_SP[lane] = m_SP[lane];
+		break;
+	case Star::stum0:
+	{
+		SetFlag(lane, FLAG_US, true);
+		auto tmp = m_SS[lane];
+		m_SS[lane] = m_PREV_SS[lane];
+		m_PREV_SS[lane] = tmp;
+		tmp = m_SP[lane];
+		m_SP[lane] = m_PREV_SP[lane];
+		m_PREV_SP[lane] = tmp;
+	}
+	break;
+	default:
+		m_STAR[lane] = Star::hlt0;
+		return;
+	}
+
+	m_STAR[lane] = GetNextState(lane);
+}
+
+void LaneProcessor::Interrupt(int lane)
+{
+	//int0 .. int2, see FastProcessor::Interrupt
+	SwapStacks(lane);
+	m_SP[lane]--;
+	m_MAR[lane] = ComputePhysicalAddress(m_SS[lane], m_SP[lane]);
+	m_DIR[lane] = true;
+	m_MBR[lane] = m_F[lane];
+	Write(lane, m_MAR[lane], m_MBR[lane]);
+
+	m_MW_[lane] = false;
+	m_STAR[lane] = Star::int3;
+}
+
+void LaneProcessor::SwapStacks(int lane)
+{
+	if (!GetFlag(lane, FLAG_US))
+		return;
+
+	auto ss = m_SS[lane];
+	m_SS[lane] = m_PREV_SS[lane];
+	m_PREV_SS[lane] = ss;
+	auto sp = m_SP[lane];
+	m_SP[lane] = m_PREV_SP[lane];
+	m_PREV_SP[lane] = sp;
+}
+
+Star LaneProcessor::GetNextState(int lane) const
+{
+	return GetFlag(lane, FLAG_IF) ? Star::pre_tipo0 : Star::fetch0;
+}
+
+bool LaneProcessor::GetFlag(int lane, int index) const
+{
+	return (m_F[lane] >> index) & 1;
+}
+
+void LaneProcessor::SetFlag(int lane, int index, bool val)
+{
+	m_F[lane] = (m_F[lane] & ~(1 << index)) | (val << index);
+}
+
+void LaneProcessor::OnReset()
+{
+	for (int lane = 0; lane < LANES; lane++)
+	{
+		m_cycles[lane] = 0;
+		m_instructions[lane] = 0;
+		m_MAR[lane] = 0;
+		m_DI[lane] = m_DS[lane] = m_SS[lane] = m_SP[lane] = 0;
+		m_DEST_OFF[lane] = m_DEST_SEL[lane] = m_PREV_SS[lane] = m_PREV_SP[lane] = 0;
+		m_AL[lane] = m_AH[lane] = m_MBR[lane] = m_OPCODE[lane] = m_SOURCE[lane] = m_d7_d0[lane] = 0;
+		m_MJR[lane] = Star::fetch0;
+
+		m_DIR[lane] = false;
+		m_MR_[lane] = true;
+		m_MW_[lane] = true;
+		m_IOR_[lane] = true;
+		m_IOW_[lane] = true;
+		m_INTA[lane] = false;
+		m_intr[lane] = false;
+		m_F[lane] = 0b000000;
+		m_CS[lane] = 0xF000;
+		m_IP[lane] = 0x0000;
+		m_STAR[lane] = Star::fetch0;
+	}
+
+	m_running = m_laneCount == LANES ? ~0u : (1u << m_laneCount) - 1;
+}
+
+bool LaneProcessor::IsHalted(int lane) const
+{
+	return m_STAR[lane] == Star::hlt0 || m_STAR[lane] == Star::nvi0 || m_STAR[lane] == Star::int3;
+}
+
+CPU::State LaneProcessor::GetState(int lane) const
+{
+	CPU::State state = {};
+	state.cycles = m_cycles[lane];
+	state.instructions = m_instructions[lane];
+	state.mar = m_MAR[lane];
+	state.di = m_DI[lane];
+	state.ds = m_DS[lane];
+	state.cs = m_CS[lane];
+	state.ip = m_IP[lane];
+	state.ss = m_SS[lane];
+	state.sp = m_SP[lane];
+	state.destOff = m_DEST_OFF[lane];
+	state.destSel = m_DEST_SEL[lane];
+	state.prevSs = m_PREV_SS[lane];
+	state.prevSp = m_PREV_SP[lane];
+	state.star = (uint8_t)m_STAR[lane];
+	state.mjr = (uint8_t)m_MJR[lane];
+	state.d7d0 = m_d7_d0[lane];
+	state.f = m_F[lane];
+	state.al = m_AL[lane];
+	state.ah = m_AH[lane];
+	state.mbr = m_MBR[lane];
+	state.opcode = m_OPCODE[lane];
+	state.source = m_SOURCE[lane];
+	state.mr_ = m_MR_[lane];
+	state.mw_ = m_MW_[lane];
+	state.ior_ = m_IOR_[lane];
+	state.iow_ = m_IOW_[lane];
+	state.inta = m_INTA[lane];
+	state.dir = m_DIR[lane];
+	state.intr = m_intr[lane];
+	return state;
+}
+
+bool LaneProcessor::SetState(int lane, const CPU::State &state)
+{
+	auto star = (Star)state.star;
+	if (star != Star::fetch0 && star != Star::pre_tipo0 && star != Star::hlt0 && star != Star::nvi0 && star != Star::int3)
+		return false;
+
+	m_cycles[lane] = state.cycles;
+	m_instructions[lane] = state.instructions;
+	m_MAR[lane] = state.mar;
+	m_DI[lane] = state.di;
+	m_DS[lane] = state.ds;
+	m_CS[lane] = state.cs;
+	m_IP[lane] = state.ip;
+	m_SS[lane] = state.ss;
+	m_SP[lane] = state.sp;
+	m_DEST_OFF[lane] = state.destOff;
+	m_DEST_SEL[lane] = state.destSel;
+	m_PREV_SS[lane] = state.prevSs;
+	m_PREV_SP[lane] = state.prevSp;
+	m_STAR[lane] = star;
+	m_MJR[lane] = (Star)state.mjr;
+	m_d7_d0[lane] = state.d7d0;
+	m_F[lane] = state.f;
+	m_AL[lane] = state.al;
+	m_AH[lane] = state.ah;
+	m_MBR[lane] = state.mbr;
+	m_OPCODE[lane] = state.opcode;
+	m_SOURCE[lane] = state.source;
+	m_MR_[lane] = state.mr_;
+	m_MW_[lane] = state.mw_;
+	m_IOR_[lane] = state.ior_;
+	m_IOW_[lane] = state.iow_;
+	m_INTA[lane] = state.inta;
+	m_DIR[lane] = state.dir;
+	m_intr[lane] = state.intr;
+	return true;
+}
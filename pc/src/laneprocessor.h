@@ -0,0 +1,67 @@
+#pragma once
+#include "alu.h"
+#include "bus.h"
+#include "cpu.h"
+#include "../../common/star.h"
+#include <cstdint>
+#include <vector>
+
+//Runs up to LANES machines in lockstep, one instruction per Step like FastProcessor, with the
+//registers of every machine kept in structure of arrays. Every lane has its own bus and memory.
+//After the fetch the lanes are grouped by opcode: ALU instructions and conditional jumps of a group
+//run as vector kernels (see ALU::ExecuteLanes and Instructions::GetConditionLanes), every other
+//instruction and the lanes that went another way run lane by lane.
+//The state of every lane is the same FastProcessor, and so Processor, would have.
+class LaneProcessor
+{
+public:
+	static constexpr int LANES = ALU::LANES;
+
+	LaneProcessor() = delete;
+	//one bus per lane, at most LANES
+	LaneProcessor(const std::vector<Bus *> &buses);
+	int GetLaneCount() const;
+
+	void OnReset();
+	//one instruction on every running lane
+	void Step();
+	//steps until every lane halts or reaches its own maxCycles, 0 means no limit
+	void Run(const std::vector<uint64_t> &maxCycles);
+
+	bool IsHalted(int lane) const;
+	CPU::State GetState(int lane) const;
+	//only the states between two instructions, see FastProcessor::SetState
+	bool SetState(int lane, const CPU::State &state);
+
+private:
+	std::vector<Bus *> m_buses;
+	int m_laneCount;
+	//lanes stepped by Step
+	uint32_t m_running;
+
+	uint64_t m_cycles[LANES];
+	uint64_t m_instructions[LANES];
+	uint32_t m_MAR[LANES];
+	uint16_t m_DI[LANES], m_DS[LANES], m_CS[LANES], m_IP[LANES], m_SS[LANES], m_SP[LANES];
+	uint16_t m_DEST_OFF[LANES], m_DEST_SEL[LANES], m_PREV_SS[LANES], m_PREV_SP[LANES];
+	alignas(32) uint8_t m_AL[LANES];
+	alignas(32) uint8_t m_F[LANES];
+	alignas(32) uint8_t m_SOURCE[LANES];
+	uint8_t m_AH[LANES], m_MBR[LANES], m_OPCODE[LANES], m_d7_d0[LANES];
+	bool m_MR_[LANES], m_MW_[LANES], m_IOR_[LANES], m_IOW_[LANES], m_INTA[LANES], m_DIR[LANES], m_intr[LANES];
+	Star m_STAR[LANES], m_MJR[LANES];
+
+	uint8_t Read(int lane, uint32_t address);
+	void Write(int lane, uint32_t address, uint8_t data);
+	uint8_t FetchByte(int lane);
+	//the operands of the instruction, leaves IP, MAR and d7_d0 as FetchByte would
+	void FetchOperands(int lane, uint8_t *operands, int count);
+	void Fetch(int lane);
+	void ExecuteGroup(uint8_t opcode, uint32_t lanes);
+	void Execute(int lane);
+	void Interrupt(int lane);
+	void SwapStacks(int lane);
+	Star GetNextState(int lane) const;
+	bool GetFlag(int lane, int index) const;
+	void SetFlag(int lane, int index, bool val);
+};
@@ -0,0 +1,235 @@
+#include "machine.h"
+#include "aotprocessor.h"
+#include "fastprocessor.h"
+#include "jitprocessor.h"
+#include "processor.h"
+#include <iostream>
+
+#define FNV_OFFSET 0xcbf29ce484222325ull
+#define FNV_PRIME 0x100000001b3ull
+
+namespace
+{
+	void Hash(uint64_t &hash, const void *data, std::size_t size)
+	{
+		auto bytes = (const uint8_t *)data;
+		for (std::size_t i = 0; i < size; i++)
+		{
+			hash = (hash ^ bytes[i]) * FNV_PRIME;
+		}
+	}
+
+	template <typename T>
+	void Hash(uint64_t &hash, T value)
+	{
+		Hash(hash, &value, sizeof(value));
+	}
+} // namespace
+
+bool Machine::Timing::HasDefaultLatency() const
+{
+	return romLatency == MemDevice::DEFAULT_LATENCY && ramLatency == MemDevice::DEFAULT_LATENCY;
+}
+
+Machine::Machine(std::shared_ptr<const RomImage> program, Engine engine, uint32_t seed, const Timing &timing)
+		: m_eprom(EPROM_START, EPROM_END, true, false, false),
+			m_ramOne(RAM_ONE_START, RAM_ONE_END, true, true, false),
+			m_vidMem(VID_MEM_START, VID_MEM_END, false, true, true),
+			m_ramTwo(RAM_TWO_START, RAM_TWO_END, true, true, false),
+			m_devices({&m_eprom, &m_ramOne, &m_vidMem, &m_ramTwo}),
+			m_engine(engine),
+			m_valid(true)
+{
+	for (auto device : m_devices)
+	{
+		if (!m_bus.RegisterDevice(*device))
+		{
+			std::cerr << "Memory device [" << device->GetFrom() << ", " << device->GetTo() << "] overlaps another device\n";
+			m_valid = false;
+		}
+	}
+	SetFillSeed(seed);
+	if (program != nullptr && !MapProgram(program))
+	{
+		m_valid = false;
+	}
+
+	//before OnReset, FastProcessor looks at the latencies there
+	m_eprom.SetLatency(timing.romLatency);
+	m_ramOne.SetLatency(timing.ramLatency);
+	m_ramTwo.SetLatency(timing.ramLatency);
+	if (!timing.HasDefaultLatency() && (engine == Engine::Jit || engine == Engine::Aot))
+	{
+		std::cerr << "--jit and --aot only count the cycles of the default memory latency\n";
+		m_valid = false;
+	}
+
+	switch (engine)
+	{
+	case Engine::Processor:
+	{
+		auto processor = std::make_unique<Processor>(m_bus);
+		processor->SetFastBus(timing.fastBus);
+		m_processor = std::move(processor);
+	}
+	break;
+	case Engine::Fast:
+		m_processor = std::make_unique<FastProcessor>(m_bus);
+		break;
+	case Engine::Jit:
+		m_processor = std::make_unique<JitProcessor>(m_bus);
+		break;
+	case Engine::Aot:
+		m_processor = std::make_unique<AotProcessor>(m_bus);
+		break;
+	}
+	m_processor->OnReset();
+	if (program != nullptr)
+	{
+		auto state = m_processor->GetState();
+		state.cs = program->GetEntryCS();
+		state.ip = program->GetEntryIP();
+		m_processor->SetState(state);
+	}
+}
+
+bool Machine::MapProgram(const std::shared_ptr<const RomImage> &program)
+{
+	for (const auto &section : program->GetSections())
+	{
+		if (section.size == 0)
+			continue;
+
+		//a section cannot span two devices
+		auto device = m_bus.GetDevice(section.address);
+		if (device == nullptr || section.address + section.size - 1 > (uint64_t)device->GetTo())
+		{
+			std::cerr << "The section at " << section.address << " of " << section.size << " bytes is not inside a memory device\n";
+			return false;
+		}
+
+		device->MapImage(section.address, std::shared_ptr<const uint8_t>(program, section.data), section.size);
+	}
+
+	return true;
+}
+
+bool Machine::IsValid() const
+{
+	return m_valid;
+}
+
+CPU &Machine::GetCPU()
+{
+	return *m_processor;
+}
+
+Bus &Machine::GetBus()
+{
+	return m_bus;
+}
+
+MemDevice &Machine::GetEprom()
+{
+	return m_eprom;
+}
+
+MemDevice &Machine::GetRamOne()
+{
+	return m_ramOne;
+}
+
+MemDevice &Machine::GetRamTwo()
+{
+	return m_ramTwo;
+}
+
+MemDevice &Machine::GetVideoMemory()
+{
+	return m_vidMem;
+}
+
+const std::vector<MemDevice *> &Machine::GetDevices() const
+{
+	return m_devices;
+}
+
+void Machine::SetFillSeed(uint32_t seed)
+{
+	m_bus.SetFillSeed(seed);
+	for (auto device : m_devices)
+	{
+		device->SetFillSeed(seed);
+	}
+}
+
+bool Machine::SetTraceWriter(TraceWriter *writer)
+{
+	if (m_engine != Engine::Processor)
+		return false;
+
+	static_cast<Processor &>(*m_processor).SetTraceWriter(writer);
+	return true;
+}
+
+bool Machine::SetProfiler(Profiler *profiler)
+{
+	if (m_engine != Engine::Processor)
+		return false;
+
+	static_cast<Processor &>(*m_processor).SetProfiler(profiler);
+	return true;
+}
+
+bool Machine::SetHistograms(Histograms *histograms)
+{
+	if (m_engine != Engine::Processor)
+		return false;
+
+	static_cast<Processor &>(*m_processor).SetHistograms(histograms);
+	return true;
+}
+
+void Machine::Run(uint64_t maxCycles)
+{
+	m_processor->SetCycleLimit(maxCycles);
+	while (!m_processor->IsHalted() && (maxCycles == 0 || m_processor->GetCycles() < maxCycles))
+	{
+		m_processor->Step();
+	}
+}
+
+uint64_t Machine::GetRegisterDigest() const
+{
+	//the microstate and the internal registers depend on the engine, see FastProcessor
+	auto state = m_processor->GetState();
+	uint64_t hash = FNV_OFFSET;
+	for (uint16_t value : {state.cs, state.ip, state.ss, state.sp, state.ds, state.di, state.prevSs, state.prevSp})
+	{
+		Hash(hash, value);
+	}
+	for (uint8_t value : {state.al, state.ah, state.f})
+	{
+		Hash(hash, value);
+	}
+	return hash;
+}
+
+uint64_t Machine::GetMemoryDigest() const
+{
+	uint64_t hash = FNV_OFFSET;
+	for (auto device : m_devices)
+	{
+		for (std::size_t i = 0; i < device->GetPageCount(); i++)
+		{
+			auto page = device->GetPageAt(i);
+			if (page == nullptr || page->IsEmpty())
+				continue;
+
+			Hash(hash, (uint32_t)(((device->GetFrom() >> MemDevice::PAGE_BITS) + i) << MemDevice::PAGE_BITS));
+			Hash(hash, page->data, sizeof(page->data));
+			Hash(hash, page->initialized, sizeof(page->initialized));
+		}
+	}
+	return hash;
+}
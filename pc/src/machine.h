@@ -0,0 +1,96 @@
+#pragma once
+#include "bus.h"
+#include "cpu.h"
+#include "histograms.h"
+#include "memdevice.h"
+#include "profiler.h"
+#include "romimage.h"
+#include "tracefile.h"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#define RAM_ONE_START 0x00000
+#define RAM_ONE_END 0x9FFFF
+
+#define VID_MEM_START 0xA0000
+#define VID_MEM_END 0xAFFFF
+
+#define RAM_TWO_START 0xB0000
+#define RAM_TWO_END 0xEFFFF
+
+#define EPROM_START 0xF0000
+#define EPROM_END 0xFFFFF
+
+//A complete ME88: the bus, the memory devices and the processor, independent from any other instance.
+class Machine
+{
+public:
+	//Processor runs microstates, FastProcessor whole instructions, JitProcessor translated blocks and
+	//AotProcessor the ROM recompiled by ME88Recompile
+	enum class Engine
+	{
+		Processor,
+		Fast,
+		Jit,
+		Aot
+	};
+
+	//wait states of the reads from each device, see MemDevice::SetLatency
+	struct Timing
+	{
+		int romLatency = MemDevice::DEFAULT_LATENCY;
+		//both RAMs, the video memory cannot be read
+		int ramLatency = MemDevice::DEFAULT_LATENCY;
+		//Processor only, see Processor::SetFastBus. The other engines never run the wait states one by one
+		bool fastBus = false;
+
+		bool HasDefaultLatency() const;
+	};
+
+	//the memory devices map the sections of program, that can be shared by many machines, and the
+	//processor starts from its entry point. Jit and Aot only count the cycles of the default latency, the
+	//machine is not valid with any other
+	Machine(std::shared_ptr<const RomImage> program, Engine engine, uint32_t seed, const Timing &timing);
+	Machine(const Machine &) = delete;
+	Machine &operator=(const Machine &) = delete;
+	//false if the memory devices could not be mapped on the bus
+	bool IsValid() const;
+
+	CPU &GetCPU();
+	Bus &GetBus();
+	MemDevice &GetEprom();
+	MemDevice &GetRamOne();
+	MemDevice &GetRamTwo();
+	MemDevice &GetVideoMemory();
+	//in registration order, as stored in the snapshots
+	const std::vector<MemDevice *> &GetDevices() const;
+
+	void SetFillSeed(uint32_t seed);
+	//only with Processor, false with the other engines
+	bool SetTraceWriter(TraceWriter *writer);
+	bool SetProfiler(Profiler *profiler);
+	bool SetHistograms(Histograms *histograms);
+
+	//steps until the processor halts or reaches maxCycles, 0 means no limit
+	void Run(uint64_t maxCycles);
+
+	//FNV-1a of the programmer visible registers and of the memory content, the same for both engines
+	uint64_t GetRegisterDigest() const;
+	uint64_t GetMemoryDigest() const;
+
+private:
+	Bus m_bus;
+	MemDevice m_eprom;
+	MemDevice m_ramOne;
+	MemDevice m_vidMem;
+	MemDevice m_ramTwo;
+	std::vector<MemDevice *> m_devices;
+	std::unique_ptr<CPU> m_processor;
+	Engine m_engine;
+	bool m_valid;
+
+	//false if a section is not inside a memory device
+	bool MapProgram(const std::shared_ptr<const RomImage> &program);
+};
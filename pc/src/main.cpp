@@ -1,14 +1,211 @@
 #include "microPC.h"
+#include "laneprocessor.h"
+#include "memdevice.h"
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <limits>
 #include <string>
+#include <type_traits>
+
+//the whole text as a number that fits in value, base 0 takes 0x and 0 prefixes as well
+template <typename T>
+bool ParseNumber(const char *text, T &value, int base = 10)
+{
+	char *end;
+	errno = 0;
+	if constexpr (std::is_signed<T>::value)
+	{
+		auto number = strtoll(text, &end, base);
+		if (number < std::numeric_limits<T>::min() || number > std::numeric_limits<T>::max())
+			return false;
+		value = number;
+	}
+	else
+	{
+		//strtoull takes -1 as the largest value
+		auto number = strtoull(text, &end, base);
+		if (text[strspn(text, " \t")] == '-' || number > std::numeric_limits<T>::max())
+			return false;
+		value = number;
+	}
+
+	return end != text && *end == 0 && errno == 0;
+}
+
+void PrintUsage()
+{
+	std::cout << "usage: ME88 [--rom path] [-d] [--headless] [--fast] [--jit] [--aot] [--trace] [--trace-file path] [--profile path] [--histograms path] [--load-state path] [--save-state path] [--batch jobs [--threads N] [--lanes N]] [--rom-latency N] [--ram-latency N] [--fast-bus] [--share name] [--fps N] [--every N] [--cycles N] [--seed N]\n";
+}
 
 int main(int argc, char* argv[])
 {
-	bool debug = false;
-	if(argc > 1)
-	{			
-		debug = argv[1] == std::string("-d") || argv[1] == std::string("-D");
+	microPC::Options options;
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+		if (arg == "--rom" && hasValue)
+		{
+			options.rom = argv[++i];
+		}
+		else if (arg == "-d" || arg == "-D")
+		{
+			options.debugging = true;
+		}
+		else if (arg == "--headless")
+		{
+			options.headless = true;
+		}
+		else if (arg == "--fast")
+		{
+			options.fast = true;
+		}
+		else if (arg == "--jit")
+		{
+			options.jit = true;
+		}
+		else if (arg == "--aot")
+		{
+			options.aot = true;
+		}
+		else if (arg == "--trace")
+		{
+			options.trace = true;
+		}
+		else if (arg == "--trace-file" && hasValue)
+		{
+			options.traceFile = argv[++i];
+		}
+		else if (arg == "--profile" && hasValue)
+		{
+			options.profile = argv[++i];
+		}
+		else if (arg == "--histograms" && hasValue)
+		{
+			options.histograms = argv[++i];
+		}
+		else if (arg == "--load-state" && hasValue)
+		{
+			options.loadState = argv[++i];
+		}
+		else if (arg == "--save-state" && hasValue)
+		{
+			options.saveState = argv[++i];
+		}
+		else if (arg == "--batch" && hasValue)
+		{
+			options.batch = argv[++i];
+		}
+		else if (arg == "--threads" && hasValue)
+		{
+			if (!ParseNumber(argv[++i], options.threads))
+			{
+				PrintUsage();
+				return 1;
+			}
+			if (options.threads <= 0)
+			{
+				std::cerr << "--threads must be at least 1\n";
+				return 1;
+			}
+		}
+		else if (arg == "--lanes" && hasValue)
+		{
+			if (!ParseNumber(argv[++i], options.lanes))
+			{
+				PrintUsage();
+				return 1;
+			}
+			if (options.lanes < 1 || options.lanes > LaneProcessor::LANES)
+			{
+				std::cerr << "--lanes must be between 1 and " << LaneProcessor::LANES << "\n";
+				return 1;
+			}
+		}
+		else if (arg == "--rom-latency" && hasValue)
+		{
+			if (!ParseNumber(argv[++i], options.romLatency))
+			{
+				PrintUsage();
+				return 1;
+			}
+			if (options.romLatency < 0 || options.romLatency > MemDevice::MAX_LATENCY)
+			{
+				std::cerr << "--rom-latency must be between 0 and " << MemDevice::MAX_LATENCY << "\n";
+				return 1;
+			}
+		}
+		else if (arg == "--ram-latency" && hasValue)
+		{
+			if (!ParseNumber(argv[++i], options.ramLatency))
+			{
+				PrintUsage();
+				return 1;
+			}
+			if (options.ramLatency < 0 || options.ramLatency > MemDevice::MAX_LATENCY)
+			{
+				std::cerr << "--ram-latency must be between 0 and " << MemDevice::MAX_LATENCY << "\n";
+				return 1;
+			}
+		}
+		else if (arg == "--fast-bus")
+		{
+			options.fastBus = true;
+		}
+		else if (arg == "--share" && hasValue)
+		{
+			options.share = argv[++i];
+		}
+		else if (arg == "--fps" && hasValue)
+		{
+			if (!ParseNumber(argv[++i], options.fps))
+			{
+				PrintUsage();
+				return 1;
+			}
+			if (options.fps <= 0)
+			{
+				std::cerr << "--fps must be at least 1\n";
+				return 1;
+			}
+		}
+		else if (arg == "--every" && hasValue)
+		{
+			if (!ParseNumber(argv[++i], options.redrawCycles))
+			{
+				PrintUsage();
+				return 1;
+			}
+		}
+		else if (arg == "--cycles" && hasValue)
+		{
+			if (!ParseNumber(argv[++i], options.maxCycles))
+			{
+				PrintUsage();
+				return 1;
+			}
+		}
+		else if (arg == "--seed" && hasValue)
+		{
+			if (!ParseNumber(argv[++i], options.seed, 0))
+			{
+				PrintUsage();
+				return 1;
+			}
+		}
+		else
+		{
+			PrintUsage();
+			return 1;
+		}
+	}
+
+	if (!options.batch.empty())
+	{
+		return microPC::RunBatch(options) ? 0 : 1;
 	}
 
-	microPC::PowerOn(debug);
-	return 0;
-}
\ No newline at end of file
+	return microPC::PowerOn(options) ? 0 : 1;
+}
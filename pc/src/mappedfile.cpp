@@ -0,0 +1,40 @@
+#include "mappedfile.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedFile::MappedFile(const std::string &filename)
+{
+	auto fd = open(filename.c_str(), O_RDONLY);
+	if (fd < 0)
+		return;
+
+	struct stat info;
+	if (fstat(fd, &info) == 0 && info.st_size > 0)
+	{
+		auto address = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (address != MAP_FAILED)
+		{
+			m_data = (const uint8_t *)address;
+			m_size = info.st_size;
+		}
+	}
+	close(fd);
+}
+
+MappedFile::~MappedFile()
+{
+	if (m_data)
+		munmap((void *)m_data, m_size);
+}
+
+const uint8_t *MappedFile::Data() const
+{
+	return m_data;
+}
+
+std::size_t MappedFile::Size() const
+{
+	return m_size;
+}
@@ -0,0 +1,22 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+//read only mapping of a whole file, released when it goes out of scope
+class MappedFile
+{
+public:
+	MappedFile(const std::string &filename);
+	~MappedFile();
+	MappedFile(const MappedFile &) = delete;
+	MappedFile &operator=(const MappedFile &) = delete;
+
+	//nullptr if the file could not be mapped or is empty
+	const uint8_t *Data() const;
+	std::size_t Size() const;
+
+private:
+	const uint8_t *m_data = nullptr;
+	std::size_t m_size = 0;
+};
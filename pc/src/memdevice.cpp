@@ -1,19 +1,171 @@
 #include "memdevice.h"
-#include <ctime>
+#include <algorithm>
+#include <cstring>
 #include <sstream>
 #include <vector>
-#include <algorithm>
 
-MemDevice::MemDevice(int from, int to, bool read, bool write, bool io, const std::vector<int> &mem) : m_addFrom(from), m_addTo(to), m_readable(read), m_writeable(write), m_IO(io)
+MemDevice::MemDevice(int from, int to, bool read, bool write, bool io, const std::vector<int> &mem) : m_addFrom(from), m_addTo(to), m_readable(read), m_writeable(write), m_IO(io), m_fillSeed(DEFAULT_FILL_SEED), m_latency(DEFAULT_LATENCY), m_allDirty(true)
+{
+	m_pages.resize((to >> PAGE_BITS) - (from >> PAGE_BITS) + 1);
+	m_dirtyPages.resize(m_pages.size() / 64 + 1);
+	std::vector<uint8_t> bytes(mem.begin(), mem.end());
+	StoreBlock(from, bytes.data(), bytes.size());
+}
+
+MemDevice::MemDevice(int from, int to, bool read, bool write, bool io, const std::unordered_map<int, std::bitset<8>> &mem) : m_addFrom(from), m_addTo(to), m_readable(read), m_writeable(write), m_IO(io), m_fillSeed(DEFAULT_FILL_SEED), m_latency(DEFAULT_LATENCY), m_allDirty(true)
+{
+	m_pages.resize((to >> PAGE_BITS) - (from >> PAGE_BITS) + 1);
+	m_dirtyPages.resize(m_pages.size() / 64 + 1);
+	for (const auto &loc : mem)
+	{
+		Store(loc.first, loc.second.to_ulong());
+	}
+}
+
+std::size_t MemDevice::GetPageIndex(int address) const
 {
-	for (int i = 0; i < mem.size(); i++)
+	return (address >> PAGE_BITS) - (m_addFrom >> PAGE_BITS);
+}
+
+MemDevice::Page *MemDevice::GetPage(int address)
+{
+	return AllocatePageAt(GetPageIndex(address));
+}
+
+bool MemDevice::Page::IsEmpty() const
+{
+	for (auto word : initialized)
 	{
-		m_memory[from + i] = mem[i];
+		if (word != 0)
+			return false;
 	}
+
+	return true;
 }
 
-MemDevice::MemDevice(int from, int to, bool read, bool write, bool io, const std::unordered_map<int, std::bitset<8>> &mem) : m_addFrom(from), m_addTo(to), m_readable(read), m_writeable(write), m_IO(io), m_memory(mem)
+std::size_t MemDevice::GetPageCount() const
 {
+	return m_pages.size();
+}
+
+const MemDevice::Page *MemDevice::GetPageAt(std::size_t index) const
+{
+	return LoadPage(index);
+}
+
+MemDevice::Page *MemDevice::AllocatePageAt(std::size_t index)
+{
+	auto page = LoadPage(index);
+	if (page == nullptr)
+	{
+		m_pages[index] = std::make_unique<Page>();
+		page = m_pages[index].get();
+	}
+
+	return page;
+}
+
+MemDevice::Page *MemDevice::LoadPage(std::size_t index) const
+{
+	auto &page = m_pages[index];
+	if (page != nullptr || m_images.empty())
+		return page.get();
+
+	int base = ((m_addFrom >> PAGE_BITS) + (int)index) << PAGE_BITS;
+	for (const auto &image : m_images)
+	{
+		int first = std::max(base, image.from);
+		int last = std::min(base + PAGE_SIZE - 1, image.to);
+		if (first > last)
+			continue;
+
+		if (page == nullptr)
+		{
+			page = std::make_unique<Page>();
+		}
+		std::memcpy(page->data + (first - base), image.data.get() + (first - image.from), last - first + 1);
+		for (int offset = first - base; offset <= last - base; offset++)
+		{
+			page->SetInitialized(offset);
+		}
+		MarkDirty(index, first - base, last - first + 1);
+	}
+
+	return page.get();
+}
+
+void MemDevice::ClearPages()
+{
+	for (auto &page : m_pages)
+	{
+		page.reset();
+	}
+	m_images.clear();
+	m_allDirty = true;
+}
+
+void MemDevice::MapImage(int address, std::shared_ptr<const uint8_t> image, std::size_t size)
+{
+	//only the part in the device
+	int from = std::max(address, m_addFrom);
+	int to = (int)std::min((int64_t)address + (int64_t)size - 1, (int64_t)m_addTo);
+	if (from > to)
+		return;
+
+	auto data = std::shared_ptr<const uint8_t>(image, image.get() + (from - address));
+	m_images.push_back({from, to, std::move(data)});
+}
+
+void MemDevice::Store(int address, uint8_t data)
+{
+	if (!IsAddressInRange(address))
+		return;
+
+	auto index = GetPageIndex(address);
+	auto page = AllocatePageAt(index);
+	auto offset = address & (PAGE_SIZE - 1);
+	page->data[offset] = data;
+	page->SetInitialized(offset);
+	//MarkDirty of a single byte, this is every write of the processor
+	page->dirty |= (uint64_t)1 << (offset >> DIRTY_LINE_BITS);
+	m_dirtyPages[index >> 6] |= (uint64_t)1 << (index & 63);
+}
+
+void MemDevice::StoreBlock(int address, const uint8_t *data, std::size_t size)
+{
+	while (size > 0)
+	{
+		auto run = GetPageRun(address, size);
+		if (IsAddressInRange(address) && IsAddressInRange(address + run - 1))
+		{
+			auto index = GetPageIndex(address);
+			auto page = AllocatePageAt(index);
+			auto offset = address & (PAGE_SIZE - 1);
+			std::memcpy(page->data + offset, data, run);
+			for (std::size_t i = 0; i < run; i++)
+			{
+				page->SetInitialized(offset + i);
+			}
+			MarkDirty(index, offset, run);
+		}
+		else
+		{
+			//first or last page of the device
+			for (std::size_t i = 0; i < run; i++)
+			{
+				Store(address + i, data[i]);
+			}
+		}
+
+		address += run;
+		data += run;
+		size -= run;
+	}
+}
+
+std::size_t MemDevice::GetPageRun(int address, std::size_t size)
+{
+	return std::min(size, (std::size_t)(PAGE_SIZE - (address & (PAGE_SIZE - 1))));
 }
 
 void MemDevice::Write(int to, const std::bitset<8> &data)
@@ -22,7 +174,7 @@ void MemDevice::Write(int to, const std::bitset<8> &data)
 	if (!m_writeable || !IsAddressInRange(to))
 		return;
 
-	m_memory[to] = data;
+	Store(to, data.to_ulong());
 }
 
 std::bitset<8> MemDevice::Read(int from)
@@ -30,20 +182,147 @@ std::bitset<8> MemDevice::Read(int from)
 
 	if (!m_readable || !IsAddressInRange(from))
 	{
-		return std::rand() % 255;
+		return GetFillValue(m_fillSeed, from);
 	}
 
-	auto it = m_memory.find(from);
-	if (it != m_memory.end())
+	auto index = GetPageIndex(from);
+	auto page = AllocatePageAt(index);
+	auto offset = from & (PAGE_SIZE - 1);
+	if (!page->IsInitialized(offset))
 	{
-		return m_memory[from];
+		page->data[offset] = GetFillValue(m_fillSeed, from);
+		page->SetInitialized(offset);
+		MarkDirty(index, offset, 1);
 	}
-	else
+
+	return page->data[offset];
+}
+
+void MemDevice::ReadBlock(int from, uint8_t *data, std::size_t size)
+{
+	while (size > 0)
+	{
+		auto run = GetPageRun(from, size);
+		if (m_readable && IsAddressInRange(from) && IsAddressInRange(from + run - 1))
+		{
+			auto index = GetPageIndex(from);
+			auto page = AllocatePageAt(index);
+			auto offset = from & (PAGE_SIZE - 1);
+			for (std::size_t i = 0; i < run; i++)
+			{
+				if (!page->IsInitialized(offset + i))
+				{
+					page->data[offset + i] = GetFillValue(m_fillSeed, from + i);
+					page->SetInitialized(offset + i);
+					MarkDirty(index, offset + i, 1);
+				}
+				data[i] = page->data[offset + i];
+			}
+		}
+		else
+		{
+			for (std::size_t i = 0; i < run; i++)
+			{
+				data[i] = Read(from + i).to_ulong();
+			}
+		}
+
+		from += run;
+		data += run;
+		size -= run;
+	}
+}
+
+void MemDevice::MarkDirty(std::size_t index, int offset, int size) const
+{
+	auto page = m_pages[index].get();
+	for (int line = offset >> DIRTY_LINE_BITS; line <= (offset + size - 1) >> DIRTY_LINE_BITS; line++)
+	{
+		page->dirty |= (uint64_t)1 << line;
+	}
+	m_dirtyPages[index >> 6] |= (uint64_t)1 << (index & 63);
+}
+
+void MemDevice::GetDirtyLines(std::vector<int> &lines) const
+{
+	lines.clear();
+	for (std::size_t word = 0; word < m_dirtyPages.size(); word++)
+	{
+		for (auto pages = m_dirtyPages[word]; pages != 0; pages &= pages - 1)
+		{
+			auto index = word * 64 + __builtin_ctzll(pages);
+			auto page = m_pages[index].get();
+			int base = ((m_addFrom >> PAGE_BITS) + (int)index) << PAGE_BITS;
+			for (auto dirty = page != nullptr ? page->dirty : 0; dirty != 0; dirty &= dirty - 1)
+			{
+				lines.push_back(base + (__builtin_ctzll(dirty) << DIRTY_LINE_BITS));
+			}
+		}
+	}
+}
+
+bool MemDevice::IsDirty() const
+{
+	for (auto pages : m_dirtyPages)
+	{
+		if (pages != 0)
+			return true;
+	}
+
+	return false;
+}
+
+bool MemDevice::IsAllDirty() const
+{
+	return m_allDirty;
+}
+
+void MemDevice::ClearDirty()
+{
+	for (std::size_t word = 0; word < m_dirtyPages.size(); word++)
 	{
-		std::srand(std::time(nullptr));
-		m_memory[from] = std::rand() % 255;
-		return m_memory[from];
+		for (auto pages = m_dirtyPages[word]; pages != 0; pages &= pages - 1)
+		{
+			auto page = m_pages[word * 64 + __builtin_ctzll(pages)].get();
+			if (page != nullptr)
+			{
+				page->dirty = 0;
+			}
+		}
+		m_dirtyPages[word] = 0;
 	}
+	m_allDirty = false;
+}
+
+bool MemDevice::Peek(int from, uint8_t &data) const
+{
+	if (!m_readable || !IsAddressInRange(from))
+		return false;
+
+	auto page = GetPageAt((from >> PAGE_BITS) - (m_addFrom >> PAGE_BITS));
+	auto offset = from & (PAGE_SIZE - 1);
+	if (page == nullptr || !page->IsInitialized(offset))
+		return false;
+
+	data = page->data[offset];
+	return true;
+}
+
+void MemDevice::SetFillSeed(uint32_t seed)
+{
+	m_fillSeed = seed;
+}
+
+uint8_t MemDevice::GetFillValue(uint32_t seed, int address)
+{
+	//murmur3 finalizer, so that the value does not depend on the access order
+	uint32_t hash = seed ^ (uint32_t)address;
+	hash ^= hash >> 16;
+	hash *= 0x85ebca6b;
+	hash ^= hash >> 13;
+	hash *= 0xc2b2ae35;
+	hash ^= hash >> 16;
+	return hash % 255;
 }
 
 bool MemDevice::IsReadOnly()
@@ -66,28 +345,55 @@ bool MemDevice::IsAddressInRange(int add) const
 	return add >= m_addFrom && add <= m_addTo;
 }
 
-std::string MemDevice::Dump(std::string title, bool caracters) const
+int MemDevice::GetFrom() const
+{
+	return m_addFrom;
+}
+
+int MemDevice::GetTo() const
 {
-	std::vector<std::pair<int, std::bitset<8>>> vect(m_memory.begin(), m_memory.end());
-	std::sort(vect.begin(), vect.end(),
-						[](std::pair<int, std::bitset<8>> a, std::pair<int, std::bitset<8>> b) {
-							return a.first > b.first;
-						});
+	return m_addTo;
+}
+
+void MemDevice::SetLatency(int latency)
+{
+	m_latency = latency;
+}
 
+int MemDevice::GetLatency() const
+{
+	return m_latency;
+}
+
+std::string MemDevice::Dump(std::string title, bool caracters) const
+{
 	std::stringstream stream;
 	stream << "Dump " << title << ": ";
-	for (const auto &loc : vect)
+
+	//highest address first
+	for (int p = m_pages.size() - 1; p >= 0; p--)
 	{
-		if (!caracters)
-		{
-			stream << "[" << loc.first << "] ";
-			stream << loc.second.to_ulong() << " ";
-		}
-		else
+		auto page = GetPageAt(p);
+		if (page == nullptr || page->IsEmpty())
+			continue;
+
+		int base = ((m_addFrom >> PAGE_BITS) + p) << PAGE_BITS;
+		for (int offset = PAGE_SIZE - 1; offset >= 0; offset--)
 		{
-			stream << loc.second.to_ulong();
+			if (!page->IsInitialized(offset))
+				continue;
+
+			if (!caracters)
+			{
+				stream << "[" << base + offset << "] ";
+				stream << (int)page->data[offset] << " ";
+			}
+			else
+			{
+				stream << (int)page->data[offset];
+			}
 		}
 	}
 	stream << "\n";
 	return stream.str();
-}
\ No newline at end of file
+}
@@ -1,28 +1,120 @@
 #pragma once
-#include "memdevice.h"
 #include <bitset>
+#include <cstdint>
+#include <memory>
+#include <string>
 #include <unordered_map>
 #include <vector>
 
 class MemDevice
 {
 public:
+	//memory is stored in pages allocated the first time they are touched
+	static const int PAGE_BITS = 12;
+	static const int PAGE_SIZE = 1 << PAGE_BITS;
+	static const uint32_t DEFAULT_FILL_SEED = 0x88;
+	//wait states of a read, the microprogram has one idle state after every read address (fetch1, ret1, ...)
+	static const int DEFAULT_LATENCY = 1;
+	static const int MAX_LATENCY = 255;
+	//the dirty tracking works on lines of DIRTY_LINE_SIZE bytes, one bit of Page::dirty each
+	static const int DIRTY_LINE_BITS = 6;
+	static const int DIRTY_LINE_SIZE = 1 << DIRTY_LINE_BITS;
+
 	MemDevice() = delete;
 	MemDevice(int from, int to, bool read, bool write, bool io, const std::vector<int> &mem = std::vector<int>());
 	MemDevice(int from, int to, bool read, bool write, bool io, const std::unordered_map<int, std::bitset<8>> &mem);
 	void Write(int to, const std::bitset<8> &data);
 	std::bitset<8> Read(int from);
+	//Read of size consecutive bytes, the same of one call per byte but with one page lookup per page
+	void ReadBlock(int from, uint8_t *data, std::size_t size);
+	//Read without side effects, false if the byte is not readable or was never initialized
+	bool Peek(int from, uint8_t &data) const;
 	bool IsReadOnly();
 	bool IsWriteOnly();
 	bool IsIO();
 	bool IsAddressInRange(int add) const;
+	int GetFrom() const;
+	int GetTo() const;
+	//the device reads image from address on instead of a copy of it, a page is copied out of the images
+	//the first time it is touched, so the pages that are never accessed are never allocated. The part of
+	//image out of the device is ignored, a later image wins where two of them overlap and the pages that
+	//were already touched do not change
+	void MapImage(int address, std::shared_ptr<const uint8_t> image, std::size_t size);
+	//from 0 to MAX_LATENCY, 0 completes a read in the cycle driving the address, see Processor::SkipWaitState
+	void SetLatency(int latency);
+	int GetLatency() const;
 	std::string Dump(std::string title, bool caracters = false) const;
 
+	//a line is dirty from the moment one of its bytes is written or initialized until ClearDirty, so that
+	//the user interface only redraws what changed. Address of the first byte of every dirty line, in
+	//increasing order. lines is cleared first and keeps its capacity
+	void GetDirtyLines(std::vector<int> &lines) const;
+	bool IsDirty() const;
+	//true after ClearPages until ClearDirty, nothing of the device can be assumed to be the same
+	bool IsAllDirty() const;
+	void ClearDirty();
+
+	//uninitialized bytes get a pseudo random value depending only on the seed and the address
+	void SetFillSeed(uint32_t seed);
+	static uint8_t GetFillValue(uint32_t seed, int address);
+
+	struct Page
+	{
+		uint8_t data[PAGE_SIZE];
+		//one bit per byte, set once the byte has been written or read
+		uint64_t initialized[PAGE_SIZE / 64];
+		//one bit per line of DIRTY_LINE_SIZE bytes, see GetDirtyLines
+		uint64_t dirty;
+
+		bool IsInitialized(int offset) const
+		{
+			return (initialized[offset >> 6] >> (offset & 63)) & 1;
+		}
+		void SetInitialized(int offset)
+		{
+			initialized[offset >> 6] |= (uint64_t)1 << (offset & 63);
+		}
+		bool IsEmpty() const;
+	};
+
+	static_assert(PAGE_SIZE / DIRTY_LINE_SIZE == 64, "Page::dirty has one bit per line");
+
+	//direct access to the pages for snapshots, index 0 is the page containing GetFrom()
+	std::size_t GetPageCount() const;
+	//nullptr if the page was never touched
+	const Page *GetPageAt(std::size_t index) const;
+	Page *AllocatePageAt(std::size_t index);
+	//also drops the images, see MapImage
+	void ClearPages();
+
 private:
 	int m_addFrom;
 	int m_addTo;
 	bool m_readable;
 	bool m_writeable;
 	bool m_IO;
-	std::unordered_map<int, std::bitset<8>> m_memory;
+	uint32_t m_fillSeed;
+	int m_latency;
+	//pages of the image are created by the const accessors too
+	mutable std::vector<std::unique_ptr<Page>> m_pages;
+	struct Image
+	{
+		int from;
+		int to;
+		std::shared_ptr<const uint8_t> data;
+	};
+	std::vector<Image> m_images;
+	//one bit per page with dirty lines
+	mutable std::vector<uint64_t> m_dirtyPages;
+	bool m_allDirty;
+
+	std::size_t GetPageIndex(int address) const;
+	Page *GetPage(int address);
+	void MarkDirty(std::size_t index, int offset, int size) const;
+	//nullptr if the page was never touched and is not in an image
+	Page *LoadPage(std::size_t index) const;
+	void Store(int address, uint8_t data);
+	void StoreBlock(int address, const uint8_t *data, std::size_t size);
+	//bytes from address to the end of its page, at most size
+	static std::size_t GetPageRun(int address, std::size_t size);
 };
@@ -1,93 +1,291 @@
 #include "microPC.h"
+#include "aotprocessor.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
 #include <fstream>
 #include <iostream>
-#include "processor.h"
-#include "bus.h"
-#include "memdevice.h"
+#include <memory>
+#include "batch.h"
+#include "console.h"
+#include "machine.h"
 #include "printer.h"
+#include "renderthread.h"
+#include "snapshot.h"
+#include "stateexport.h"
 
-#define RAM_ONE_START 0x00000
-#define RAM_ONE_END 0x9FFFF
+//bus transactions printed at the end of the run
+#define REPORT_TRACE_LINES 16
 
-#define VID_MEM_START 0xA0000
-#define VID_MEM_END 0xAFFFF
+//how many steps to run between two checks of the wall clock
+#define FRAME_CHECK_CYCLES 1024
 
-#define RAM_TWO_START 0xB000
-#define RAM_TWO_END 0xEFFFF
+//the render thread never draws more often than this, whatever --fps and --every ask for
+#define RENDER_FPS 60
 
-#define EPROM_START 0xF0000
-#define EPROM_END 0xFFFFF
+struct Frame
+{
+	std::chrono::steady_clock::time_point last;
+	uint64_t nextCycle;
+	uint64_t steps;
+};
 
-std::vector<int> LoadProgram(const std::string &filename)
+bool IsFrameDue(const microPC::Options &options, uint64_t cycle, Frame &frame)
 {
-	std::vector<int> eprom;
-	std::ifstream file;
-	file.open(filename);
-	if (file.is_open())
+	//without --fps and --every there is no point in capturing more frames than the render thread draws
+	auto fps = options.fps != 0 || options.redrawCycles != 0 ? options.fps : RENDER_FPS;
+	if (options.redrawCycles != 0 && cycle >= frame.nextCycle)
+	{
+		frame.last = std::chrono::steady_clock::now();
+		frame.nextCycle = cycle + options.redrawCycles;
+		return true;
+	}
+
+	if (fps != 0 && ++frame.steps % FRAME_CHECK_CYCLES == 0)
 	{
-		std::string codeline;
-		while (std::getline(file, codeline))
+		auto now = std::chrono::steady_clock::now();
+		if (now - frame.last >= std::chrono::seconds(1) / fps)
 		{
-			eprom.push_back(std::stoi(codeline, 0, 2));
+			frame.last = now;
+			return true;
 		}
 	}
 
-	return eprom;
+	return false;
 }
 
-std::unordered_map<int, std::bitset<8>> LoadInterrupts()
+void PrintReport(const CPU::Status &status, const Trace &trace, const MemDevice &vidMem, double seconds)
 {
-	std::unordered_map<int, std::bitset<8>> interrupts;
-	//TO DO make something scalable
-	//interrupt table at the top of the RAM
-	//interrupt type 0
-	interrupts[0] = 0x00;				//IP high part for the interrupt program
-	interrupts[1] = 0x00;				//IP low part for the interrupt program
-	interrupts[2] = 0x00;				//CS high part for the interrupt program
-	interrupts[3] = 0b00000001; //CS low part for the interrupt program
-
-	auto int0Program = LoadProgram("../../programs/type0interrupt.asm.bin");
-
-	auto address = (interrupts[1].to_ulong() << 4) + interrupts[0].to_ulong();
-	for (int i = 0; i < int0Program.size(); i++)
+	std::cout << "STAR = " << status.star << " MJR = " << status.mjr << "\n";
+	std::cout << "CS = " << status.cs << " IP = " << status.ip << " OPCODE = " << status.opcode
+						<< " SOURCE = " << status.source << " AL = " << status.al << "\n";
+	std::cout << "SS = " << status.ss << " SP = " << status.sp << " DS = " << status.ds
+						<< " DI = " << status.di << " d7_d0 = " << status.d7d0 << "\n";
+	std::cout << "CF = " << status.cf << " OF = " << status.of << " SF = " << status.sf
+						<< " ZF = " << status.zf << "\n";
+	std::cout << "MAR = " << status.mar << " MBR = " << status.mbr << "\n";
+	std::cout << vidMem.Dump("Video", true);
+	for (const auto &line : trace.Format(REPORT_TRACE_LINES))
 	{
-		interrupts[address + i] = int0Program[i];
+		std::cout << line << "\n";
 	}
+	std::cout << "cycles = " << status.cycles << " instructions = " << status.instructions
+						<< " seconds = " << seconds;
+	if (seconds > 0)
+	{
+		std::cout << " cycles/s = " << (uint64_t)(status.cycles / seconds);
+	}
+	std::cout << "\n";
+}
+
+Machine::Engine GetEngine(const microPC::Options &options)
+{
+	if (options.aot)
+		return Machine::Engine::Aot;
 
-	return interrupts;
+	if (options.jit)
+		return Machine::Engine::Jit;
+
+	return options.fast ? Machine::Engine::Fast : Machine::Engine::Processor;
 }
 
-void microPC::PowerOn(bool debugging)
+Machine::Timing GetTiming(const microPC::Options &options)
 {
-	Bus bus;
+	Machine::Timing timing;
+	timing.romLatency = options.romLatency;
+	timing.ramLatency = options.ramLatency;
+	timing.fastBus = options.fastBus;
+	return timing;
+}
 
-	MemDevice eprom(EPROM_START, EPROM_END, true, false, false, LoadProgram("../../programs/eprom.F7.bin"));
-	MemDevice ramOne(RAM_ONE_START, RAM_ONE_END, true, true, false);
-	MemDevice ramTwo(RAM_TWO_START, RAM_TWO_END, true, true, false);
-	MemDevice vidMem(VID_MEM_START, VID_MEM_END, false, true, true);
+bool microPC::PowerOn(const Options &options)
+{
+	auto engine = GetEngine(options);
+	auto program = RomImage::Load(options.rom);
+	if (program == nullptr)
+	{
+		std::cerr << "Cannot read the ROM " << options.rom << "\n";
+		return false;
+	}
 
-	bus.RegisterDevice(eprom);
-	bus.RegisterDevice(ramOne);
-	bus.RegisterDevice(vidMem);
-	bus.RegisterDevice(ramTwo);
+	Machine machine(program, engine, options.seed, GetTiming(options));
+	if (!machine.IsValid())
+		return false;
 
-	auto processor = Processor(bus);
+	if ((engine != Machine::Engine::Processor || options.fastBus) && !options.traceFile.empty())
+	{
+		std::cerr << "The trace file records every clock cycle, it cannot be written with --fast, --jit, --aot or --fast-bus\n";
+		return false;
+	}
 
-	auto printer = Printer(processor, ramOne, ramTwo, vidMem, eprom);
-	processor.OnReset();
-	bool end = false;
-	while (!end)
+	if (engine != Machine::Engine::Processor && (!options.profile.empty() || !options.histograms.empty()))
+	{
+		std::cerr << "--profile and --histograms count the clock cycles of Processor, they cannot run with --fast, --jit or --aot\n";
+		return false;
+	}
+
+	if (engine == Machine::Engine::Aot && !static_cast<AotProcessor &>(machine.GetCPU()).HasProgram())
+	{
+		std::cerr << "This ROM was not recompiled into ME88 with ME88_AOT_ROM, running it like --fast\n";
+	}
+
+	std::unique_ptr<TraceWriter> traceWriter;
+	if (!options.traceFile.empty())
+	{
+		traceWriter = std::make_unique<TraceWriter>(options.traceFile);
+		if (!traceWriter->IsOpen())
+		{
+			std::cerr << "Cannot open " << options.traceFile << "\n";
+			return false;
+		}
+		machine.SetTraceWriter(traceWriter.get());
+	}
+
+	std::unique_ptr<Profiler> profiler;
+	if (!options.profile.empty())
+	{
+		profiler = std::make_unique<Profiler>();
+		machine.SetProfiler(profiler.get());
+	}
+
+	std::unique_ptr<Histograms> histograms;
+	if (!options.histograms.empty())
+	{
+		histograms = std::make_unique<Histograms>();
+		machine.SetHistograms(histograms.get());
+	}
+
+	auto &processor = machine.GetCPU();
+	processor.SetTracing(options.trace);
+	processor.SetCycleLimit(options.maxCycles);
+
+	std::unique_ptr<FrameCapture> capture;
+	std::unique_ptr<RenderThread> renderer;
+	//the console of -d prints on the terminal instead of the screen
+	if (!options.headless && !options.debugging)
+	{
+		capture = std::make_unique<FrameCapture>(processor, machine.GetRamOne(), machine.GetRamTwo(), machine.GetVideoMemory(), machine.GetEprom());
+		renderer = std::make_unique<RenderThread>(options.fps != 0 ? std::min(options.fps, RENDER_FPS) : RENDER_FPS);
+	}
+
+	auto seed = options.seed;
+	if (!options.loadState.empty())
+	{
+		if (!Snapshot::Load(options.loadState, processor, machine.GetDevices(), seed))
+			return false;
+
+		machine.SetFillSeed(seed);
+	}
+
+	std::unique_ptr<StateExport> stateExport;
+	if (!options.share.empty())
 	{
-		printer.Print();
-		if (debugging)
+		stateExport = std::make_unique<StateExport>(options.share, processor, machine.GetVideoMemory());
+		if (!stateExport->IsOpen())
 		{
-			auto c = getchar();
-			if (c == 'q')
+			std::cerr << "Cannot create the shared memory object " << options.share << ": " << std::strerror(stateExport->GetError()) << "\n";
+			if (stateExport->GetError() == EEXIST)
 			{
-				end = true;
+				std::cerr << "Another ME88 may be sharing it, or a previous run left it in /dev/shm\n";
 			}
+			return false;
 		}
+	}
+
+	//the run goes on when an output cannot be written, only the exit status tells
+	bool written = true;
+	auto start = std::chrono::steady_clock::now();
+	Frame frame = {start, 0, 0};
+	if (options.debugging)
+	{
+		Console console(machine, options.maxCycles, stateExport.get());
+		console.Run();
+	}
+
+	bool end = options.debugging;
+	while (!end)
+	{
+		if (renderer && IsFrameDue(options, processor.GetCycles(), frame))
+		{
+			renderer->Publish(capture->Capture());
+		}
+
+		processor.Step();
+		if (stateExport)
+		{
+			stateExport->Publish();
+		}
+
+		if (processor.IsHalted() || (options.maxCycles != 0 && processor.GetCycles() >= options.maxCycles))
+		{
+			end = true;
+		}
+	}
+
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+	if (stateExport)
+	{
+		stateExport->PublishAll();
+	}
+
+	if (profiler)
+	{
+		profiler->OnStop(processor.GetCycles(), processor.GetState().opcode);
+		if (!profiler->Write(options.profile, program->GetSymbols(), program->GetLines()))
+		{
+			std::cerr << "Cannot write the profile " << options.profile << "\n";
+			written = false;
+		}
+	}
+
+	if (histograms)
+	{
+		histograms->OnStop(processor.GetCycles(), processor.GetState().opcode);
+		if (!histograms->Write(options.histograms))
+		{
+			std::cerr << "Cannot write the histograms " << options.histograms << "\n";
+			written = false;
+		}
+	}
+
+	if (renderer)
+	{
+		//show the final state until a key is pressed
+		renderer->Publish(capture->Capture());
+		renderer->WaitDrawn();
+		getchar();
+		renderer.reset();
+	}
 
-		processor.OnClock();
+	if (!options.saveState.empty())
+	{
+		written = Snapshot::Save(options.saveState, processor, machine.GetDevices(), seed) && written;
 	}
-}
\ No newline at end of file
+
+	PrintReport(processor.GetStatus(), processor.GetTrace(), machine.GetVideoMemory(), elapsed.count());
+	return written;
+}
+
+bool microPC::RunBatch(const Options &options)
+{
+	std::vector<Batch::Job> jobs;
+	if (!Batch::LoadJobs(options.batch, jobs))
+		return false;
+
+	auto timing = GetTiming(options);
+	if (!timing.HasDefaultLatency() && (options.lanes > 1 || options.jit || options.aot))
+	{
+		std::cerr << "--lanes, --jit and --aot only count the cycles of the default memory latency\n";
+		return false;
+	}
+
+	WorkStealingPool pool(options.threads);
+	auto start = std::chrono::steady_clock::now();
+	auto results = Batch::Run(jobs, GetEngine(options), timing, options.lanes, pool);
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+	Batch::PrintReport(jobs, results, pool.GetThreadCount(), elapsed.count());
+	return true;
+}
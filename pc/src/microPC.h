@@ -1,6 +1,60 @@
 #pragma once
+#include <cstdint>
+#include <string>
 
 namespace microPC
 {
-	void PowerOn(bool debugging = false);
+	struct Options
+	{
+		//executable, binary or text ROM, see RomImage
+		std::string rom = "../../programs/eprom.F7.bin";
+		//start stopped in the Console instead of running
+		bool debugging = false;
+		//never start ncurses, only report the final state
+		bool headless = false;
+		//run whole instructions with FastProcessor instead of microstates with Processor
+		bool fast = false;
+		//run the ROM as x86-64 code translated by JitProcessor, anything else like FastProcessor
+		bool jit = false;
+		//run the ROM as the C++ ME88Recompile generated for it, when it was built in with ME88_AOT_ROM
+		bool aot = false;
+		//redraw at most fps times per second, 0 means no wall clock limit with redrawCycles and
+		//RENDER_FPS without
+		int fps = 0;
+		//redraw every redrawCycles cycles, 0 means no cycle limit
+		uint64_t redrawCycles = 0;
+		//stop after maxCycles cycles, 0 means run until the processor halts
+		uint64_t maxCycles = 0;
+		uint32_t seed = 0x88;
+		//keep the last bus transactions in the trace buffer
+		bool trace = false;
+		//write every clock cycle to this file, only with Processor
+		std::string traceFile;
+		//write the cycles of every instruction to this file and the call stacks to profile.folded, only with Processor
+		std::string profile;
+		//write the entries and cycles of every microstate and the CPI of every format and opcode to this file, only with Processor
+		std::string histograms;
+		//restore the machine from a snapshot after the reset
+		std::string loadState;
+		//save a snapshot of the machine when the run stops
+		std::string saveState;
+		//run the jobs of this file instead of the interactive machine
+		std::string batch;
+		//workers of the batch mode, 0 means one per hardware thread
+		int threads = 0;
+		//machines run in lockstep by every batch worker, more than 1 uses LaneProcessor
+		int lanes = 1;
+		//wait states of every read from the EPROM and from the RAMs, 1 is the timing of the microprogram
+		int romLatency = 1;
+		int ramLatency = 1;
+		//Processor runs the wait states of a read at once, the cycle counts do not change
+		bool fastBus = false;
+		//export the registers and the video memory to this POSIX shared memory object, see StateExport
+		std::string share;
+	};
+
+	//false if the machine cannot start or an output cannot be written
+	bool PowerOn(const Options &options);
+	//false if the job list cannot be read
+	bool RunBatch(const Options &options);
 }
@@ -0,0 +1,458 @@
+#pragma once
+#include "instruction.h"
+#include "../../common/star.h"
+#include <array>
+#include <cstdint>
+
+//The microprogram of the ME88 sequencer as data, one row per Star: the bus control lines the state
+//drives, the register transfers it makes and how it picks the next state. Processor::OnClock runs it.
+
+namespace Microcode
+{
+	//bus control lines, they are active low: X_LOW starts a transaction and X_HIGH ends it
+	constexpr uint8_t MR_LOW = 1 << 0;
+	constexpr uint8_t MR_HIGH = 1 << 1;
+	constexpr uint8_t MW_LOW = 1 << 2;
+	constexpr uint8_t MW_HIGH = 1 << 3;
+	constexpr uint8_t IOR_LOW = 1 << 4;
+	constexpr uint8_t IOR_HIGH = 1 << 5;
+	constexpr uint8_t IOW_LOW = 1 << 6;
+	constexpr uint8_t IOW_HIGH = 1 << 7;
+	//idle state waiting for the device at MAR to answer a read, it lasts MemDevice::GetLatency cycles
+	constexpr uint16_t WAIT = 1 << 8;
+
+	//register transfers, executed in the order of the row
+	enum class Transfer : uint8_t
+	{
+		None,
+		CountInstruction, //instructions++
+		MarCsIp,					//MAR = CS:IP, IP++
+		MarDsDi,					//MAR = DS:DI
+		MarOperand,				//F4: MAR = 0:offset for in, DS:offset otherwise, MR_ = in
+		MarDest,					//MAR = DEST_SEL:DEST_OFF
+		MarPush,					//MAR = SS:(SP - 1)
+		MarPop,						//MAR = SS:SP, SP++
+		MarSsSp,					//MAR = SS:SP
+		MarVector,				//MAR = SOURCE * 4
+		MarNext,					//MAR++
+		OpcodeD7,					//OPCODE = D7D0
+		MjrFetch,					//MJR = fetch state of OPCODE
+		SourceD7,					//SOURCE = D7D0
+		SourceNvi,				//SOURCE = 6 for an invalid instruction in user mode, 5 otherwise
+		SourceNvma,				//SOURCE = 4
+		MbrD7,						//MBR = D7D0
+		MbrAl,						//MBR = AL
+		MbrIpHigh,				//MBR = IP >> 8
+		MbrIpLow,					//MBR = IP & 0xFF
+		MbrCsHigh,				//MBR = CS >> 8
+		MbrCsLow,					//MBR = CS & 0xFF
+		MbrF,							//MBR = F
+		DestDsDi,					//DEST = DS:DI
+		DestPort,					//DEST = 0:offset for out, DS:offset otherwise
+		DestCsOffset,			//DEST = CS:offset
+		DestOffset,				//DEST_OFF = D7D0:MBR
+		AlD7,							//AL = D7D0
+		AlAh,							//AL = AH
+		AhAl,							//AH = AL
+		AlSource,					//AL = SOURCE
+		AxDs,							//AX = DS
+		AxSs,							//AX = SS
+		AxSp,							//AX = SP
+		AxDi,							//AX = DI
+		DsAx,							//DS = AX
+		SsAx,							//SS = AX
+		SpAx,							//SP = AX
+		DiAx,							//DI = AX
+		IpDest,						//IP = DEST_OFF
+		IpD7Mbr,					//IP = D7D0:MBR
+		CsDest,						//CS = DEST_SEL
+		CsD7Mbr,					//CS = D7D0:MBR
+		Jump,							//CS = DEST_SEL, IP = DEST_OFF if the condition of OPCODE matches
+		SpDec,						//SP--
+		Alu,							//AL = AL op SOURCE, F updated
+		FD7,							//F = D7D0
+		ClearF,						//F = 0
+		ClearIF,					//IF = 0
+		SetIF,						//IF = 1
+		SetUS,						//US = 1
+		SavePsr,					//PREV_SS:PREV_SP = SS:SP
+		SwapStack,				//SS:SP <-> PREV_SS:PREV_SP
+		SwapStackUser,		//SwapStack in user mode
+		DirOut,						//DIR = 1
+		DirIn,						//DIR = 0
+		IntaHigh,					//INTA = 1
+		IntaLow						//INTA = 0
+	};
+
+	enum class Next : uint8_t
+	{
+		Goto,			 //target
+		Mjr,			 //MJR
+		Execute,	 //MJR, then MJR = execution state of OPCODE
+		End,			 //pre_tipo0 if IF is set, fetch0 otherwise
+		IfValid,	 //target if OPCODE is valid in the current mode, alternative otherwise
+		IfAccess,	 //target and MW_ low if MAR can be written in the current mode, nvma0 otherwise
+		IfOpcode,	 //target if OPCODE is opcode, alternative otherwise
+		IfInterrupt //target if INTR is set, alternative otherwise
+	};
+
+	struct MicroInstruction
+	{
+		const char *name; //the Star, for debugging
+		uint16_t bus;
+		Transfer transfers[4];
+		Next next;
+		Star target;
+		Star alternative;
+		uint8_t opcode;
+	};
+
+	using T = Transfer;
+
+	constexpr MicroInstruction Get(Star state)
+	{
+		switch (state)
+		{
+		//////////////////////////////// fetch phase
+		case Star::fetch0:
+			return {"fetch0", MR_LOW, {T::CountInstruction, T::MarCsIp}, Next::Goto, Star::fetch1};
+		case Star::fetch1:
+			return {"fetch1", WAIT, {}, Next::Goto, Star::fetch2};
+		case Star::fetch2:
+			return {"fetch2", MR_HIGH, {T::OpcodeD7, T::MjrFetch}, Next::IfValid, Star::fetch3, Star::nvi0};
+		case Star::fetch3:
+			return {"fetch3", 0, {}, Next::Execute};
+		case Star::fetchF0_0:
+			return {"fetchF0_0", 0, {}, Next::Mjr};
+		case Star::fetchF1_0:
+			return {"fetchF1_0", MR_LOW, {T::MarDsDi}, Next::Goto, Star::fetchF1_1};
+		case Star::fetchF1_1:
+			return {"fetchF1_1", WAIT, {}, Next::Goto, Star::fetchF1_2};
+		case Star::fetchF1_2:
+			return {"fetchF1_2", MR_HIGH, {T::SourceD7}, Next::Mjr};
+		case Star::fetchF2_0:
+			return {"fetchF2_0", 0, {T::DestDsDi}, Next::Mjr};
+		case Star::fetchF3_0:
+			return {"fetchF3_0", MR_LOW, {T::MarCsIp}, Next::Goto, Star::fetchF3_1};
+		case Star::fetchF3_1:
+			return {"fetchF3_1", WAIT, {}, Next::Goto, Star::fetchF3_2};
+		case Star::fetchF3_2:
+			return {"fetchF3_2", MR_HIGH, {T::SourceD7}, Next::Mjr};
+		case Star::fetchF4_0:
+			return {"fetchF4_0", MR_LOW, {T::MarCsIp}, Next::Goto, Star::fetchF4_1};
+		case Star::fetchF4_1:
+			return {"fetchF4_1", WAIT, {}, Next::Goto, Star::fetchF4_2};
+		case Star::fetchF4_2:
+			return {"fetchF4_2", 0, {T::MbrD7, T::MarCsIp}, Next::Goto, Star::fetchF4_3};
+		case Star::fetchF4_3:
+			return {"fetchF4_3", WAIT, {}, Next::Goto, Star::fetchF4_4};
+		case Star::fetchF4_4:
+			return {"fetchF4_4", 0, {T::MarOperand}, Next::IfOpcode, Star::fetchF4_5, Star::fetchF4_6, Instructions::IN_OPCODE};
+		case Star::fetchF4_5:
+			return {"fetchF4_5", IOR_LOW, {}, Next::Goto, Star::fetchF4_6};
+		case Star::fetchF4_6:
+			return {"fetchF4_6", WAIT, {}, Next::Goto, Star::fetchF4_7};
+		case Star::fetchF4_7:
+			return {"fetchF4_7", MR_HIGH | IOR_HIGH, {T::SourceD7}, Next::Mjr};
+		case Star::fetchF5_0:
+			return {"fetchF5_0", MR_LOW, {T::MarCsIp}, Next::Goto, Star::fetchF5_1};
+		case Star::fetchF5_1:
+			return {"fetchF5_1", WAIT, {}, Next::Goto, Star::fetchF5_2};
+		case Star::fetchF5_2:
+			return {"fetchF5_2", 0, {T::MbrD7, T::MarCsIp}, Next::Goto, Star::fetchF5_3};
+		case Star::fetchF5_3:
+			return {"fetchF5_3", WAIT, {}, Next::Goto, Star::fetchF5_4};
+		case Star::fetchF5_4:
+			return {"fetchF5_4", MR_HIGH, {T::DestPort}, Next::Mjr};
+		case Star::fetchF6_0:
+			return {"fetchF6_0", MR_LOW, {T::MarCsIp}, Next::Goto, Star::fetchF6_1};
+		case Star::fetchF6_1:
+			return {"fetchF6_1", WAIT, {}, Next::Goto, Star::fetchF6_2};
+		case Star::fetchF6_2:
+			return {"fetchF6_2", 0, {T::MbrD7, T::MarCsIp}, Next::Goto, Star::fetchF6_3};
+		case Star::fetchF6_3:
+			return {"fetchF6_3", WAIT, {}, Next::Goto, Star::fetchF6_4};
+		case Star::fetchF6_4:
+			return {"fetchF6_4", MR_HIGH, {T::DestCsOffset}, Next::Mjr};
+		case Star::fetchF7_0:
+			return {"fetchF7_0", MR_LOW, {T::MarCsIp}, Next::Goto, Star::fetchF7_1};
+		case Star::fetchF7_1:
+			return {"fetchF7_1", WAIT, {}, Next::Goto, Star::fetchF7_2};
+		case Star::fetchF7_2:
+			return {"fetchF7_2", 0, {T::MbrD7, T::MarCsIp}, Next::Goto, Star::fetchF7_3};
+		case Star::fetchF7_3:
+			return {"fetchF7_3", WAIT, {}, Next::Goto, Star::fetchF7_4};
+		case Star::fetchF7_4:
+			return {"fetchF7_4", 0, {T::DestOffset, T::MarCsIp}, Next::Goto, Star::fetchF7_5};
+		case Star::fetchF7_5:
+			return {"fetchF7_5", WAIT, {}, Next::Goto, Star::fetchF7_6};
+		case Star::fetchF7_6:
+			return {"fetchF7_6", 0, {T::MbrD7, T::MarCsIp}, Next::Goto, Star::fetchF7_7};
+		case Star::fetchF7_7:
+			return {"fetchF7_7", WAIT, {}, Next::Goto, Star::fetchF7_8};
+		case Star::fetchF7_8:
+			return {"fetchF7_8", MR_HIGH, {T::DestOffset}, Next::Mjr};
+		case Star::nvi0:
+			return {"nvi0", 0, {T::SourceNvi}, Next::Goto, Star::nvi0};
+		//////////////////////////////// execution phase
+		case Star::nop0:
+			return {"nop0", 0, {}, Next::End};
+		case Star::hlt0:
+			return {"hlt0", 0, {}, Next::Goto, Star::hlt0};
+		case Star::ldah0:
+			return {"ldah0", 0, {T::AhAl}, Next::End};
+		case Star::ldal0:
+			return {"ldal0", 0, {T::AlAh}, Next::End};
+		case Star::ldds0:
+			return {"ldds0", 0, {T::DsAx}, Next::End};
+		case Star::ldss0:
+			return {"ldss0", 0, {T::SsAx}, Next::End};
+		case Star::ldsp0:
+			return {"ldsp0", 0, {T::SpAx}, Next::End};
+		case Star::lddi0:
+			return {"lddi0", 0, {T::DiAx}, Next::End};
+		case Star::ldax0:
+			return {"ldax0", 0, {T::AxDs}, Next::End};
+		case Star::ldax1:
+			return {"ldax1", 0, {T::AxSs}, Next::End};
+		case Star::ldax2:
+			return {"ldax2", 0, {T::AxSp}, Next::End};
+		case Star::ldax3:
+			return {"ldax3", 0, {T::AxDi}, Next::End};
+		case Star::ld0:
+			return {"ld0", 0, {T::MarDest, T::MbrAl, T::DirOut}, Next::Goto, Star::ld1};
+		case Star::ld1:
+			return {"ld1", 0, {}, Next::IfAccess, Star::ld2};
+		case Star::ld2:
+			return {"ld2", MW_HIGH, {}, Next::End};
+		case Star::out0:
+			return {"out0", 0, {T::MarDest, T::MbrAl, T::DirOut}, Next::Goto, Star::out1};
+		case Star::out1:
+			return {"out1", IOW_LOW, {}, Next::Goto, Star::out2};
+		case Star::out2:
+			return {"out2", IOW_HIGH, {}, Next::End};
+		case Star::arit_log0:
+			return {"arit_log0", 0, {T::Alu}, Next::End};
+		case Star::ldal1:
+			return {"ldal1", 0, {T::AlSource}, Next::End};
+		case Star::jmp0:
+			return {"jmp0", 0, {T::Jump}, Next::End};
+		case Star::push0:
+			return {"push0", 0, {T::MarPush, T::MbrAl, T::DirOut}, Next::Goto, Star::push1};
+		case Star::push1:
+			return {"push1", 0, {}, Next::IfAccess, Star::push2};
+		case Star::push2:
+			return {"push2", MW_HIGH, {T::SpDec}, Next::End};
+		case Star::pop0:
+			return {"pop0", MR_LOW, {T::MarPop}, Next::Goto, Star::pop1};
+		case Star::pop1:
+			return {"pop1", WAIT, {}, Next::Goto, Star::pop2};
+		case Star::pop2:
+			return {"pop2", MR_HIGH, {T::AlD7}, Next::End};
+		case Star::call0:
+			return {"call0", 0, {T::MarPush, T::MbrIpHigh, T::DirOut}, Next::Goto, Star::call1};
+		case Star::call1:
+			return {"call1", 0, {}, Next::IfAccess, Star::call2};
+		case Star::call2:
+			return {"call2", MW_HIGH, {T::SpDec}, Next::Goto, Star::call3};
+		case Star::call3:
+			return {"call3", 0, {T::MarPush, T::MbrIpLow}, Next::Goto, Star::call4};
+		case Star::call4:
+			return {"call4", 0, {}, Next::IfAccess, Star::call5};
+		case Star::call5:
+			return {"call5", MW_HIGH, {T::SpDec, T::IpDest}, Next::IfOpcode, Star::call6, Star::call12, Instructions::CALLF_OPCODE};
+		case Star::call6:
+			return {"call6", 0, {T::MarPush, T::MbrCsHigh}, Next::Goto, Star::call7};
+		case Star::call7:
+			return {"call7", 0, {}, Next::IfAccess, Star::call8};
+		case Star::call8:
+			return {"call8", MW_HIGH, {T::SpDec}, Next::Goto, Star::call9};
+		case Star::call9:
+			return {"call9", 0, {T::MarPush, T::MbrCsLow}, Next::Goto, Star::call10};
+		case Star::call10:
+			return {"call10", 0, {}, Next::IfAccess, Star::call11};
+		case Star::call11:
+			return {"call11", MW_HIGH, {T::SpDec, T::CsDest}, Next::Goto, Star::call12};
+		case Star::call12:
+			return {"call12", 0, {}, Next::End};
+		case Star::ret0:
+			return {"ret0", MR_LOW, {T::MarPop}, Next::Goto, Star::ret1};
+		case Star::ret1:
+			return {"ret1", WAIT, {}, Next::Goto, Star::ret2};
+		case Star::ret2:
+			return {"ret2", 0, {T::MbrD7, T::MarPop}, Next::Goto, Star::ret3};
+		case Star::ret3:
+			return {"ret3", WAIT, {}, Next::IfOpcode, Star::ret4, Star::ret8, Instructions::RETF_OPCODE};
+		case Star::ret4:
+			return {"ret4", 0, {T::CsD7Mbr, T::MarPop}, Next::Goto, Star::ret5};
+		case Star::ret5:
+			return {"ret5", WAIT, {}, Next::Goto, Star::ret6};
+		case Star::ret6:
+			return {"ret6", 0, {T::MbrD7, T::MarPop}, Next::Goto, Star::ret7};
+		case Star::ret7:
+			return {"ret7", WAIT, {}, Next::Goto, Star::ret8};
+		case Star::ret8:
+			return {"ret8", MR_HIGH, {T::IpD7Mbr}, Next::End};
+		case Star::int0:
+			return {"int0", 0, {T::SwapStackUser}, Next::Goto, Star::int1};
+		case Star::int1:
+			return {"int1", 0, {T::SpDec, T::MarSsSp, T::DirOut, T::MbrF}, Next::Goto, Star::int2};
+		case Star::int2:
+			return {"int2", MW_LOW, {}, Next::Goto, Star::int3};
+		case Star::int3:
+			//never moves on to int4, see GetOpcodeInfo
+			return {"int3", MW_HIGH, {T::ClearF}, Next::Goto, Star::int3};
+		case Star::int4:
+			return {"int4", 0, {T::SpDec, T::MarSsSp, T::MbrIpHigh}, Next::Goto, Star::int5};
+		case Star::int5:
+			return {"int5", MW_LOW, {}, Next::Goto, Star::int6};
+		case Star::int6:
+			return {"int6", MW_HIGH, {}, Next::Goto, Star::int7};
+		case Star::int7:
+			return {"int7", 0, {T::SpDec, T::MarSsSp, T::MbrIpLow}, Next::Goto, Star::int8};
+		case Star::int8:
+			return {"int8", MW_LOW, {}, Next::Goto, Star::int9};
+		case Star::int9:
+			return {"int9", MW_HIGH, {}, Next::Goto, Star::int10};
+		case Star::int10:
+			return {"int10", 0, {T::SpDec, T::MarSsSp, T::MbrCsHigh}, Next::Goto, Star::int11};
+		case Star::int11:
+			return {"int11", MW_LOW, {}, Next::Goto, Star::int12};
+		case Star::int12:
+			return {"int12", MW_HIGH, {}, Next::Goto, Star::int13};
+		case Star::int13:
+			return {"int13", 0, {T::SpDec, T::MarSsSp, T::MbrCsLow}, Next::Goto, Star::int14};
+		case Star::int14:
+			return {"int14", MW_LOW, {}, Next::Goto, Star::int15};
+		case Star::int15:
+			return {"int15", MW_HIGH, {}, Next::Goto, Star::int16};
+		case Star::int16:
+			return {"int16", MR_LOW, {T::DirIn, T::MarVector}, Next::Goto, Star::int17};
+		case Star::int17:
+			return {"int17", WAIT, {}, Next::Goto, Star::int18};
+		case Star::int18:
+			return {"int18", 0, {T::MbrD7, T::MarNext}, Next::Goto, Star::int19};
+		case Star::int19:
+			return {"int19", WAIT, {}, Next::Goto, Star::int20};
+		case Star::int20:
+			return {"int20", 0, {T::IpD7Mbr, T::MarNext}, Next::Goto, Star::int21};
+		case Star::int21:
+			return {"int21", WAIT, {}, Next::Goto, Star::int22};
+		case Star::int22:
+			return {"int22", 0, {T::MbrD7, T::MarNext}, Next::Goto, Star::int23};
+		case Star::int23:
+			return {"int23", WAIT, {}, Next::Goto, Star::int24};
+		case Star::int24:
+			return {"int24", MR_HIGH, {T::CsD7Mbr}, Next::Goto, Star::fetch0};
+		case Star::iret0:
+			return {"iret0", MR_LOW, {T::MarPop}, Next::Goto, Star::iret1};
+		case Star::iret1:
+			return {"iret1", WAIT, {}, Next::Goto, Star::iret2};
+		case Star::iret2:
+			return {"iret2", 0, {T::MbrD7, T::MarPop}, Next::Goto, Star::iret3};
+		case Star::iret3:
+			return {"iret3", WAIT, {}, Next::Goto, Star::iret4};
+		case Star::iret4:
+			return {"iret4", 0, {T::CsD7Mbr, T::MarPop}, Next::Goto, Star::iret5};
+		case Star::iret5:
+			return {"iret5", WAIT, {}, Next::Goto, Star::iret6};
+		case Star::iret6:
+			return {"iret6", 0, {T::MbrD7, T::MarPop}, Next::Goto, Star::iret7};
+		case Star::iret7:
+			return {"iret7", WAIT, {}, Next::Goto, Star::iret8};
+		case Star::iret8:
+			return {"iret8", 0, {T::IpD7Mbr, T::MarPop}, Next::Goto, Star::iret9};
+		case Star::iret9:
+			return {"iret9", WAIT, {}, Next::Goto, Star::iret10};
+		case Star::iret10:
+			return {"iret10", MR_HIGH, {T::FD7}, Next::Goto, Star::iret11};
+		case Star::iret11:
+			return {"iret11", 0, {T::SwapStackUser}, Next::Goto, Star::fetch0};
+		case Star::cli0:
+			return {"cli0", 0, {T::ClearIF}, Next::Goto, Star::fetch0};
+		case Star::sti0:
+			return {"sti0", 0, {T::SetIF}, Next::IfInterrupt, Star::pre_tipo0, Star::fetch0};
+		case Star::ldpsr0:
+			return {"ldpsr0", 0, {T::SavePsr}, Next::End};
+		case Star::stum0:
+			return {"stum0", 0, {T::SetUS, T::SwapStack}, Next::End};
+		case Star::nvma0:
+			return {"nvma0", 0, {T::SourceNvma}, Next::Goto, Star::int0};
+		case Star::pre_tipo0:
+			return {"pre_tipo0", 0, {T::DirIn, T::IntaHigh}, Next::IfInterrupt, Star::pre_tipo0, Star::pre_tipo1};
+		case Star::pre_tipo1:
+			return {"pre_tipo1", 0, {T::SourceD7, T::IntaLow}, Next::Goto, Star::int0};
+		}
+
+		return {"?", 0, {}, Next::Goto, Star::hlt0};
+	}
+
+	constexpr int STATES = (int)Star::pre_tipo1 + 1;
+
+	constexpr std::array<MicroInstruction, STATES> BuildAll()
+	{
+		std::array<MicroInstruction, STATES> table = {};
+		for (int state = 0; state < STATES; state++)
+		{
+			table[state] = Get((Star)state);
+		}
+		return table;
+	}
+} // namespace Microcode
+
+constexpr std::array<Microcode::MicroInstruction, Microcode::STATES> MICROCODE = Microcode::BuildAll();
+
+//the row running in state, a halting row for the values out of Star
+constexpr const Microcode::MicroInstruction &GetMicroInstruction(Star state)
+{
+	return (unsigned)state < MICROCODE.size() ? MICROCODE[(int)state] : MICROCODE[(int)Star::hlt0];
+}
+
+namespace Microcode
+{
+	constexpr bool IsWait(Star state)
+	{
+		return (GetMicroInstruction(state).bus & WAIT) != 0;
+	}
+
+	//true if the row can move on to a wait state, Processor skips it right away when it takes no cycles
+	constexpr bool MayEnterWait(Star state)
+	{
+		auto &micro = GetMicroInstruction(state);
+		switch (micro.next)
+		{
+		case Next::Goto:
+			return IsWait(micro.target);
+		case Next::IfValid:
+		case Next::IfOpcode:
+		case Next::IfInterrupt:
+			return IsWait(micro.target) || IsWait(micro.alternative);
+		default:
+			return false;
+		}
+	}
+
+	//a wait state only picks the next state, and MJR never points to one
+	constexpr bool AreWaitsIdle()
+	{
+		for (const auto &micro : MICROCODE)
+		{
+			bool idle = micro.bus == WAIT && micro.transfers[0] == Transfer::None && (micro.next == Next::Goto || micro.next == Next::IfOpcode);
+			if ((micro.bus & WAIT) != 0 && !idle)
+				return false;
+		}
+		for (const auto &info : OPCODE_INFO)
+		{
+			if (IsWait(info.fetchState) || IsWait(info.executionState))
+				return false;
+		}
+		return true;
+	}
+
+	static_assert(AreWaitsIdle(), "Processor::SkipWaitState only picks the next state of a wait state");
+} // namespace Microcode
+
+constexpr const char *GetStarName(Star state)
+{
+	return (unsigned)state < MICROCODE.size() ? MICROCODE[(int)state].name : "?";
+}
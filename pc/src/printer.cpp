@@ -1,12 +1,194 @@
 #include "printer.h"
+#include "registers.h"
+#include <algorithm>
+#include <bitset>
+#include <cstring>
+#include <string>
 
-Printer::Printer(const Processor &proc, const MemDevice &ramOne, const MemDevice &ramTwo,
-								 const MemDevice &videoMem, const MemDevice &eprom)
-		: m_proc(proc), m_ramOne(ramOne), m_ramTwo(ramTwo),
-			m_eprom(eprom), m_videoMem(videoMem)
+//lines of the registers, the trace follows them
+#define STATUS_LINES 10
+
+#define VIDEO_TOP (STATUS_LINES + PRINTER_TRACE_LINES)
+#define PANE_TOP (VIDEO_TOP + PRINTER_VIDEO_ROWS + 1)
+
+namespace
+{
+	const char *PANE_TITLES[PRINTER_PANES] = {"Eprom", "RAMOn", "RAMTW"};
+
+	int GetPaneTop(int pane)
+	{
+		return PANE_TOP + pane * (PRINTER_PANE_ROWS + 1);
+	}
+
+	//also the bytes of the devices the processor cannot read, like the video memory
+	bool GetByte(const MemDevice &device, int address, uint8_t &data)
+	{
+		auto page = device.GetPageAt((address >> MemDevice::PAGE_BITS) - (device.GetFrom() >> MemDevice::PAGE_BITS));
+		auto offset = address & (MemDevice::PAGE_SIZE - 1);
+		if (page == nullptr || !page->IsInitialized(offset))
+			return false;
+
+		data = page->data[offset];
+		return true;
+	}
+} // namespace
+
+FrameCapture::FrameCapture(const CPU &proc, MemDevice &ramOne, MemDevice &ramTwo,
+													 MemDevice &videoMem, MemDevice &eprom)
+		: m_proc(proc), m_videoMem(videoMem), m_panes{&eprom, &ramOne, &ramTwo}, m_frame{}
+{
+}
+
+const ScreenFrame &FrameCapture::Capture()
+{
+	m_frame.state = m_proc.GetState();
+
+	const auto &trace = m_proc.GetTrace();
+	m_frame.traceCount = std::min(trace.Size(), (std::size_t)PRINTER_TRACE_LINES);
+	for (std::size_t i = 0; i < m_frame.traceCount; i++)
+	{
+		m_frame.trace[i] = trace.Get(trace.Size() - m_frame.traceCount + i);
+	}
+
+	CaptureVideo();
+	for (int pane = 0; pane < PRINTER_PANES; pane++)
+	{
+		CapturePane(pane);
+	}
+
+	return m_frame;
+}
+
+void FrameCapture::CaptureVideo()
+{
+	auto first = m_videoMem.GetFrom();
+	auto end = first + PRINTER_VIDEO_COLUMNS * PRINTER_VIDEO_ROWS;
+	if (m_videoMem.IsAllDirty())
+	{
+		for (int address = first; address < end; address++)
+		{
+			CaptureCell(address);
+		}
+	}
+	else
+	{
+		m_videoMem.GetDirtyLines(m_dirtyLines);
+		for (auto line : m_dirtyLines)
+		{
+			for (int address = std::max(line, first); address < std::min(line + MemDevice::DIRTY_LINE_SIZE, end); address++)
+			{
+				CaptureCell(address);
+			}
+		}
+	}
+
+	m_videoMem.ClearDirty();
+}
+
+void FrameCapture::CaptureCell(int address)
+{
+	auto cell = address - m_videoMem.GetFrom();
+	uint8_t data;
+	char character = ' ';
+	if (GetByte(m_videoMem, address, data))
+	{
+		character = data >= 0x20 && data < 0x7F ? data : '.';
+	}
+
+	m_frame.video[cell / PRINTER_VIDEO_COLUMNS][cell % PRINTER_VIDEO_COLUMNS] = character;
+}
+
+void FrameCapture::CapturePane(int pane)
+{
+	auto &device = *m_panes[pane];
+	if (device.IsAllDirty())
+	{
+		ScanPane(pane);
+	}
+	else if (device.IsDirty())
+	{
+		//bytes never go back to uninitialized without IsAllDirty, so rows only appear or change and the
+		//rows of the previous frame are still the top ones but for the dirty lines
+		device.GetDirtyLines(m_dirtyLines);
+		for (auto line : m_dirtyLines)
+		{
+			for (int address = line; address < line + MemDevice::DIRTY_LINE_SIZE; address += PRINTER_ROW_BYTES)
+			{
+				UpdateRow(pane, address);
+			}
+		}
+	}
+	else
+	{
+		return;
+	}
+
+	//the scan creates the pages of the images, that does not change what is on screen
+	device.ClearDirty();
+}
+
+void FrameCapture::ScanPane(int pane)
+{
+	//from the top of the device down to the first rows with an initialized byte
+	auto &device = *m_panes[pane];
+	uint32_t count = 0;
+	for (int index = device.GetPageCount() - 1; index >= 0 && count < PRINTER_PANE_ROWS; index--)
+	{
+		auto page = device.GetPageAt(index);
+		if (page == nullptr)
+			continue;
+
+		int base = ((device.GetFrom() >> MemDevice::PAGE_BITS) + index) << MemDevice::PAGE_BITS;
+		for (int offset = MemDevice::PAGE_SIZE - PRINTER_ROW_BYTES; offset >= 0 && count < PRINTER_PANE_ROWS; offset -= PRINTER_ROW_BYTES)
+		{
+			uint16_t initialized = page->initialized[offset >> 6] >> (offset & 63);
+			if (initialized == 0)
+				continue;
+
+			auto &row = m_frame.rows[pane][count++];
+			row.address = base + offset;
+			row.initialized = initialized;
+			std::memcpy(row.data, page->data + offset, PRINTER_ROW_BYTES);
+		}
+	}
+	m_frame.rowCount[pane] = count;
+}
+
+void FrameCapture::UpdateRow(int pane, int address)
+{
+	auto &device = *m_panes[pane];
+	auto page = device.GetPageAt((address >> MemDevice::PAGE_BITS) - (device.GetFrom() >> MemDevice::PAGE_BITS));
+	auto offset = address & (MemDevice::PAGE_SIZE - 1);
+	uint16_t initialized = page != nullptr ? page->initialized[offset >> 6] >> (offset & 63) : 0;
+	if (initialized == 0)
+		return;
+
+	//the rows are sorted from the highest address, a row below the last one of a full pane is not shown
+	auto rows = m_frame.rows[pane];
+	auto &count = m_frame.rowCount[pane];
+	uint32_t index = 0;
+	while (index < count && rows[index].address > (uint32_t)address)
+	{
+		index++;
+	}
+	if (index == PRINTER_PANE_ROWS)
+		return;
+
+	if (index == count || rows[index].address != (uint32_t)address)
+	{
+		count = std::min(count + 1, (uint32_t)PRINTER_PANE_ROWS);
+		std::memmove(&rows[index + 1], &rows[index], (count - 1 - index) * sizeof(ScreenFrame::Row));
+	}
+
+	rows[index].address = address;
+	rows[index].initialized = initialized;
+	std::memcpy(rows[index].data, page->data + offset, PRINTER_ROW_BYTES);
+}
+
+Printer::Printer() : m_last{}, m_first(true)
 {
 	initscr();
-	m_win = newwin(500, 500, 0, 0);
+	m_win = newwin(0, 0, 0, 0);
 }
 
 Printer::~Printer()
@@ -14,32 +196,101 @@ Printer::~Printer()
 	endwin();
 }
 
-void Printer::Print()
+void Printer::Print(const ScreenFrame &frame)
+{
+	PrintStatus(frame);
+
+	for (int row = 0; row < PRINTER_VIDEO_ROWS; row++)
+	{
+		if (!m_first && std::memcmp(frame.video[row], m_last.video[row], PRINTER_VIDEO_COLUMNS) == 0)
+			continue;
+
+		for (int column = 0; column < PRINTER_VIDEO_COLUMNS; column++)
+		{
+			if (m_first || frame.video[row][column] != m_last.video[row][column])
+			{
+				mvwaddch(m_win, VIDEO_TOP + row, column, (chtype)(uint8_t)frame.video[row][column]);
+			}
+		}
+	}
+
+	for (int pane = 0; pane < PRINTER_PANES; pane++)
+	{
+		if (m_first)
+		{
+			mvwprintw(m_win, GetPaneTop(pane), 0, "%s", PANE_TITLES[pane]);
+			wclrtoeol(m_win);
+		}
+
+		for (int index = 0; index < PRINTER_PANE_ROWS; index++)
+		{
+			bool shown = index < (int)frame.rowCount[pane];
+			bool wasShown = index < (int)m_last.rowCount[pane];
+			if (m_first || shown != wasShown || (shown && std::memcmp(&frame.rows[pane][index], &m_last.rows[pane][index], sizeof(ScreenFrame::Row)) != 0))
+			{
+				PrintRow(frame, pane, index);
+			}
+		}
+	}
+
+	wrefresh(m_win);
+	m_last = frame;
+	m_first = false;
+}
+
+void Printer::PrintStatus(const ScreenFrame &frame)
 {
 	wmove(m_win, 0, 0);
 
-	auto status = m_proc.GetStatus();
+	const auto &state = frame.state;
+	auto flag = [&](int index) { return (state.f >> index) & 1; };
 
 	wprintw(m_win,
-					"STAR = %i MJR = %i \n\n",
-					status.star, status.mjr);
+					"STAR = %i MJR = %i CYCLES = %llu\n\n",
+					state.star, state.mjr, (unsigned long long)state.cycles);
 	wprintw(m_win,
 					"CS = %i IP = %i OPCODE = %i SOURCE = %i AL = %i\nDEST_SEL = %i DEST_OFF = %i\n\n",
-					status.cs, status.ip, status.opcode, status.source, status.al, status.destSel, status.destOff);
+					state.cs, state.ip, state.opcode, state.source, state.al, state.destSel, state.destOff);
 	wprintw(m_win,
 					"SS = %i SP = %i DS = %i DI = %i d7_d0 = %i\n\n",
-					status.ss, status.sp, status.ds, status.di, status.d7d0);
+					state.ss, state.sp, state.ds, state.di, state.d7d0);
 	wprintw(m_win,
 					"CF = %d OF = %d SF = %d ZF = %d\n\n",
-					status.cf, status.of, status.sf, status.zf);
+					flag(FLAG_CF), flag(FLAG_OF), flag(FLAG_SF), flag(FLAG_ZF));
 	wprintw(m_win,
-					std::string("MAR = " + status.mar + " MBR = %i MR_ = %i MW_ = %i\n\n").c_str(),
-					status.mbr, status.mr_, status.mw_);
+					"MAR = %s MBR = %i MR_ = %i MW_ = %i\n\n",
+					std::bitset<20>(state.mar).to_string().c_str(), state.mbr, state.mr_, state.mw_);
 
-	wprintw(m_win, m_eprom.Dump("Eprom").c_str());
-	wprintw(m_win, m_ramOne.Dump("RAMOn").c_str());
-	wprintw(m_win, m_ramTwo.Dump("RAMTW").c_str());
-	wprintw(m_win, m_videoMem.Dump("Video", true).c_str());
+	//always the same number of lines, the video starts right after them
+	for (int i = 0; i < PRINTER_TRACE_LINES; i++)
+	{
+		wmove(m_win, STATUS_LINES + i, 0);
+		if (i < (int)frame.traceCount)
+		{
+			waddstr(m_win, Trace::Format(frame.trace[i]).c_str());
+		}
+		wclrtoeol(m_win);
+	}
+}
 
-	wrefresh(m_win);
+void Printer::PrintRow(const ScreenFrame &frame, int pane, int index)
+{
+	wmove(m_win, GetPaneTop(pane) + 1 + index, 0);
+	if (index < (int)frame.rowCount[pane])
+	{
+		const auto &row = frame.rows[pane][index];
+		wprintw(m_win, "%05X:", row.address);
+		for (int i = 0; i < PRINTER_ROW_BYTES; i++)
+		{
+			if ((row.initialized >> i) & 1)
+			{
+				wprintw(m_win, " %02X", row.data[i]);
+			}
+			else
+			{
+				waddstr(m_win, " --");
+			}
+		}
+	}
+	wclrtoeol(m_win);
 }
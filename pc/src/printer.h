@@ -1,22 +1,82 @@
 #pragma once
 
 #include <ncurses.h>
-#include "processor.h"
+#include <vector>
+#include "cpu.h"
+#include "memdevice.h"
+#include "trace.h"
 
+//bus transactions shown on screen when tracing is on
+#define PRINTER_TRACE_LINES 8
+#define PRINTER_VIDEO_COLUMNS 80
+#define PRINTER_VIDEO_ROWS 25
+//the EPROM and the two RAMs
+#define PRINTER_PANES 3
+#define PRINTER_PANE_ROWS 6
+#define PRINTER_ROW_BYTES 16
+
+//Everything the Printer draws. FrameCapture fills it on the emulation thread and the Printer draws it
+//on the render thread, it is copied between them as it is, see RenderThread
+struct ScreenFrame
+{
+	struct Row
+	{
+		uint32_t address;
+		//one bit per byte
+		uint16_t initialized;
+		uint8_t data[PRINTER_ROW_BYTES];
+	};
+
+	CPU::State state;
+	uint32_t traceCount;
+	Trace::Record trace[PRINTER_TRACE_LINES];
+	//the video memory as a grid of characters from its first address, ' ' for the bytes never written
+	char video[PRINTER_VIDEO_ROWS][PRINTER_VIDEO_COLUMNS];
+	//the touched rows with the highest addresses of every pane, first the highest like MemDevice::Dump
+	uint32_t rowCount[PRINTER_PANES];
+	Row rows[PRINTER_PANES][PRINTER_PANE_ROWS];
+};
+
+//Copies the machine into a ScreenFrame on the emulation thread. Only the video cells and the pane rows in
+//dirty lines are copied again, see MemDevice::GetDirtyLines
+class FrameCapture
+{
+public:
+	FrameCapture(const CPU &proc, MemDevice &ramOne,
+							 MemDevice &ramTwo, MemDevice &videoMem,
+							 MemDevice &eprom);
+	const ScreenFrame &Capture();
+
+private:
+	const CPU &m_proc;
+	MemDevice &m_videoMem;
+	MemDevice *m_panes[PRINTER_PANES];
+	ScreenFrame m_frame;
+	//reused by every capture
+	std::vector<int> m_dirtyLines;
+
+	void CaptureVideo();
+	void CaptureCell(int address);
+	void CapturePane(int pane);
+	//the top rows of the device from scratch
+	void ScanPane(int pane);
+	//the row at address, if it is among the top rows of the pane
+	void UpdateRow(int pane, int address);
+};
+
+//Draws ScreenFrames with ncurses, only what changed since the previous one
 class Printer
 {
 public:
-	Printer(const Processor &proc, const MemDevice &ramOne,
-					const MemDevice &ramTwo, const MemDevice &videoMem,
-					const MemDevice &eprom);
+	Printer();
 	~Printer();
-	void Print();
+	void Print(const ScreenFrame &frame);
 
 private:
 	WINDOW *m_win;
-	const Processor &m_proc;
-	const MemDevice &m_ramOne;
-	const MemDevice &m_ramTwo;
-	const MemDevice &m_eprom;
-	const MemDevice &m_videoMem;
+	ScreenFrame m_last;
+	bool m_first;
+
+	void PrintStatus(const ScreenFrame &frame);
+	void PrintRow(const ScreenFrame &frame, int pane, int index);
 };
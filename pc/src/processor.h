@@ -1,232 +1,64 @@
 
 #pragma once
 #include "bus.h"
+#include "cpu.h"
+#include "histograms.h"
+#include "microcode.h"
+#include "profiler.h"
+#include "tracefile.h"
+#include "../../common/star.h"
+#include <array>
+#include <cstdint>
 #include <unordered_map>
-#include <vector>
-#include <string>
+#include <utility>
 
-enum class Star
-{
-	//fetch phase
-	fetch0 = 0,
-	fetch1,
-	fetch2,
-	fetch3,
-	fetchF0_0,
-	fetchF1_0,
-	fetchF1_1,
-	fetchF1_2,
-	fetchF2_0,
-	fetchF3_0,
-	fetchF3_1,
-	fetchF3_2,
-	fetchF4_0,
-	fetchF4_1,
-	fetchF4_2,
-	fetchF4_3,
-	fetchF4_4,
-	fetchF4_5,
-	fetchF4_6,
-	fetchF4_7,
-	fetchF5_0,
-	fetchF5_1,
-	fetchF5_2,
-	fetchF5_3,
-	fetchF5_4,
-	fetchF6_0,
-	fetchF6_1,
-	fetchF6_2,
-	fetchF6_3,
-	fetchF6_4,
-	fetchF7_0,
-	fetchF7_1,
-	fetchF7_2,
-	fetchF7_3,
-	fetchF7_4,
-	fetchF7_5,
-	fetchF7_6,
-	fetchF7_7,
-	fetchF7_8,
-	nvi0, //something went wrong
-
-	//execution phase
-	nop0,	 //NOP
-	hlt0,	 //HLT
-	ldah0, //MOV AL,AH
-	ldal0, //MOV AH,AL
-	ldds0, //MOV AX,DS
-	ldss0, //MOV AX,SS
-	ldsp0, //MOV AX,SP
-	lddi0, //MOV AX,DI
-	ldax0, //MOV DS,AX
-	ldax1, //MOV SS,AX
-	ldax2, //MOV SP,AX
-	ldax3, //MOV DI,AX
-
-	//MOV AL,DS:(DI)
-	ld0,
-	ld1,
-	ld2,
-
-	//OUT AL,offset
-	out0,
-	out1,
-	out2,
-
-	//ADD, SUB, AND, OR, CMP, SHR, SAL...
-	arit_log0,
-
-	//MOV, IN
-	ldal1,
-
-	//JMP, JA, JAE...
-	jmp0,
-
-	//PUSH AL
-	push0,
-	push1,
-	push2,
-
-	//POP AL
-	pop0,
-	pop1,
-	pop2,
-
-	//CALL selector:offset
-	call0,
-	call1,
-	call2,
-	call3,
-	call4,
-	call5,
-	call6,
-	call7,
-	call8,
-	call9,
-	call10,
-	call11,
-	call12,
-
-	//RETN, RETF
-	ret0,
-	ret1,
-	ret2,
-	ret3,
-	ret4,
-	ret5,
-	ret6,
-	ret7,
-	ret8,
-
-	//INT
-	int0,
-	int1,
-	int2,
-	int3,
-	int4,
-	int5,
-	int6,
-	int7,
-	int8,
-	int9,
-	int10,
-	int11,
-	int12,
-	int13,
-	int14,
-	int15,
-	int16,
-	int17,
-	int18,
-	int19,
-	int20,
-	int21,
-	int22,
-	int23,
-	int24,
-
-	//IRET
-	iret0,
-	iret1,
-	iret2,
-	iret3,
-	iret4,
-	iret5,
-	iret6,
-	iret7,
-	iret8,
-	iret9,
-	iret10,
-	iret11,
-
-	//CLI
-	cli0,
-
-	//STI
-	sti0,
-
-	//LDPSR
-	ldpsr0,
-
-	//STUM
-	stum0,
-
-	//new statement
-	nvma0,
-
-	//interruption fetch phase
-	pre_tipo0,
-	pre_tipo1
-};
-
-class Processor
+class Processor : public CPU
 {
 public:
-	struct Status
-	{
-		int star;
-		int mjr;
-		int d7d0;
-		int cs;
-		int ip;
-		int opcode;
-		int source;
-		int ss;
-		int sp;
-		int ds;
-		int di;
-		int destSel;
-		int destOff;
-		int al;
-		bool cf;
-		bool of;
-		bool sf;
-		bool zf;
-
-		std::string mar;
-		int mbr;
-		int mr_;
-		int mw_;
-		std::vector<std::string> log;
-	};
-
 	Processor() = delete;
 	Processor(Bus& bus);
 	void OnClock();
-	void OnReset();
-	Status GetStatus() const;
+	void Step() override;
+	void OnReset() override;
+	Status GetStatus() const override;
+	bool IsHalted() const override;
+	uint64_t GetCycles() const override;
+	State GetState() const override;
+	bool SetState(const State &state) override;
+	//record every cycle in a trace file, nullptr to stop
+	void SetTraceWriter(TraceWriter *writer);
+	//count the cycles of every instruction, nullptr to stop
+	void SetProfiler(Profiler *profiler);
+	//count the cycles of every microstate and opcode, nullptr to stop
+	void SetHistograms(Histograms *histograms);
+	void SetCycleLimit(uint64_t limit) override;
+	//run the wait states of a read in the cycle driving the address and add their cycles at once.
+	//GetCycles is the same of the exact mode, but there is no OnClock for the skipped cycles
+	void SetFastBus(bool enabled);
 
 private:
 	Bus& m_Bus;
-	std::vector<std::string> m_Log;
-
-	std::bitset<8> m_d7_d0;
+	uint64_t m_cycles;
+	uint64_t m_instructions;
+	TraceWriter *m_traceWriter = nullptr;
+	Profiler *m_profiler = nullptr;
+	Histograms *m_histograms = nullptr;
+	//a profiler or histograms are set, the only test OnClock makes for them
+	bool m_counting = false;
+	bool m_fastBus = false;
+	//every wait state lasts one cycle, nothing to look up on the bus
+	bool m_defaultLatency = true;
+	uint64_t m_cycleLimit = UINT64_MAX;
+	//cycles already spent in the current wait state
+	uint8_t m_wait = 0;
+
+	uint8_t m_d7_d0 = 0;
 
 	//TO DO this is set from an external interface
 	bool m_intr; 
 
 	//Registers
-	std::bitset<20> m_MAR;
+	uint32_t m_MAR = 0; //20 bits
 	bool m_MR_;	 //memory read
 	bool m_MW_;	 //memory write
 	bool m_IOR_; //i/o read
@@ -234,11 +66,11 @@ private:
 	bool m_INTA; //interrupt
 
 	bool m_DIR;
-	std::bitset<6> m_F; //flags
-	std::bitset<8> m_AL, m_AH, m_MBR, m_OPCODE, m_SOURCE;
-	std::bitset<16> m_DI, m_DS, m_CS, m_IP, m_SS, m_SP, m_DEST_OFF, m_DEST_SEL, m_PREV_SS, m_PREV_SP;
+	uint8_t m_F = 0; //flags, 6 bits
+	uint8_t m_AL = 0, m_AH = 0, m_MBR = 0, m_OPCODE = 0, m_SOURCE = 0;
+	uint16_t m_DI = 0, m_DS = 0, m_CS = 0, m_IP = 0, m_SS = 0, m_SP = 0, m_DEST_OFF = 0, m_DEST_SEL = 0, m_PREV_SS = 0, m_PREV_SP = 0;
 
-	Star m_STAR, m_MJR; //status register
+	Star m_STAR = Star::fetch0, m_MJR = Star::fetch0; //status register
 
 	// flags
 	void SetCF(bool val); //carry
@@ -254,9 +86,24 @@ private:
 	bool GetOF() const;
 	bool GetIF() const;
 	bool GetUS() const;
-
-	std::bitset<8> GetFlags();
+	void SetFlag(int index, bool val);
+	bool GetFlag(int index) const;
 
 	bool IsConditionMatch();
 	void ExecuteALU();
+
+	using MicroHandler = void (*)(Processor &processor);
+
+	//one row of MICROCODE: the bus lines first, then the transfers, then the next state
+	template <int state>
+	void RunMicroInstruction();
+	template <Microcode::Transfer transfer>
+	void Execute();
+	template <int... states>
+	static constexpr std::array<MicroHandler, sizeof...(states)> BuildMicroHandlers(std::integer_sequence<int, states...>);
+	static MicroHandler GetMicroHandler(Star state);
+	//moves on from the wait state in m_STAR when the device at MAR has no wait states, or in fast bus mode
+	void SkipWaitState();
+	//hands the cycle about to run to the profiler and the histograms
+	void CountClock();
 };
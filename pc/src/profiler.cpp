@@ -0,0 +1,255 @@
+#include "profiler.h"
+#include "registers.h"
+#include "../../common/opcodeinfo.h"
+#include <algorithm>
+#include <cstdio>
+#include <numeric>
+
+#define ADDRESS_SPACE (1 << 20)
+
+namespace
+{
+	//"name" or "name+0x12" after the closest symbol below address, the address in hex without one.
+	//symbols sorted by address
+	std::string GetLocation(uint32_t address, const std::vector<RomImage::Symbol> &symbols)
+	{
+		auto next = std::upper_bound(symbols.begin(), symbols.end(), address,
+																 [](uint32_t value, const RomImage::Symbol &symbol) { return value < symbol.address; });
+		char text[32];
+		if (next == symbols.begin())
+		{
+			snprintf(text, sizeof(text), "%05X", address);
+			return text;
+		}
+
+		auto &symbol = *(next - 1);
+		if (symbol.address == address)
+			return symbol.name;
+
+		snprintf(text, sizeof(text), "+0x%X", address - symbol.address);
+		return symbol.name + text;
+	}
+
+	std::vector<RomImage::Symbol> SortSymbols(const std::vector<RomImage::Symbol> &symbols)
+	{
+		auto sorted = symbols;
+		std::stable_sort(sorted.begin(), sorted.end(), [](const RomImage::Symbol &a, const RomImage::Symbol &b) { return a.address < b.address; });
+		return sorted;
+	}
+
+	double GetCPI(uint64_t cycles, uint64_t instructions)
+	{
+		return instructions != 0 ? (double)cycles / instructions : 0;
+	}
+} // namespace
+
+Profiler::Profiler()
+		: m_cycles(ADDRESS_SPACE), m_instructions(ADDRESS_SPACE), m_opcodes(ADDRESS_SPACE), m_opcodeCycles{},
+			m_opcodeInstructions{}, m_frames{{0, -1, -1, -1, 0}}, m_frame(0), m_depth(0), m_overflow(0),
+			m_stackChange(StackChange::None), m_started(false), m_address(0), m_start(0)
+{
+}
+
+void Profiler::OnClock(uint64_t cycle, Star state, uint16_t cs, uint16_t ip, uint8_t opcode)
+{
+	switch (state)
+	{
+	case Star::fetch0:
+		OnInstruction(cycle, cs, ip, opcode);
+		break;
+	case Star::call0:
+	case Star::int0:
+		m_stackChange = StackChange::Push;
+		break;
+	case Star::ret0:
+	case Star::iret0:
+		m_stackChange = StackChange::Pop;
+		break;
+	default:
+		break;
+	}
+}
+
+void Profiler::OnInstruction(uint64_t cycle, uint16_t cs, uint16_t ip, uint8_t opcode)
+{
+	auto address = ComputePhysicalAddress(cs, ip);
+	if (m_started)
+	{
+		Close(cycle, opcode);
+	}
+	else
+	{
+		//the first instruction, a snapshot may start in the middle of the previous one
+		m_frames[0].address = address;
+		m_started = true;
+	}
+
+	if (m_stackChange == StackChange::Push)
+	{
+		Push(address);
+	}
+	else if (m_stackChange == StackChange::Pop)
+	{
+		Pop();
+	}
+	m_stackChange = StackChange::None;
+
+	m_address = address;
+	m_start = cycle;
+}
+
+void Profiler::OnStop(uint64_t cycle, uint8_t opcode)
+{
+	if (!m_started)
+		return;
+
+	//the cycle after the last one counted, like a fetch0 would be
+	Close(cycle + 1, opcode);
+}
+
+void Profiler::Close(uint64_t cycle, uint8_t opcode)
+{
+	auto cycles = cycle - m_start;
+	m_cycles[m_address] += cycles;
+	m_instructions[m_address]++;
+	m_opcodes[m_address] = opcode;
+	m_opcodeCycles[opcode] += cycles;
+	m_opcodeInstructions[opcode]++;
+	m_frames[m_frame].cycles += cycles;
+}
+
+void Profiler::Push(uint32_t address)
+{
+	if (m_depth == PROFILER_MAX_DEPTH)
+	{
+		m_overflow++;
+		return;
+	}
+
+	auto child = m_frames[m_frame].firstChild;
+	while (child >= 0 && m_frames[child].address != address)
+	{
+		child = m_frames[child].nextSibling;
+	}
+
+	if (child < 0)
+	{
+		child = (int)m_frames.size();
+		m_frames.push_back({address, m_frame, -1, m_frames[m_frame].firstChild, 0});
+		m_frames[m_frame].firstChild = child;
+	}
+
+	m_frame = child;
+	m_depth++;
+}
+
+void Profiler::Pop()
+{
+	if (m_overflow > 0)
+	{
+		m_overflow--;
+	}
+	else if (m_frame != 0)
+	{
+		//a ret without a call stays in the first function
+		m_frame = m_frames[m_frame].parent;
+		m_depth--;
+	}
+}
+
+bool Profiler::Write(const std::string &path, const std::vector<RomImage::Symbol> &symbols,
+										 const std::vector<Executable::Line> &lines) const
+{
+	auto sorted = SortSymbols(symbols);
+	return WriteReport(path, sorted, lines) && WriteStacks(path + ".folded", sorted);
+}
+
+bool Profiler::WriteReport(const std::string &path, const std::vector<RomImage::Symbol> &symbols,
+													 const std::vector<Executable::Line> &lines) const
+{
+	auto file = fopen(path.c_str(), "w");
+	if (file == nullptr)
+		return false;
+
+	auto cycles = std::accumulate(m_opcodeCycles, m_opcodeCycles + 256, (uint64_t)0);
+	auto instructions = std::accumulate(m_opcodeInstructions, m_opcodeInstructions + 256, (uint64_t)0);
+	fprintf(file, "cycles = %llu instructions = %llu CPI = %.3f\n\n", (unsigned long long)cycles,
+					(unsigned long long)instructions, GetCPI(cycles, instructions));
+
+	std::vector<uint32_t> hot;
+	for (uint32_t address = 0; address < ADDRESS_SPACE; address++)
+	{
+		if (m_instructions[address] != 0)
+		{
+			hot.push_back(address);
+		}
+	}
+	auto count = std::min(hot.size(), (std::size_t)PROFILER_REPORT_LINES);
+	std::partial_sort(hot.begin(), hot.begin() + count, hot.end(), [this](uint32_t a, uint32_t b) {
+		return m_cycles[a] != m_cycles[b] ? m_cycles[a] > m_cycles[b] : a < b;
+	});
+
+	fprintf(file, "%-7s %14s %7s %12s %7s  %-20s %6s  %s\n", "address", "cycles", "%", "instructions", "CPI", "opcode", "line", "location");
+	for (std::size_t i = 0; i < count; i++)
+	{
+		auto address = hot[i];
+		auto mnemonic = GetOpcodeInfo(m_opcodes[address]).mnemonic;
+		char line[16] = "-";
+		auto source = std::upper_bound(lines.begin(), lines.end(), address,
+																	 [](uint32_t value, const Executable::Line &entry) { return value < entry.address; });
+		if (source != lines.begin())
+		{
+			snprintf(line, sizeof(line), "%u", (source - 1)->line);
+		}
+		fprintf(file, "%05X   %14llu %6.2f%% %12llu %7.3f  %-20s %6s  %s\n", address, (unsigned long long)m_cycles[address],
+						cycles != 0 ? 100.0 * m_cycles[address] / cycles : 0, (unsigned long long)m_instructions[address],
+						GetCPI(m_cycles[address], m_instructions[address]), mnemonic ? mnemonic : "?", line,
+						GetLocation(address, symbols).c_str());
+	}
+
+	std::vector<int> opcodes(256);
+	std::iota(opcodes.begin(), opcodes.end(), 0);
+	std::stable_sort(opcodes.begin(), opcodes.end(), [this](int a, int b) { return m_opcodeCycles[a] > m_opcodeCycles[b]; });
+
+	fprintf(file, "\n%-7s %14s %7s %12s %7s  %s\n", "opcode", "cycles", "%", "instructions", "CPI", "mnemonic");
+	for (auto opcode : opcodes)
+	{
+		if (m_opcodeInstructions[opcode] == 0)
+			break;
+
+		auto mnemonic = GetOpcodeInfo(opcode).mnemonic;
+		fprintf(file, "%02X      %14llu %6.2f%% %12llu %7.3f  %s\n", opcode, (unsigned long long)m_opcodeCycles[opcode],
+						cycles != 0 ? 100.0 * m_opcodeCycles[opcode] / cycles : 0, (unsigned long long)m_opcodeInstructions[opcode],
+						GetCPI(m_opcodeCycles[opcode], m_opcodeInstructions[opcode]), mnemonic ? mnemonic : "?");
+	}
+
+	return fclose(file) == 0;
+}
+
+bool Profiler::WriteStacks(const std::string &path, const std::vector<RomImage::Symbol> &symbols) const
+{
+	auto file = fopen(path.c_str(), "w");
+	if (file == nullptr)
+		return false;
+
+	std::vector<std::string> names;
+	for (const auto &frame : m_frames)
+	{
+		names.push_back(GetLocation(frame.address, symbols));
+	}
+
+	for (std::size_t i = 0; i < m_frames.size(); i++)
+	{
+		if (m_frames[i].cycles == 0)
+			continue;
+
+		std::string stack = names[i];
+		for (auto parent = m_frames[i].parent; parent >= 0; parent = m_frames[parent].parent)
+		{
+			stack = names[parent] + ";" + stack;
+		}
+		fprintf(file, "%s %llu\n", stack.c_str(), (unsigned long long)m_frames[i].cycles);
+	}
+
+	return fclose(file) == 0;
+}
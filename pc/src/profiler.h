@@ -0,0 +1,83 @@
+#pragma once
+#include "romimage.h"
+#include "../../common/star.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+//instructions listed in the hot spot report
+#define PROFILER_REPORT_LINES 40
+//calls nested deeper than this are counted in the function at this depth
+#define PROFILER_MAX_DEPTH 256
+
+//Counts the clock cycles Processor spends on every instruction, by physical address and by opcode, and
+//by call stack for flame graphs. An instruction starts at fetch0 and owns every cycle up to the next
+//fetch0, wait states and the entry of a hardware interrupt included. The call stack follows the
+//microstates of call, retn/retf, int (hardware interrupts too) and iret: the instruction after a call
+//or an int starts a new function, the one after a ret or an iret goes back to the caller.
+class Profiler
+{
+public:
+	Profiler();
+	Profiler(const Profiler &) = delete;
+	Profiler &operator=(const Profiler &) = delete;
+
+	//every clock cycle, before the processor executes state, with the cycle count already incremented.
+	//The opcode and CS:IP are still the ones of the previous cycle
+	void OnClock(uint64_t cycle, Star state, uint16_t cs, uint16_t ip, uint8_t opcode);
+	//closes the instruction running at cycle, once when the run stops
+	void OnStop(uint64_t cycle, uint8_t opcode);
+
+	//the hot spots and the cycles per opcode to path, the call stacks to path.folded in the collapsed
+	//format of flamegraph.pl, one "caller;callee cycles" line per stack
+	bool Write(const std::string &path, const std::vector<RomImage::Symbol> &symbols,
+						 const std::vector<Executable::Line> &lines) const;
+
+private:
+	enum class StackChange
+	{
+		None,
+		Push,
+		Pop
+	};
+
+	//node of the call tree, the children of a frame are linked through nextSibling
+	struct Frame
+	{
+		uint32_t address;
+		int parent;
+		int firstChild;
+		int nextSibling;
+		uint64_t cycles;
+	};
+
+	//by physical address
+	std::vector<uint64_t> m_cycles;
+	std::vector<uint64_t> m_instructions;
+	//the last opcode run from every address
+	std::vector<uint8_t> m_opcodes;
+	//by opcode
+	uint64_t m_opcodeCycles[256];
+	uint64_t m_opcodeInstructions[256];
+
+	//0 is the function of the first instruction
+	std::vector<Frame> m_frames;
+	int m_frame;
+	int m_depth;
+	//calls past PROFILER_MAX_DEPTH still to return
+	int m_overflow;
+	StackChange m_stackChange;
+
+	//the running instruction
+	bool m_started;
+	uint32_t m_address;
+	uint64_t m_start;
+
+	void OnInstruction(uint64_t cycle, uint16_t cs, uint16_t ip, uint8_t opcode);
+	void Close(uint64_t cycle, uint8_t opcode);
+	void Push(uint32_t address);
+	void Pop();
+	bool WriteReport(const std::string &path, const std::vector<RomImage::Symbol> &symbols,
+									 const std::vector<Executable::Line> &lines) const;
+	bool WriteStacks(const std::string &path, const std::vector<RomImage::Symbol> &symbols) const;
+};
@@ -0,0 +1,579 @@
+#include "instruction.h"
+#include "machine.h"
+#include "registers.h"
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+//Recompiles a ROM to C++ for AotProcessor. The control flow is followed from the reset vector
+//through every jump, call and return address, and every block found becomes a label of a single
+//function, so that the jumps between blocks are gotos. Far jumps and calls use a DEST_SEL that is
+//only known at run time and ret pops its target, they go through a switch over the known blocks and
+//back to the interpreter when the target is not one of them.
+namespace
+{
+	//Processor::OnReset
+	const uint16_t RESET_CS = 0xF000;
+	const uint16_t RESET_IP = 0x0000;
+
+	struct Instruction
+	{
+		uint16_t ip;
+		uint8_t opcode;
+		uint8_t length;
+		uint8_t operands[4];
+	};
+
+	//the instructions the generated code runs, the same that JitProcessor translates
+	bool IsCompiled(uint8_t opcode)
+	{
+		const auto &info = GetOpcodeInfo(opcode);
+		if (info.mnemonic == nullptr || opcode == Instructions::IN_OPCODE)
+			return false;
+
+		switch (info.executionState)
+		{
+		case Star::hlt0:
+		case Star::out0:
+		case Star::int0:
+		case Star::iret0:
+		case Star::cli0:
+		case Star::sti0:
+			return false;
+		default:
+			return true;
+		}
+	}
+
+	//the interpreted instructions the execution goes on after
+	bool IsFallthrough(uint8_t opcode)
+	{
+		auto state = GetOpcodeInfo(opcode).executionState;
+		return state == Star::out0 || state == Star::cli0 || state == Star::sti0 || opcode == Instructions::IN_OPCODE;
+	}
+
+	bool IsTerminator(uint8_t opcode)
+	{
+		auto state = GetOpcodeInfo(opcode).executionState;
+		return state == Star::jmp0 || state == Star::call0 || state == Star::ret0;
+	}
+
+	//bit f is set when the jump is taken with the 4 low bits of F equal to f
+	uint16_t GetConditionMask(uint8_t opcode)
+	{
+		uint16_t mask = 0;
+		for (int flags = 0; flags < 16; flags++)
+		{
+			mask |= Instructions::IsConditionMatch(opcode, flags) << flags;
+		}
+		return mask;
+	}
+
+	uint16_t GetTarget(const Instruction &instruction)
+	{
+		auto format = Instructions::GetFormatType(instruction.opcode);
+		return format == Instructions::Format::F7 ? Concat(instruction.operands[3], instruction.operands[2])
+																							: Concat(instruction.operands[1], instruction.operands[0]);
+	}
+
+	std::string Hex(unsigned value, int digits)
+	{
+		char text[16];
+		snprintf(text, sizeof(text), "0x%0*X", digits, value);
+		return text;
+	}
+
+	std::string Label(uint16_t ip)
+	{
+		char text[16];
+		snprintf(text, sizeof(text), "B_%04X", ip);
+		return text;
+	}
+
+	class Recompiler
+	{
+	public:
+		//the code section mapped at base, entry is the IP of the entry point in RESET_CS
+		Recompiler(const RomImage::Section &rom, uint16_t entry) : m_rom(rom), m_base(rom.address), m_entry(entry), m_far(0)
+		{
+		}
+
+		void Explore();
+		bool Write(const std::string &filename, const std::string &source);
+		void PrintSummary() const;
+
+	private:
+		const RomImage::Section &m_rom;
+		uint32_t m_base;
+		uint16_t m_entry;
+		std::set<uint16_t> m_entries;
+		std::vector<uint16_t> m_pending;
+		//first instruction of every block that has at least one compiled instruction
+		std::map<uint16_t, std::vector<Instruction>> m_blocks;
+		//far jumps and calls, their targets are assumed to be in the ROM segment
+		int m_far;
+
+		//false if the instruction is not entirely inside the ROM
+		bool Decode(uint16_t ip, Instruction &instruction) const;
+		void AddEntry(uint16_t ip);
+		std::vector<Instruction> GetBlock(uint16_t ip) const;
+
+		void WriteBlock(std::ostream &out, uint16_t ip, const std::vector<Instruction> &block) const;
+		void WriteInstruction(std::ostream &out, const Instruction &instruction) const;
+		void WriteGoto(std::ostream &out, uint16_t ip, bool setIp, const char *indent) const;
+		void WritePush(std::ostream &out, const std::string &value) const;
+		//MAR = SS:SP, SP++, the byte is p.Read(p.m_MAR)
+		void WritePop(std::ostream &out) const;
+	};
+
+	bool Recompiler::Decode(uint16_t ip, Instruction &instruction) const
+	{
+		instruction = {ip};
+		for (int i = 0; i == 0 || i < instruction.length; i++)
+		{
+			auto address = (int64_t)ComputePhysicalAddress(RESET_CS, ip + i) - m_base;
+			if ((uint16_t)(ip + i) < ip || address < 0 || address >= (int64_t)m_rom.size)
+				return false;
+
+			if (i == 0)
+			{
+				instruction.opcode = m_rom.data[address];
+				instruction.length = GetOpcodeInfo(instruction.opcode).length;
+			}
+			else
+			{
+				instruction.operands[i - 1] = m_rom.data[address];
+			}
+		}
+
+		return true;
+	}
+
+	void Recompiler::AddEntry(uint16_t ip)
+	{
+		if (m_entries.insert(ip).second)
+		{
+			m_pending.push_back(ip);
+		}
+	}
+
+	void Recompiler::Explore()
+	{
+		std::set<uint16_t> visited;
+		AddEntry(RESET_IP);
+		AddEntry(m_entry);
+		while (!m_pending.empty())
+		{
+			uint16_t ip = m_pending.back();
+			m_pending.pop_back();
+
+			Instruction instruction;
+			while (visited.insert(ip).second && Decode(ip, instruction))
+			{
+				uint16_t next = ip + instruction.length;
+				if (!IsCompiled(instruction.opcode))
+				{
+					if (IsFallthrough(instruction.opcode))
+					{
+						AddEntry(next);
+					}
+					break;
+				}
+
+				if (IsTerminator(instruction.opcode))
+				{
+					auto far = Instructions::GetFormatType(instruction.opcode) == Instructions::Format::F7;
+					switch (GetOpcodeInfo(instruction.opcode).executionState)
+					{
+					case Star::jmp0:
+					{
+						auto mask = GetConditionMask(instruction.opcode);
+						if (far)
+						{
+							//the segment is only known at run time, the dispatch checks it
+							m_far++;
+							AddEntry(GetTarget(instruction));
+							break;
+						}
+						if (mask != 0)
+						{
+							AddEntry(GetTarget(instruction));
+						}
+						if (mask != 0xFFFF)
+						{
+							AddEntry(next);
+						}
+					}
+					break;
+					case Star::call0:
+						//the return address is only reached through ret
+						AddEntry(next);
+						if (far)
+						{
+							m_far++;
+						}
+						AddEntry(GetTarget(instruction));
+						break;
+					default:
+						break;
+					}
+					break;
+				}
+
+				ip = next;
+			}
+		}
+
+		for (auto entry : m_entries)
+		{
+			auto block = GetBlock(entry);
+			if (!block.empty())
+			{
+				m_blocks[entry] = block;
+			}
+		}
+	}
+
+	std::vector<Instruction> Recompiler::GetBlock(uint16_t ip) const
+	{
+		//up to a terminator, an interpreted instruction or the next entry
+		std::vector<Instruction> block;
+		Instruction instruction;
+		while ((block.empty() || m_entries.count(ip) == 0) && Decode(ip, instruction) && IsCompiled(instruction.opcode))
+		{
+			block.push_back(instruction);
+			if (IsTerminator(instruction.opcode))
+				break;
+
+			ip += instruction.length;
+		}
+		return block;
+	}
+
+	void Recompiler::WriteGoto(std::ostream &out, uint16_t ip, bool setIp, const char *indent) const
+	{
+		if (setIp)
+		{
+			out << indent << "p.m_IP = " << Hex(ip, 4) << ";\n";
+		}
+		out << indent << "goto " << (m_blocks.count(ip) != 0 ? Label(ip) : "exit") << ";\n";
+	}
+
+	void Recompiler::WritePush(std::ostream &out, const std::string &value) const
+	{
+		out << "\tp.m_MAR = ComputePhysicalAddress(p.m_SS, p.m_SP - 1);\n";
+		out << "\tp.m_MBR = " << value << ";\n";
+		out << "\tp.Write(p.m_MAR, p.m_MBR);\n";
+		out << "\tp.m_SP--;\n";
+	}
+
+	void Recompiler::WritePop(std::ostream &out) const
+	{
+		out << "\tp.m_MAR = ComputePhysicalAddress(p.m_SS, p.m_SP);\n";
+		out << "\tp.m_SP++;\n";
+	}
+
+	void Recompiler::WriteInstruction(std::ostream &out, const Instruction &instruction) const
+	{
+		const auto &info = GetOpcodeInfo(instruction.opcode);
+		auto opcode = Hex(instruction.opcode, 2);
+		auto operands = instruction.operands;
+		uint16_t next = instruction.ip + instruction.length;
+
+		out << "\t//" << Hex(instruction.ip, 4) << " " << info.mnemonic;
+		for (int i = 0; i < instruction.length - 1; i++)
+		{
+			out << " " << Hex(operands[i], 2);
+		}
+		out << "\n";
+
+		//fetch0 .. fetch3, see FastProcessor::Fetch
+		out << "\tp.m_IP = " << Hex(next, 4) << ";\n";
+		out << "\tp.m_MAR = " << Hex(ComputePhysicalAddress(RESET_CS, next - 1), 5) << ";\n";
+		out << "\tp.m_d7_d0 = " << Hex(instruction.length == 1 ? instruction.opcode : operands[instruction.length - 2], 2) << ";\n";
+		out << "\tp.m_OPCODE = " << opcode << ";\n";
+		out << "\tp.m_MR_ = true;\n";
+		out << "\tp.m_MJR = GetOpcodeInfo(" << opcode << ").executionState;\n";
+
+		switch (info.format)
+		{
+		case Instructions::Format::F0:
+			break;
+		case Instructions::Format::F1:
+			out << "\tp.m_MAR = ComputePhysicalAddress(p.m_DS, p.m_DI);\n";
+			out << "\tp.m_SOURCE = p.Read(p.m_MAR);\n";
+			break;
+		case Instructions::Format::F2:
+			out << "\tp.m_DEST_SEL = p.m_DS;\n";
+			out << "\tp.m_DEST_OFF = p.m_DI;\n";
+			break;
+		case Instructions::Format::F3:
+			out << "\tp.m_SOURCE = " << Hex(operands[0], 2) << ";\n";
+			break;
+		case Instructions::Format::F4:
+			//never IN, see IsCompiled
+			out << "\tp.m_MBR = " << Hex(operands[0], 2) << ";\n";
+			out << "\tp.m_MAR = ComputePhysicalAddress(p.m_DS, " << Hex(Concat(operands[1], operands[0]), 4) << ");\n";
+			out << "\tp.m_SOURCE = p.Read(p.m_MAR);\n";
+			break;
+		case Instructions::Format::F5:
+			out << "\tp.m_MBR = " << Hex(operands[0], 2) << ";\n";
+			out << "\tp.m_DEST_SEL = p.m_DS;\n";
+			out << "\tp.m_DEST_OFF = " << Hex(Concat(operands[1], operands[0]), 4) << ";\n";
+			break;
+		case Instructions::Format::F6:
+			out << "\tp.m_MBR = " << Hex(operands[0], 2) << ";\n";
+			out << "\tp.m_DEST_SEL = " << Hex(RESET_CS, 4) << ";\n";
+			out << "\tp.m_DEST_OFF = " << Hex(Concat(operands[1], operands[0]), 4) << ";\n";
+			break;
+		case Instructions::Format::F7:
+			//DEST_SEL is never loaded, see FastProcessor::Fetch
+			out << "\tp.m_MBR = " << Hex(operands[2], 2) << ";\n";
+			out << "\tp.m_DEST_OFF = " << Hex(Concat(operands[3], operands[2]), 4) << ";\n";
+			break;
+		}
+
+		switch (info.executionState)
+		{
+		case Star::ldah0:
+			out << "\tah = al;\n";
+			break;
+		case Star::ldal0:
+			out << "\tal = ah;\n";
+			break;
+		case Star::ldds0:
+			out << "\tp.m_DS = Concat(ah, al);\n";
+			break;
+		case Star::ldss0:
+			out << "\tp.m_SS = Concat(ah, al);\n";
+			break;
+		case Star::ldsp0:
+			out << "\tp.m_SP = Concat(ah, al);\n";
+			break;
+		case Star::lddi0:
+			out << "\tp.m_DI = Concat(ah, al);\n";
+			break;
+		case Star::ldax0:
+			out << "\tah = p.m_DS >> 8;\n\tal = p.m_DS;\n";
+			break;
+		case Star::ldax1:
+			out << "\tah = p.m_SS >> 8;\n\tal = p.m_SS;\n";
+			break;
+		case Star::ldax2:
+			out << "\tah = p.m_SP >> 8;\n\tal = p.m_SP;\n";
+			break;
+		case Star::ldax3:
+			out << "\tah = p.m_DI >> 8;\n\tal = p.m_DI;\n";
+			break;
+		case Star::ld0:
+			out << "\tp.m_MAR = ComputePhysicalAddress(p.m_DEST_SEL, p.m_DEST_OFF);\n";
+			out << "\tp.m_MBR = al;\n";
+			out << "\tp.m_DIR = true;\n";
+			out << "\tp.Write(p.m_MAR, p.m_MBR);\n";
+			break;
+		case Star::arit_log0:
+			out << "\tal = ALU::Execute(GetOpcodeInfo(" << opcode << ").alu, al, p.m_SOURCE, f);\n";
+			break;
+		case Star::ldal1:
+			out << "\tal = p.m_SOURCE;\n";
+			break;
+		case Star::push0:
+			out << "\tp.m_DIR = true;\n";
+			WritePush(out, "al");
+			break;
+		case Star::pop0:
+			WritePop(out);
+			out << "\tal = p.Read(p.m_MAR);\n";
+			break;
+		case Star::ldpsr0:
+			out << "\tp.m_PREV_SS = p.m_SS;\n";
+			out << "\tp.m_PREV_SP = p.m_SP;\n";
+			break;
+		case Star::stum0:
+			out << "\tf |= 1 << FLAG_US;\n";
+			out << "\tstd::swap(p.m_SS, p.m_PREV_SS);\n";
+			out << "\tstd::swap(p.m_SP, p.m_PREV_SP);\n";
+			break;
+		case Star::jmp0:
+			if (info.format == Instructions::Format::F7)
+			{
+				out << "\tp.m_CS = p.m_DEST_SEL;\n";
+				out << "\tp.m_IP = " << Hex(GetTarget(instruction), 4) << ";\n";
+				out << "\tgoto dispatch;\n";
+				break;
+			}
+
+			//CS = DEST_SEL = CS
+			switch (GetTarget(instruction) == next ? 0x0000 : GetConditionMask(instruction.opcode))
+			{
+			case 0xFFFF:
+				WriteGoto(out, GetTarget(instruction), true, "\t");
+				break;
+			case 0x0000:
+				WriteGoto(out, next, false, "\t");
+				break;
+			default:
+				out << "\tif ((" << Hex(GetConditionMask(instruction.opcode), 4) << " >> (f & 0x0F)) & 1)\n\t{\n";
+				WriteGoto(out, GetTarget(instruction), true, "\t\t");
+				out << "\t}\n";
+				WriteGoto(out, next, false, "\t");
+				break;
+			}
+			break;
+		case Star::call0:
+			out << "\tp.m_DIR = true;\n";
+			WritePush(out, Hex(next >> 8, 2));
+			WritePush(out, Hex(next & 0xFF, 2));
+			if (instruction.opcode != Instructions::CALLF_OPCODE)
+			{
+				WriteGoto(out, GetTarget(instruction), true, "\t");
+				break;
+			}
+
+			WritePush(out, Hex(RESET_CS >> 8, 2));
+			WritePush(out, Hex(RESET_CS & 0xFF, 2));
+			out << "\tp.m_CS = p.m_DEST_SEL;\n";
+			out << "\tp.m_IP = " << Hex(GetTarget(instruction), 4) << ";\n";
+			out << "\tgoto dispatch;\n";
+			break;
+		case Star::ret0:
+			//retf takes the same path, see opcodeinfo.h
+			WritePop(out);
+			out << "\tp.m_MBR = p.Read(p.m_MAR);\n";
+			WritePop(out);
+			out << "\tp.m_IP = Concat(p.Read(p.m_MAR), p.m_MBR);\n";
+			out << "\tgoto dispatch;\n";
+			break;
+		default:
+			//nop0
+			break;
+		}
+	}
+
+	void Recompiler::WriteBlock(std::ostream &out, uint16_t ip, const std::vector<Instruction> &block) const
+	{
+		int cycles = 0;
+		for (const auto &instruction : block)
+		{
+			cycles += GetOpcodeInfo(instruction.opcode).cycles;
+		}
+
+		//CS:IP is already the one of the block
+		out << Label(ip) << ":\n";
+		out << "\tif (cycles + " << cycles << " > limit)\n\t\tgoto exit;\n";
+		out << "\tcycles += " << cycles << ";\n";
+		out << "\tinstructions += " << block.size() << ";\n";
+		for (const auto &instruction : block)
+		{
+			WriteInstruction(out, instruction);
+		}
+
+		const auto &last = block.back();
+		if (!IsTerminator(last.opcode))
+		{
+			WriteGoto(out, last.ip + last.length, false, "\t");
+		}
+		out << "\n";
+	}
+
+	bool Recompiler::Write(const std::string &filename, const std::string &source)
+	{
+		std::ofstream out(filename);
+		if (!out.is_open())
+			return false;
+
+		out << "//generated by ME88Recompile from " << source << ", do not edit\n";
+		out << "#include \"aotprocessor.h\"\n";
+		out << "#include \"alu.h\"\n";
+		out << "#include \"registers.h\"\n";
+		out << "#include <utility>\n\n";
+
+		out << "class AotProgram\n{\npublic:\n\tstatic void Run(AotProcessor &p);\n};\n\n";
+
+		out << "namespace\n{\n\tconst uint8_t g_rom[] = {";
+		for (std::size_t i = 0; i < m_rom.size; i++)
+		{
+			out << (i % 16 == 0 ? "\n\t\t" : " ") << Hex(m_rom.data[i], 2) << ",";
+		}
+		out << "\n\t};\n\n";
+		out << "\tconst bool g_registered = AotProcessor::Register({g_rom, sizeof(g_rom), " << Hex(m_base, 5) << ", &AotProgram::Run});\n";
+		out << "} // namespace\n\n";
+
+		out << "void AotProgram::Run(AotProcessor &p)\n{\n";
+		out << "\tuint8_t al = p.m_AL, ah = p.m_AH, f = p.m_F;\n";
+		out << "\tuint64_t cycles = p.m_cycles, instructions = p.m_instructions;\n";
+		out << "\tconst uint64_t limit = p.m_stepLimit;\n\n";
+
+		//without indirect jumps nothing goes back to the dispatch
+		out << "dispatch:\n\t__attribute__((unused));\n";
+		out << "\tswitch (((uint32_t)p.m_CS << 16) | p.m_IP)\n\t{\n";
+		for (const auto &block : m_blocks)
+		{
+			out << "\tcase " << Hex(((uint32_t)RESET_CS << 16) | block.first, 8) << ":\n\t\tgoto " << Label(block.first) << ";\n";
+		}
+		out << "\t}\n";
+		out << "\tgoto exit;\n\n";
+
+		for (const auto &block : m_blocks)
+		{
+			WriteBlock(out, block.first, block.second);
+		}
+
+		out << "exit:\n";
+		out << "\tp.m_AL = al;\n\tp.m_AH = ah;\n\tp.m_F = f;\n";
+		out << "\tp.m_cycles = cycles;\n\tp.m_instructions = instructions;\n";
+		out << "}\n";
+		return out.good();
+	}
+
+	void Recompiler::PrintSummary() const
+	{
+		std::size_t instructions = 0;
+		for (const auto &block : m_blocks)
+		{
+			instructions += block.second.size();
+		}
+		std::cout << "entries = " << m_entries.size() << " blocks = " << m_blocks.size() << " instructions = " << instructions
+							<< " far targets = " << m_far << "\n";
+	}
+} // namespace
+
+int main(int argc, char *argv[])
+{
+	if (argc != 3)
+	{
+		std::cout << "usage: ME88Recompile rom out.cpp\n";
+		return 1;
+	}
+
+	auto rom = RomImage::Load(argv[1]);
+	if (rom == nullptr)
+	{
+		std::cerr << "Cannot read the ROM " << argv[1] << "\n";
+		return 1;
+	}
+
+	auto code = rom->FindSection(EPROM_START);
+	if (code == nullptr)
+	{
+		std::cerr << argv[1] << " has nothing at the start of the EPROM\n";
+		return 1;
+	}
+
+	//an entry point out of the ROM segment runs through --fast anyway
+	auto entry = rom->GetEntryCS() == RESET_CS ? rom->GetEntryIP() : RESET_IP;
+	Recompiler recompiler(*code, entry);
+	recompiler.Explore();
+	if (!recompiler.Write(argv[2], argv[1]))
+	{
+		std::cerr << "Cannot write " << argv[2] << "\n";
+		return 1;
+	}
+
+	recompiler.PrintSummary();
+	return 0;
+}
@@ -0,0 +1,29 @@
+#pragma once
+#include <cstdint>
+
+//bit of every flag in the F register
+#define FLAG_CF 0 //carry
+#define FLAG_ZF 1 //zero
+#define FLAG_SF 2 //sign
+#define FLAG_OF 3 //overflow
+#define FLAG_IF 4 //interrupt
+#define FLAG_US 5 //user/sistem 1=user
+#define FLAGS_MASK 0b111111
+
+#define PHYSICAL_ADDRESS_MASK 0xFFFFF
+
+inline uint32_t ComputePhysicalAddress(uint16_t selector, uint16_t offset)
+{
+	//according to the docs, physical_add = | selector * 16 + offset | mod 2^20
+	return ((selector << 4) + offset) & PHYSICAL_ADDRESS_MASK;
+}
+
+inline uint16_t Concat(uint8_t head, uint8_t tail)
+{
+	return (head << 8) | tail;
+}
+
+inline uint8_t GetPart(uint16_t one, bool high)
+{
+	return high ? one >> 8 : one;
+}
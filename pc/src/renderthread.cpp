@@ -0,0 +1,56 @@
+#include "renderthread.h"
+#include <algorithm>
+#include <chrono>
+
+RenderThread::RenderThread(int fps) : m_drawn(0), m_running(true), m_waiting(false), m_fps(fps), m_thread(&RenderThread::Run, this)
+{
+}
+
+RenderThread::~RenderThread()
+{
+	m_running = false;
+	m_thread.join();
+}
+
+void RenderThread::Publish(const ScreenFrame &frame)
+{
+	m_frames.Write(frame);
+}
+
+void RenderThread::WaitDrawn()
+{
+	auto generation = m_frames.GetGeneration();
+	m_waiting = true;
+	while (m_drawn.load(std::memory_order_acquire) < generation)
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	m_waiting = false;
+}
+
+void RenderThread::Run()
+{
+	//ncurses is only ever called from this thread
+	Printer printer;
+	ScreenFrame frame;
+	auto period = std::chrono::microseconds(1000000 / m_fps);
+	auto next = std::chrono::steady_clock::now();
+	while (m_running)
+	{
+		if (m_frames.GetGeneration() != m_drawn.load(std::memory_order_relaxed))
+		{
+			auto generation = m_frames.Read(frame);
+			printer.Print(frame);
+			m_drawn.store(generation, std::memory_order_release);
+		}
+
+		next += period;
+		auto now = std::chrono::steady_clock::now();
+		while (m_running && !m_waiting && now < next)
+		{
+			std::this_thread::sleep_for(std::min<std::chrono::steady_clock::duration>(next - now, std::chrono::milliseconds(1)));
+			now = std::chrono::steady_clock::now();
+		}
+		next = std::max(next, now);
+	}
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include "printer.h"
+#include "seqlock.h"
+#include <atomic>
+#include <cstdint>
+#include <thread>
+
+//Runs the Printer on its own thread, so that drawing never stalls the emulation. The emulation thread
+//publishes ScreenFrames without waiting, the render thread draws the latest one at most fps times per
+//second and skips the ones published in between
+class RenderThread
+{
+public:
+	RenderThread(int fps);
+	~RenderThread();
+	RenderThread(const RenderThread &) = delete;
+	RenderThread &operator=(const RenderThread &) = delete;
+
+	void Publish(const ScreenFrame &frame);
+	//until the last published frame is on screen, for -d and for the final state
+	void WaitDrawn();
+
+private:
+	SeqLock<ScreenFrame> m_frames;
+	std::atomic<uint64_t> m_drawn;
+	std::atomic<bool> m_running;
+	//someone is in WaitDrawn, draw without waiting for the next period
+	std::atomic<bool> m_waiting;
+	int m_fps;
+	std::thread m_thread;
+
+	void Run();
+};
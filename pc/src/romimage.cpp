@@ -0,0 +1,211 @@
+#include "romimage.h"
+#include "machine.h"
+#include <cstring>
+#include <iostream>
+
+#define TEXT_LINE_DIGITS 8
+
+namespace
+{
+	bool IsBinaryDigit(uint8_t c)
+	{
+		return c == '0' || c == '1';
+	}
+
+	bool ParseText(const std::string &filename, const uint8_t *data, std::size_t size, std::vector<uint8_t> &bytes)
+	{
+		std::size_t line = 1;
+		std::size_t position = 0;
+		while (position < size)
+		{
+			//like std::stoi(line, 0, 2): leading blanks, then the digits up to the first other character
+			while (position < size && (data[position] == ' ' || data[position] == '\t'))
+			{
+				position++;
+			}
+
+			uint8_t value = 0;
+			std::size_t digits = 0;
+			for (; position < size && IsBinaryDigit(data[position]); position++, digits++)
+			{
+				value = (value << 1) | (data[position] - '0');
+			}
+
+			if (digits == 0)
+			{
+				std::cerr << "Line " << line << " of " << filename << " is not a binary number\n";
+				return false;
+			}
+
+			bytes.push_back(value);
+			while (position < size && data[position++] != '\n')
+			{
+			}
+			line++;
+		}
+
+		return true;
+	}
+} // namespace
+
+RomImage::RomImage() : m_entryCS(EPROM_START >> 4), m_entryIP(0)
+{
+}
+
+std::shared_ptr<const RomImage> RomImage::Load(const std::string &filename)
+{
+	std::shared_ptr<RomImage> image(new RomImage());
+	image->m_file = std::make_unique<MappedFile>(filename);
+	auto data = image->m_file->Data();
+	auto size = image->m_file->Size();
+	if (data == nullptr)
+		return nullptr;
+
+	if (size >= sizeof(EXECUTABLE_MAGIC) && std::memcmp(data, EXECUTABLE_MAGIC, sizeof(EXECUTABLE_MAGIC)) == 0)
+		return image->ParseExecutable(filename) ? image : nullptr;
+
+	if (IsTextFormat(data, size))
+	{
+		if (!ParseText(filename, data, size, image->m_bytes))
+			return nullptr;
+
+		image->m_file.reset();
+		data = image->m_bytes.data();
+		size = image->m_bytes.size();
+	}
+
+	image->m_sections.push_back({Executable::SectionType::Code, EPROM_START, data, size});
+	return image;
+}
+
+bool RomImage::ParseExecutable(const std::string &filename)
+{
+	auto data = m_file->Data();
+	auto size = m_file->Size();
+	Executable::Header header;
+	if (size < sizeof(header))
+	{
+		std::cerr << filename << " is truncated\n";
+		return false;
+	}
+
+	std::memcpy(&header, data, sizeof(header));
+	if (header.version != EXECUTABLE_VERSION)
+	{
+		std::cerr << filename << " is an executable of version " << header.version << ", not " << EXECUTABLE_VERSION << "\n";
+		return false;
+	}
+
+	if (size < sizeof(header) + (uint64_t)header.sectionCount * sizeof(Executable::SectionHeader))
+	{
+		std::cerr << filename << " is truncated\n";
+		return false;
+	}
+
+	m_entryCS = header.entryCS;
+	m_entryIP = header.entryIP;
+	for (uint32_t i = 0; i < header.sectionCount; i++)
+	{
+		Executable::SectionHeader section;
+		std::memcpy(&section, data + sizeof(header) + i * sizeof(section), sizeof(section));
+		if ((uint64_t)section.offset + section.size > size)
+		{
+			std::cerr << "Section " << i << " of " << filename << " is out of the file\n";
+			return false;
+		}
+
+		auto content = data + section.offset;
+		switch ((Executable::SectionType)section.type)
+		{
+		case Executable::SectionType::Interrupts:
+			if (section.size % 4 != 0)
+			{
+				std::cerr << "The interrupt table of " << filename << " is not 4 bytes per type\n";
+				return false;
+			}
+			//fall through
+		case Executable::SectionType::Code:
+		case Executable::SectionType::Data:
+			//mapped from the file as they are
+			if (section.offset % EXECUTABLE_ALIGNMENT != 0)
+			{
+				std::cerr << "Section " << i << " of " << filename << " is not aligned to " << EXECUTABLE_ALIGNMENT << " bytes\n";
+				return false;
+			}
+			m_sections.push_back({(Executable::SectionType)section.type, section.address, content, section.size});
+			break;
+		case Executable::SectionType::Symbols:
+			for (uint32_t offset = 0; offset + sizeof(Executable::Symbol) <= section.size; offset += sizeof(Executable::Symbol))
+			{
+				Executable::Symbol symbol;
+				std::memcpy(&symbol, content + offset, sizeof(symbol));
+				m_symbols.push_back({symbol.address, std::string(symbol.name, strnlen(symbol.name, sizeof(symbol.name)))});
+			}
+			break;
+		case Executable::SectionType::Lines:
+			m_lines.resize(section.size / sizeof(Executable::Line));
+			std::memcpy(m_lines.data(), content, m_lines.size() * sizeof(Executable::Line));
+			break;
+		default:
+			//newer section types do not change how the program runs
+			break;
+		}
+	}
+
+	return true;
+}
+
+bool RomImage::IsTextFormat(const uint8_t *data, std::size_t size)
+{
+	std::size_t digits = 0;
+	while (digits < size && IsBinaryDigit(data[digits]))
+	{
+		digits++;
+	}
+
+	if (digits == 0 || digits > TEXT_LINE_DIGITS)
+		return false;
+
+	return digits == size || data[digits] == '\n' || data[digits] == '\r';
+}
+
+const std::vector<RomImage::Section> &RomImage::GetSections() const
+{
+	return m_sections;
+}
+
+const RomImage::Section *RomImage::FindSection(uint32_t address) const
+{
+	for (const auto &section : m_sections)
+	{
+		if (section.address == address)
+			return &section;
+	}
+
+	return nullptr;
+}
+
+uint16_t RomImage::GetEntryCS() const
+{
+	return m_entryCS;
+}
+
+uint16_t RomImage::GetEntryIP() const
+{
+	return m_entryIP;
+}
+
+const std::vector<RomImage::Symbol> &RomImage::GetSymbols() const
+{
+	return m_symbols;
+}
+
+const std::vector<Executable::Line> &RomImage::GetLines() const
+{
+	return m_lines;
+}
+
+bool RomImage::IsMapped() const
+{
+	return m_file != nullptr;
+}
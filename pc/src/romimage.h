@@ -0,0 +1,60 @@
+#pragma once
+#include "mappedfile.h"
+#include "../../common/executable.h"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+//Content of a program file, one of
+//- an ME88 executable, see common/executable.h, with its sections and entry point
+//- a binary ROM, a single code section at EPROM_START
+//- the text format the compiler used to write, one byte per line in binary
+//Executables and binary ROMs are mapped straight from the file and never copied, see MemDevice::MapImage,
+//a text ROM is parsed into memory
+class RomImage
+{
+public:
+	struct Section
+	{
+		Executable::SectionType type;
+		uint32_t address;
+		const uint8_t *data;
+		std::size_t size;
+	};
+
+	struct Symbol
+	{
+		uint32_t address;
+		std::string name;
+	};
+
+	//nullptr if the file cannot be read, is empty or is not valid
+	static std::shared_ptr<const RomImage> Load(const std::string &filename);
+	//a text ROM starts with a line of at most 8 binary digits, anything else is a binary ROM
+	static bool IsTextFormat(const uint8_t *data, std::size_t size);
+
+	//code, data and interrupt sections, everything the memory devices map
+	const std::vector<Section> &GetSections() const;
+	//nullptr if no section starts at address
+	const Section *FindSection(uint32_t address) const;
+	uint16_t GetEntryCS() const;
+	uint16_t GetEntryIP() const;
+	//empty unless the executable has them
+	const std::vector<Symbol> &GetSymbols() const;
+	const std::vector<Executable::Line> &GetLines() const;
+	//false for a text ROM
+	bool IsMapped() const;
+
+private:
+	std::unique_ptr<MappedFile> m_file;
+	std::vector<uint8_t> m_bytes;
+	std::vector<Section> m_sections;
+	uint16_t m_entryCS;
+	uint16_t m_entryIP;
+	std::vector<Symbol> m_symbols;
+	std::vector<Executable::Line> m_lines;
+
+	RomImage();
+	bool ParseExecutable(const std::string &filename);
+};
@@ -0,0 +1,78 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <type_traits>
+
+//One writer and any number of readers of a trivially copyable value. The writer never waits and never
+//allocates, a reader copies again when a write happened in the middle of its copy. The value is stored
+//as words written and read with relaxed atomics, so that a copy racing with a write is only wasted
+//instead of being a data race
+template <typename T>
+class SeqLock
+{
+	static_assert(std::is_trivially_copyable<T>::value, "the value is copied as raw words");
+
+public:
+	SeqLock() : m_sequence(0)
+	{
+		for (auto &word : m_words)
+		{
+			word.store(0, std::memory_order_relaxed);
+		}
+	}
+
+	void Write(const T &value)
+	{
+		auto sequence = m_sequence.load(std::memory_order_relaxed);
+		m_sequence.store(sequence + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		auto bytes = (const uint8_t *)&value;
+		for (std::size_t i = 0; i < WORDS; i++)
+		{
+			uint64_t word = 0;
+			std::memcpy(&word, bytes + i * 8, std::min<std::size_t>(8, sizeof(T) - i * 8));
+			m_words[i].store(word, std::memory_order_relaxed);
+		}
+		m_sequence.store(sequence + 2, std::memory_order_release);
+	}
+
+	//the generation of the value, see GetGeneration
+	uint64_t Read(T &value) const
+	{
+		uint64_t words[WORDS];
+		while (true)
+		{
+			auto before = m_sequence.load(std::memory_order_acquire);
+			if (before & 1)
+			{
+				std::this_thread::yield();
+				continue;
+			}
+
+			for (std::size_t i = 0; i < WORDS; i++)
+			{
+				words[i] = m_words[i].load(std::memory_order_relaxed);
+			}
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (m_sequence.load(std::memory_order_relaxed) == before)
+			{
+				std::memcpy(&value, words, sizeof(T));
+				return before / 2;
+			}
+		}
+	}
+
+	//number of completed writes
+	uint64_t GetGeneration() const
+	{
+		return m_sequence.load(std::memory_order_acquire) / 2;
+	}
+
+private:
+	static const std::size_t WORDS = (sizeof(T) + 7) / 8;
+	std::atomic<uint64_t> m_sequence;
+	std::atomic<uint64_t> m_words[WORDS];
+};
@@ -0,0 +1,181 @@
+#include "snapshot.h"
+#include "mappedfile.h"
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <type_traits>
+
+namespace
+{
+	struct Header
+	{
+		char magic[8];
+		uint32_t version;
+		uint32_t deviceCount;
+		uint32_t seed;
+		uint32_t pageSize;
+		CPU::State cpu;
+	};
+
+	struct DeviceEntry
+	{
+		uint32_t from;
+		uint32_t to;
+		uint32_t pages;
+		uint32_t firstPage;
+	};
+
+	const std::size_t BITMAP_SIZE = sizeof(MemDevice::Page::initialized);
+
+	static_assert(std::is_trivially_copyable<CPU::State>::value && sizeof(CPU::State) == 64, "CPU::State is stored as it is, change VERSION with it");
+
+	std::size_t AlignToPage(std::size_t offset)
+	{
+		return (offset + MemDevice::PAGE_SIZE - 1) & ~(std::size_t)(MemDevice::PAGE_SIZE - 1);
+	}
+} // namespace
+
+bool Snapshot::Save(const std::string &filename, const CPU &cpu, const std::vector<MemDevice *> &devices, uint32_t seed)
+{
+	std::ofstream file(filename, std::ios::binary);
+	if (!file.is_open())
+	{
+		std::cerr << "Cannot write the snapshot " << filename << "\n";
+		return false;
+	}
+
+	Header header = {};
+	std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+	header.version = VERSION;
+	header.deviceCount = devices.size();
+	header.seed = seed;
+	header.pageSize = MemDevice::PAGE_SIZE;
+	header.cpu = cpu.GetState();
+
+	//only the pages that were touched
+	std::vector<DeviceEntry> entries;
+	std::vector<uint32_t> index;
+	std::vector<const MemDevice::Page *> pages;
+	for (auto device : devices)
+	{
+		DeviceEntry entry = {(uint32_t)device->GetFrom(), (uint32_t)device->GetTo(), 0, (uint32_t)pages.size()};
+		for (std::size_t i = 0; i < device->GetPageCount(); i++)
+		{
+			auto page = device->GetPageAt(i);
+			if (page == nullptr || page->IsEmpty())
+				continue;
+
+			index.push_back(i);
+			pages.push_back(page);
+			entry.pages++;
+		}
+		entries.push_back(entry);
+	}
+
+	file.write((const char *)&header, sizeof(header));
+	file.write((const char *)entries.data(), entries.size() * sizeof(DeviceEntry));
+	file.write((const char *)index.data(), index.size() * sizeof(uint32_t));
+
+	auto position = sizeof(header) + entries.size() * sizeof(DeviceEntry) + index.size() * sizeof(uint32_t);
+	std::vector<char> padding(AlignToPage(position) - position, 0);
+	file.write(padding.data(), padding.size());
+
+	for (auto page : pages)
+	{
+		file.write((const char *)page->data, MemDevice::PAGE_SIZE);
+	}
+	for (auto page : pages)
+	{
+		file.write((const char *)page->initialized, BITMAP_SIZE);
+	}
+
+	if (!file)
+	{
+		std::cerr << "Cannot write the snapshot " << filename << "\n";
+		return false;
+	}
+
+	return true;
+}
+
+bool Snapshot::Load(const std::string &filename, CPU &cpu, const std::vector<MemDevice *> &devices, uint32_t &seed)
+{
+	MappedFile file(filename);
+	auto data = file.Data();
+	if (data == nullptr || file.Size() < sizeof(Header))
+	{
+		std::cerr << "Cannot read the snapshot " << filename << "\n";
+		return false;
+	}
+
+	Header header;
+	std::memcpy(&header, data, sizeof(header));
+	if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != VERSION || header.pageSize != MemDevice::PAGE_SIZE)
+	{
+		std::cerr << filename << " is not a snapshot of version " << VERSION << "\n";
+		return false;
+	}
+
+	if (header.deviceCount != devices.size() || file.Size() < sizeof(Header) + header.deviceCount * sizeof(DeviceEntry))
+	{
+		std::cerr << "The snapshot " << filename << " was taken with different memory devices\n";
+		return false;
+	}
+
+	std::vector<DeviceEntry> entries(header.deviceCount);
+	std::memcpy(entries.data(), data + sizeof(Header), entries.size() * sizeof(DeviceEntry));
+	std::size_t totalPages = 0;
+	for (std::size_t d = 0; d < devices.size(); d++)
+	{
+		const auto &entry = entries[d];
+		if (entry.from != (uint32_t)devices[d]->GetFrom() || entry.to != (uint32_t)devices[d]->GetTo() || entry.firstPage != totalPages)
+		{
+			std::cerr << "The snapshot " << filename << " was taken with different memory devices\n";
+			return false;
+		}
+		totalPages += entry.pages;
+	}
+
+	auto indexOffset = sizeof(Header) + entries.size() * sizeof(DeviceEntry);
+	auto dataOffset = AlignToPage(indexOffset + totalPages * sizeof(uint32_t));
+	auto bitmapsOffset = dataOffset + totalPages * MemDevice::PAGE_SIZE;
+	if (file.Size() < bitmapsOffset + totalPages * BITMAP_SIZE)
+	{
+		std::cerr << "The snapshot " << filename << " is truncated\n";
+		return false;
+	}
+
+	std::vector<uint32_t> index(totalPages);
+	std::memcpy(index.data(), data + indexOffset, totalPages * sizeof(uint32_t));
+	for (std::size_t d = 0; d < devices.size(); d++)
+	{
+		for (uint32_t p = entries[d].firstPage; p < entries[d].firstPage + entries[d].pages; p++)
+		{
+			if (index[p] >= devices[d]->GetPageCount())
+			{
+				std::cerr << "The snapshot " << filename << " is corrupted\n";
+				return false;
+			}
+		}
+	}
+
+	if (!cpu.SetState(header.cpu))
+	{
+		std::cerr << "The snapshot " << filename << " is corrupted, or it was taken in the middle of an instruction and can only be restored without --fast\n";
+		return false;
+	}
+
+	for (std::size_t d = 0; d < devices.size(); d++)
+	{
+		devices[d]->ClearPages();
+		for (uint32_t p = entries[d].firstPage; p < entries[d].firstPage + entries[d].pages; p++)
+		{
+			auto page = devices[d]->AllocatePageAt(index[p]);
+			std::memcpy(page->data, data + dataOffset + (std::size_t)p * MemDevice::PAGE_SIZE, MemDevice::PAGE_SIZE);
+			std::memcpy(page->initialized, data + bitmapsOffset + p * BITMAP_SIZE, BITMAP_SIZE);
+		}
+	}
+
+	seed = header.seed;
+	return true;
+}
@@ -0,0 +1,27 @@
+#pragma once
+#include "cpu.h"
+#include "memdevice.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+//Machine snapshot: the registers of the processor and the pages of every memory device.
+//
+//	header   "ME88SNP" version deviceCount seed pageSize CPU::State
+//	devices  from to pages firstPage for every device
+//	index    page index inside its device for every saved page
+//	data     PAGE_SIZE bytes for every saved page, aligned to PAGE_SIZE
+//	bitmaps  the initialized bits for every saved page
+//
+//The file is mapped on restore and the pages are copied straight out of the mapping.
+//Values are stored in the byte order of the host.
+namespace Snapshot
+{
+	const char MAGIC[8] = "ME88SNP";
+	const uint32_t VERSION = 2;
+
+	//devices in registration order, the seed is the one of the fill values
+	bool Save(const std::string &filename, const CPU &cpu, const std::vector<MemDevice *> &devices, uint32_t seed);
+	//the devices must have the same ranges of the saved ones
+	bool Load(const std::string &filename, CPU &cpu, const std::vector<MemDevice *> &devices, uint32_t &seed);
+} // namespace Snapshot
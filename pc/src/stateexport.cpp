@@ -0,0 +1,147 @@
+#include "stateexport.h"
+#include "machine.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <fcntl.h>
+#include <new>
+#include <sys/mman.h>
+#include <unistd.h>
+
+//the SeqLocks are laid over the sequence numbers and the blocks of the segment
+static_assert(sizeof(SeqLock<SharedState::Registers>) == sizeof(uint64_t) + sizeof(SharedState::Registers) &&
+									offsetof(SharedState::Segment, registers) == offsetof(SharedState::Segment, registersSequence) + sizeof(uint64_t),
+							"SeqLock<Registers> does not match the segment");
+static_assert(sizeof(SeqLock<SharedState::Video>) == sizeof(uint64_t) + sizeof(SharedState::Video) &&
+									offsetof(SharedState::Segment, video) == offsetof(SharedState::Segment, videoSequence) + sizeof(uint64_t),
+							"SeqLock<Video> does not match the segment");
+static_assert(SHARED_STATE_VIDEO_SIZE == VID_MEM_END - VID_MEM_START + 1, "Video is the whole video memory");
+
+StateExport::StateExport(const std::string &name, const CPU &proc, const MemDevice &videoMem)
+		: m_name(name), m_proc(proc), m_videoMem(videoMem), m_videoCopy{}
+{
+	//never shares an object with another emulator, or with the layout of an older SHARED_STATE_VERSION
+	auto fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+	if (fd < 0)
+	{
+		m_error = errno;
+		return;
+	}
+
+	if (ftruncate(fd, sizeof(SharedState::Segment)) == 0)
+	{
+		auto address = mmap(nullptr, sizeof(SharedState::Segment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		if (address != MAP_FAILED)
+		{
+			m_segment = (SharedState::Segment *)address;
+		}
+	}
+	m_error = errno;
+	close(fd);
+
+	if (m_segment == nullptr)
+	{
+		shm_unlink(name.c_str());
+		return;
+	}
+
+	//the new object is zero filled, the magic is written last
+	m_error = 0;
+	m_registers = new ((char *)m_segment + offsetof(SharedState::Segment, registersSequence)) SeqLock<SharedState::Registers>();
+	m_video = new ((char *)m_segment + offsetof(SharedState::Segment, videoSequence)) SeqLock<SharedState::Video>();
+
+	auto &header = m_segment->header;
+	header.version = SHARED_STATE_VERSION;
+	header.size = sizeof(SharedState::Segment);
+	header.videoAddress = videoMem.GetFrom();
+	header.videoSize = SHARED_STATE_VIDEO_SIZE;
+	header.pid = getpid();
+	header.reserved = 0;
+	std::atomic_thread_fence(std::memory_order_release);
+	std::memcpy(header.magic, SHARED_STATE_MAGIC, sizeof(header.magic));
+
+	PublishAll();
+}
+
+StateExport::~StateExport()
+{
+	if (m_segment == nullptr)
+		return;
+
+	munmap(m_segment, sizeof(SharedState::Segment));
+	shm_unlink(m_name.c_str());
+}
+
+bool StateExport::IsOpen() const
+{
+	return m_segment != nullptr;
+}
+
+int StateExport::GetError() const
+{
+	return m_error;
+}
+
+void StateExport::PublishAll()
+{
+	PublishRegisters();
+	PublishVideo();
+}
+
+void StateExport::PublishRegisters()
+{
+	m_registersCountdown = EXPORT_REGISTERS_STEPS;
+	auto state = m_proc.GetState();
+	SharedState::Registers registers = {};
+	registers.cycles = state.cycles;
+	registers.instructions = state.instructions;
+	registers.mar = state.mar;
+	registers.cs = state.cs;
+	registers.ip = state.ip;
+	registers.ss = state.ss;
+	registers.sp = state.sp;
+	registers.ds = state.ds;
+	registers.di = state.di;
+	registers.destSel = state.destSel;
+	registers.destOff = state.destOff;
+	registers.star = state.star;
+	registers.mjr = state.mjr;
+	registers.d7d0 = state.d7d0;
+	registers.opcode = state.opcode;
+	registers.source = state.source;
+	registers.al = state.al;
+	registers.ah = state.ah;
+	registers.mbr = state.mbr;
+	registers.flags = state.f;
+	registers.mr_ = state.mr_;
+	registers.mw_ = state.mw_;
+	registers.ior_ = state.ior_;
+	registers.iow_ = state.iow_;
+	registers.halted = m_proc.IsHalted();
+	m_registers->Write(registers);
+}
+
+void StateExport::PublishVideo()
+{
+	m_videoCountdown = EXPORT_VIDEO_STEPS / EXPORT_REGISTERS_STEPS;
+
+	//the pages never written stay zero
+	for (int offset = 0; offset < SHARED_STATE_VIDEO_SIZE; offset += MemDevice::PAGE_SIZE)
+	{
+		auto page = m_videoMem.GetPageAt(offset >> MemDevice::PAGE_BITS);
+		auto size = std::min(SHARED_STATE_VIDEO_SIZE - offset, (int)MemDevice::PAGE_SIZE);
+		if (page == nullptr)
+		{
+			std::memset(m_videoCopy.data + offset, 0, size);
+			std::memset(m_videoCopy.initialized + offset / 64, 0, size / 8);
+		}
+		else
+		{
+			std::memcpy(m_videoCopy.data + offset, page->data, size);
+			std::memcpy(m_videoCopy.initialized + offset / 64, page->initialized, size / 8);
+		}
+	}
+
+	m_video->Write(m_videoCopy);
+}
@@ -0,0 +1,57 @@
+#pragma once
+#include "../../common/sharedstate.h"
+#include "cpu.h"
+#include "memdevice.h"
+#include "seqlock.h"
+#include <string>
+
+//steps between two copies of the registers and of the video memory to the shared segment
+#define EXPORT_REGISTERS_STEPS 256
+#define EXPORT_VIDEO_STEPS 65536
+
+//Publishes the registers and the video memory to a POSIX shared memory object for the monitors running
+//in other processes, see common/sharedstate.h. The object is removed when the export goes out of scope
+class StateExport
+{
+public:
+	//name like "/me88", see shm_open
+	StateExport(const std::string &name, const CPU &proc, const MemDevice &videoMem);
+	~StateExport();
+	StateExport(const StateExport &) = delete;
+	StateExport &operator=(const StateExport &) = delete;
+
+	bool IsOpen() const;
+	//the errno of the failure when it is not open, EEXIST if the object already exists
+	int GetError() const;
+	//after every step. Only one call in EXPORT_REGISTERS_STEPS writes the registers, writing them after
+	//every clock cycle slows Processor down to a third
+	void Publish()
+	{
+		if (--m_registersCountdown == 0)
+		{
+			PublishRegisters();
+			if (--m_videoCountdown == 0)
+			{
+				PublishVideo();
+			}
+		}
+	}
+	//everything, when the run stops
+	void PublishAll();
+
+private:
+	std::string m_name;
+	const CPU &m_proc;
+	const MemDevice &m_videoMem;
+	SharedState::Segment *m_segment = nullptr;
+	int m_error = 0;
+	//both live in m_segment, over the sequence and the block following it
+	SeqLock<SharedState::Registers> *m_registers = nullptr;
+	SeqLock<SharedState::Video> *m_video = nullptr;
+	SharedState::Video m_videoCopy;
+	int m_registersCountdown = EXPORT_REGISTERS_STEPS;
+	int m_videoCountdown = EXPORT_VIDEO_STEPS / EXPORT_REGISTERS_STEPS;
+
+	void PublishRegisters();
+	void PublishVideo();
+};
@@ -0,0 +1,86 @@
+#include "threadpool.h"
+#include <algorithm>
+#include <thread>
+
+WorkStealingPool::WorkStealingPool(std::size_t threads) : m_threads(threads)
+{
+	if (m_threads == 0)
+	{
+		m_threads = std::max(1u, std::thread::hardware_concurrency());
+	}
+
+	for (std::size_t i = 0; i < m_threads; i++)
+	{
+		m_queues.push_back(std::make_unique<Queue>());
+	}
+}
+
+std::size_t WorkStealingPool::GetThreadCount() const
+{
+	return m_threads;
+}
+
+void WorkStealingPool::Run(std::size_t count, const std::function<void(std::size_t)> &task)
+{
+	for (std::size_t worker = 0; worker < m_threads; worker++)
+	{
+		auto &tasks = m_queues[worker]->tasks;
+		tasks.clear();
+		for (std::size_t i = count * worker / m_threads; i < count * (worker + 1) / m_threads; i++)
+		{
+			tasks.push_back(i);
+		}
+	}
+
+	//the calling thread is worker 0
+	std::vector<std::thread> threads;
+	for (std::size_t worker = 1; worker < m_threads; worker++)
+	{
+		threads.emplace_back(&WorkStealingPool::Work, this, worker, std::cref(task));
+	}
+	Work(0, task);
+
+	for (auto &thread : threads)
+	{
+		thread.join();
+	}
+}
+
+void WorkStealingPool::Work(std::size_t worker, const std::function<void(std::size_t)> &task)
+{
+	//no task is ever added while running, so empty deques everywhere means done
+	std::size_t index;
+	while (Pop(worker, index) || Steal(worker, index))
+	{
+		task(index);
+	}
+}
+
+bool WorkStealingPool::Pop(std::size_t worker, std::size_t &task)
+{
+	auto &queue = *m_queues[worker];
+	std::lock_guard<std::mutex> lock(queue.mutex);
+	if (queue.tasks.empty())
+		return false;
+
+	task = queue.tasks.back();
+	queue.tasks.pop_back();
+	return true;
+}
+
+bool WorkStealingPool::Steal(std::size_t worker, std::size_t &task)
+{
+	for (std::size_t i = 1; i < m_threads; i++)
+	{
+		auto &queue = *m_queues[(worker + i) % m_threads];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (queue.tasks.empty())
+			continue;
+
+		task = queue.tasks.front();
+		queue.tasks.pop_front();
+		return true;
+	}
+
+	return false;
+}
@@ -0,0 +1,34 @@
+#pragma once
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+//Runs a fixed set of independent tasks on a set of workers. Every worker starts with a contiguous
+//range of tasks in its own deque, takes them from the back and, once it runs out, steals from the
+//front of the other deques, so long and short tasks even out without a central queue.
+class WorkStealingPool
+{
+public:
+	//0 means one worker per hardware thread
+	WorkStealingPool(std::size_t threads = 0);
+	std::size_t GetThreadCount() const;
+	//calls task for every index in [0, count) and returns when all of them are done
+	void Run(std::size_t count, const std::function<void(std::size_t)> &task);
+
+private:
+	struct Queue
+	{
+		std::mutex mutex;
+		std::deque<std::size_t> tasks;
+	};
+
+	std::size_t m_threads;
+	std::vector<std::unique_ptr<Queue>> m_queues;
+
+	void Work(std::size_t worker, const std::function<void(std::size_t)> &task);
+	bool Pop(std::size_t worker, std::size_t &task);
+	bool Steal(std::size_t worker, std::size_t &task);
+};
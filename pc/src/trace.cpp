@@ -0,0 +1,53 @@
+#include "trace.h"
+#include <bitset>
+#include <sstream>
+
+Trace::Trace(std::size_t capacity) : m_next(0)
+{
+	std::size_t size = 1;
+	while (size < capacity)
+	{
+		size <<= 1;
+	}
+
+	m_records.resize(size);
+	m_mask = size - 1;
+}
+
+void Trace::Clear()
+{
+	m_next = 0;
+}
+
+std::size_t Trace::Size() const
+{
+	return m_next < m_records.size() ? m_next : m_records.size();
+}
+
+const Trace::Record &Trace::Get(std::size_t index) const
+{
+	return m_records[(m_next - Size() + index) & m_mask];
+}
+
+std::vector<std::string> Trace::Format(std::size_t count) const
+{
+	std::vector<std::string> lines;
+	auto size = Size();
+	auto first = count < size ? size - count : 0;
+	for (auto i = first; i < size; i++)
+	{
+		lines.push_back(Format(Get(i)));
+	}
+
+	return lines;
+}
+
+std::string Trace::Format(const Record &record)
+{
+	std::stringstream stream;
+	stream << record.cycle << " ";
+	stream << (record.direction == Direction::Read ? "Reading: " : "Writing: ");
+	stream << std::bitset<20>(record.address) << " " << std::bitset<8>(record.data);
+	stream << " device " << (int)record.device;
+	return stream.str();
+}
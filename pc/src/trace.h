@@ -0,0 +1,47 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+//Fixed capacity ring buffer of the bus transactions, the oldest records are overwritten.
+//Records are formatted only when someone asks for them.
+class Trace
+{
+public:
+	static const std::size_t DEFAULT_CAPACITY = 4096;
+
+	enum class Direction : uint8_t
+	{
+		Read,
+		Write
+	};
+
+	struct Record
+	{
+		uint64_t cycle;
+		uint32_t address;
+		uint8_t data;
+		Direction direction;
+		int8_t device; //index of the device in registration order, -1 for the open bus
+	};
+
+	//capacity is rounded up to a power of two
+	Trace(std::size_t capacity = DEFAULT_CAPACITY);
+	void Add(const Record &record)
+	{
+		m_records[m_next & m_mask] = record;
+		m_next++;
+	}
+	void Clear();
+	std::size_t Size() const;
+	//index 0 is the oldest record still in the buffer
+	const Record &Get(std::size_t index) const;
+	//the last count records, oldest first
+	std::vector<std::string> Format(std::size_t count) const;
+	static std::string Format(const Record &record);
+
+private:
+	std::vector<Record> m_records;
+	std::size_t m_mask;
+	uint64_t m_next;
+};
@@ -0,0 +1,50 @@
+#include "microcode.h"
+#include "tracefile.h"
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+#include <string>
+
+//prints the cycles of a trace file written with ME88 --trace-file
+int main(int argc, char *argv[])
+{
+	if (argc < 2 || argc > 4)
+	{
+		std::cout << "usage: ME88TraceDump file [fromCycle [count]]\n";
+		return 1;
+	}
+
+	TraceReader reader(argv[1]);
+	if (!reader.IsOpen())
+	{
+		std::cerr << "Cannot read the trace file " << argv[1] << "\n";
+		return 1;
+	}
+
+	uint64_t from = argc > 2 ? std::stoull(argv[2]) : reader.GetFirstCycle();
+	uint64_t count = argc > 3 ? std::stoull(argv[3]) : reader.GetLastCycle() - from + 1;
+	std::cout << "cycles " << reader.GetFirstCycle() << " .. " << reader.GetLastCycle() << "\n";
+
+	//one block at a time, so that a whole trace is never kept in memory
+	while (count > 0)
+	{
+		auto records = reader.Read(from, std::min<uint64_t>(count, TraceFile::BLOCK_CYCLES));
+		if (records.empty())
+			break;
+
+		for (const auto &record : records)
+		{
+			printf("%12llu STAR=%3d %-10s %04X:%04X", (unsigned long long)record.cycle, record.star, GetStarName((Star)record.star), record.cs, record.ip);
+			if (record.read)
+				printf("  R %05X=%02X", record.readAddress, record.readData);
+			if (record.write)
+				printf("  W %05X=%02X", record.writeAddress, record.writeData);
+			printf("\n");
+		}
+
+		from = records.back().cycle + 1;
+		count -= records.size();
+	}
+
+	return 0;
+}
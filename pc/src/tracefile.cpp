@@ -0,0 +1,376 @@
+#include "tracefile.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <zlib.h>
+
+#define FLAG_READ 0b0001
+#define FLAG_WRITE 0b0010
+#define FLAG_CS 0b0100
+#define FLAG_IP 0b1000
+
+namespace
+{
+	void PutVarint(std::vector<uint8_t> &data, uint64_t value)
+	{
+		while (value >= 0x80)
+		{
+			data.push_back(value | 0x80);
+			value >>= 7;
+		}
+		data.push_back(value);
+	}
+
+	//small negative deltas become small numbers as well
+	void PutDelta(std::vector<uint8_t> &data, int64_t delta)
+	{
+		PutVarint(data, ((uint64_t)delta << 1) ^ (uint64_t)(delta >> 63));
+	}
+
+	uint64_t GetVarint(const uint8_t *&data, const uint8_t *end)
+	{
+		uint64_t value = 0;
+		int shift = 0;
+		while (data < end)
+		{
+			auto byte = *data++;
+			value |= (uint64_t)(byte & 0x7F) << shift;
+			if (!(byte & 0x80))
+				break;
+			shift += 7;
+		}
+		return value;
+	}
+
+	int64_t GetDelta(const uint8_t *&data, const uint8_t *end)
+	{
+		auto value = GetVarint(data, end);
+		return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+	}
+
+	template <typename T>
+	void WriteValue(std::ofstream &file, const T &value)
+	{
+		file.write((const char *)&value, sizeof(T));
+	}
+
+	template <typename T>
+	bool ReadValue(std::ifstream &file, T &value)
+	{
+		return (bool)file.read((char *)&value, sizeof(T));
+	}
+} // namespace
+
+TraceWriter::TraceWriter(const std::string &filename) : m_file(filename, std::ios::binary), m_closing(false), m_failed(false)
+{
+	m_current = {};
+	m_previous = {};
+	m_block = {};
+	if (!m_file.is_open())
+		return;
+
+	m_file.write(TraceFile::MAGIC, sizeof(TraceFile::MAGIC));
+	WriteValue(m_file, TraceFile::VERSION);
+	WriteValue(m_file, TraceFile::BLOCK_CYCLES);
+
+	m_thread = std::thread(&TraceWriter::WriterLoop, this);
+}
+
+TraceWriter::~TraceWriter()
+{
+	if (!m_file.is_open())
+		return;
+
+	Flush();
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_closing = true;
+	}
+	m_condition.notify_all();
+	m_thread.join();
+	if (m_failed)
+	{
+		std::cerr << "Cannot compress a trace block, the trace file keeps the first " << m_index.size() << " blocks\n";
+	}
+
+	uint64_t indexOffset = m_file.tellp();
+	for (const auto &entry : m_index)
+	{
+		WriteValue(m_file, entry.firstCycle);
+		WriteValue(m_file, entry.offset);
+		WriteValue(m_file, entry.records);
+	}
+	WriteValue(m_file, indexOffset);
+	WriteValue(m_file, (uint64_t)m_index.size());
+	m_file.write(TraceFile::INDEX_MAGIC, sizeof(TraceFile::INDEX_MAGIC));
+}
+
+bool TraceWriter::IsOpen() const
+{
+	return m_file.is_open();
+}
+
+void TraceWriter::OnRead(uint32_t address, uint8_t data)
+{
+	m_current.read = true;
+	m_current.readAddress = address;
+	m_current.readData = data;
+}
+
+void TraceWriter::OnWrite(uint32_t address, uint8_t data)
+{
+	m_current.write = true;
+	m_current.writeAddress = address;
+	m_current.writeData = data;
+}
+
+void TraceWriter::OnClock(uint64_t cycle, uint8_t star, uint16_t cs, uint16_t ip)
+{
+	if (m_block.records == 0)
+	{
+		m_block.firstCycle = cycle;
+		m_previous = {};
+	}
+
+	m_current.cycle = cycle;
+	m_current.star = star;
+	m_current.cs = cs;
+	m_current.ip = ip;
+	Encode(m_current);
+	m_block.records++;
+	m_current.read = false;
+	m_current.write = false;
+
+	if (m_block.records == TraceFile::BLOCK_CYCLES)
+	{
+		Flush();
+	}
+}
+
+void TraceWriter::Encode(const TraceFile::Record &record)
+{
+	auto &data = m_block.data;
+	uint8_t flags = (record.read ? FLAG_READ : 0) | (record.write ? FLAG_WRITE : 0) |
+									(record.cs != m_previous.cs ? FLAG_CS : 0) | (record.ip != m_previous.ip ? FLAG_IP : 0);
+	data.push_back(record.star);
+	data.push_back(flags);
+
+	if (flags & FLAG_CS)
+	{
+		data.push_back(record.cs);
+		data.push_back(record.cs >> 8);
+	}
+
+	if (flags & FLAG_IP)
+	{
+		PutDelta(data, (int16_t)(record.ip - m_previous.ip));
+	}
+
+	//the previous address is the one of the last transaction, read or write
+	uint32_t address = m_previous.readAddress;
+	if (record.read)
+	{
+		PutDelta(data, (int64_t)record.readAddress - address);
+		data.push_back(record.readData);
+		address = record.readAddress;
+	}
+
+	if (record.write)
+	{
+		PutDelta(data, (int64_t)record.writeAddress - address);
+		data.push_back(record.writeData);
+		address = record.writeAddress;
+	}
+
+	m_previous.cs = record.cs;
+	m_previous.ip = record.ip;
+	m_previous.readAddress = address;
+}
+
+void TraceWriter::Flush()
+{
+	if (m_block.records == 0)
+		return;
+
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_condition.wait(lock, [this] { return m_pending.size() < MAX_PENDING_BLOCKS; });
+	m_pending.push_back(std::move(m_block));
+	lock.unlock();
+	m_condition.notify_all();
+
+	m_block = {};
+}
+
+void TraceWriter::WriterLoop()
+{
+	while (true)
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_condition.wait(lock, [this] { return !m_pending.empty() || m_closing; });
+		if (m_pending.empty())
+			return;
+
+		auto block = std::move(m_pending.front());
+		m_pending.pop_front();
+		lock.unlock();
+		m_condition.notify_all();
+
+		WriteBlock(block);
+	}
+}
+
+void TraceWriter::WriteBlock(const Block &block)
+{
+	uLongf compressedSize = compressBound(block.data.size());
+	std::vector<uint8_t> compressed(compressedSize);
+	//after a failure the blocks are dropped, the index covers the ones written before it
+	if (m_failed || compress2(compressed.data(), &compressedSize, block.data.data(), block.data.size(), Z_BEST_SPEED) != Z_OK)
+	{
+		m_failed = true;
+		return;
+	}
+
+	m_index.push_back({block.firstCycle, (uint64_t)m_file.tellp(), block.records});
+	WriteValue(m_file, block.firstCycle);
+	WriteValue(m_file, block.records);
+	WriteValue(m_file, (uint32_t)block.data.size());
+	WriteValue(m_file, (uint32_t)compressedSize);
+	m_file.write((const char *)compressed.data(), compressedSize);
+}
+
+TraceReader::TraceReader(const std::string &filename) : m_file(filename, std::ios::binary), m_valid(false)
+{
+	char magic[sizeof(TraceFile::MAGIC)];
+	uint32_t version, blockCycles;
+	if (!m_file.read(magic, sizeof(magic)) || std::memcmp(magic, TraceFile::MAGIC, sizeof(magic)) != 0 ||
+			!ReadValue(m_file, version) || version != TraceFile::VERSION || !ReadValue(m_file, blockCycles))
+		return;
+
+	uint64_t indexOffset, blocks;
+	m_file.seekg(-(std::streamoff)(2 * sizeof(uint64_t) + sizeof(TraceFile::INDEX_MAGIC)), std::ios::end);
+	if (!ReadValue(m_file, indexOffset) || !ReadValue(m_file, blocks) || !m_file.read(magic, sizeof(magic)) ||
+			std::memcmp(magic, TraceFile::INDEX_MAGIC, sizeof(magic)) != 0)
+		return;
+
+	m_file.seekg(indexOffset);
+	m_index.resize(blocks);
+	for (auto &entry : m_index)
+	{
+		if (!ReadValue(m_file, entry.firstCycle) || !ReadValue(m_file, entry.offset) || !ReadValue(m_file, entry.records))
+			return;
+	}
+
+	m_valid = true;
+}
+
+bool TraceReader::IsOpen() const
+{
+	return m_valid;
+}
+
+uint64_t TraceReader::GetFirstCycle() const
+{
+	return m_index.empty() ? 0 : m_index.front().firstCycle;
+}
+
+uint64_t TraceReader::GetLastCycle() const
+{
+	return m_index.empty() ? 0 : m_index.back().firstCycle + m_index.back().records - 1;
+}
+
+std::vector<TraceFile::Record> TraceReader::Read(uint64_t from, uint64_t count)
+{
+	std::vector<TraceFile::Record> result;
+
+	//last block starting at or before from
+	auto it = std::upper_bound(m_index.begin(), m_index.end(), from,
+														 [](uint64_t cycle, const TraceFile::BlockIndex &entry) { return cycle < entry.firstCycle; });
+	std::size_t block = it == m_index.begin() ? 0 : it - m_index.begin() - 1;
+
+	std::vector<TraceFile::Record> records;
+	for (; block < m_index.size() && result.size() < count; block++)
+	{
+		if (!ReadBlock(block, records))
+			break;
+
+		for (const auto &record : records)
+		{
+			if (record.cycle >= from && result.size() < count)
+			{
+				result.push_back(record);
+			}
+		}
+	}
+
+	return result;
+}
+
+bool TraceReader::ReadBlock(std::size_t block, std::vector<TraceFile::Record> &records)
+{
+	uint64_t firstCycle;
+	uint32_t count, rawSize, compressedSize;
+	m_file.clear();
+	m_file.seekg(m_index[block].offset);
+	if (!ReadValue(m_file, firstCycle) || !ReadValue(m_file, count) || !ReadValue(m_file, rawSize) ||
+			!ReadValue(m_file, compressedSize))
+		return false;
+
+	std::vector<uint8_t> compressed(compressedSize);
+	std::vector<uint8_t> raw(rawSize);
+	uLongf size = rawSize;
+	if (!m_file.read((char *)compressed.data(), compressedSize) ||
+			uncompress(raw.data(), &size, compressed.data(), compressedSize) != Z_OK)
+		return false;
+
+	records.clear();
+	TraceFile::Record previous = {};
+	const uint8_t *data = raw.data();
+	const uint8_t *end = data + size;
+	for (uint32_t i = 0; i < count && data + 2 <= end; i++)
+	{
+		TraceFile::Record record = {};
+		record.cycle = firstCycle + i;
+		record.star = *data++;
+		auto flags = *data++;
+		record.cs = previous.cs;
+		record.ip = previous.ip;
+
+		if ((flags & FLAG_CS) && data + 2 <= end)
+		{
+			record.cs = data[0] | (data[1] << 8);
+			data += 2;
+		}
+
+		if (flags & FLAG_IP)
+		{
+			record.ip = previous.ip + GetDelta(data, end);
+		}
+
+		uint32_t address = previous.readAddress;
+		if ((flags & FLAG_READ) && data < end)
+		{
+			record.read = true;
+			record.readAddress = address + GetDelta(data, end);
+			if (data >= end)
+				break;
+			record.readData = *data++;
+			address = record.readAddress;
+		}
+
+		if ((flags & FLAG_WRITE) && data < end)
+		{
+			record.write = true;
+			record.writeAddress = address + GetDelta(data, end);
+			if (data >= end)
+				break;
+			record.writeData = *data++;
+			address = record.writeAddress;
+		}
+
+		previous = record;
+		previous.readAddress = address;
+		records.push_back(record);
+	}
+
+	return true;
+}
@@ -0,0 +1,110 @@
+#pragma once
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+//Execution trace file: one record per clock cycle with the microstate, CS:IP and the bus transactions.
+//
+//	header   "ME88TRC" version blockCycles
+//	blocks   firstCycle records rawSize compressedSize, zlib compressed records
+//	index    firstCycle offset records for every block
+//	footer   indexOffset blocks "ME88IDX"
+//
+//Inside a block every record is delta encoded against the previous one, and the first record of a
+//block starts from zero, so every block can be decoded on its own.
+namespace TraceFile
+{
+	const char MAGIC[8] = "ME88TRC";
+	const char INDEX_MAGIC[8] = "ME88IDX";
+	const uint32_t VERSION = 1;
+	const uint32_t BLOCK_CYCLES = 1 << 16;
+
+	struct Record
+	{
+		uint64_t cycle;
+		uint8_t star; //microstate executed in the cycle
+		uint16_t cs;	//CS and IP at the end of the cycle
+		uint16_t ip;
+		bool read;
+		bool write;
+		uint32_t readAddress;
+		uint8_t readData;
+		uint32_t writeAddress;
+		uint8_t writeData;
+	};
+
+	struct BlockIndex
+	{
+		uint64_t firstCycle;
+		uint64_t offset;
+		uint64_t records;
+	};
+} // namespace TraceFile
+
+//Encodes the records on the emulation thread and compresses and writes the blocks on a background thread.
+class TraceWriter
+{
+public:
+	TraceWriter(const std::string &filename);
+	~TraceWriter();
+	bool IsOpen() const;
+
+	void OnRead(uint32_t address, uint8_t data);
+	void OnWrite(uint32_t address, uint8_t data);
+	//closes the record of the cycle
+	void OnClock(uint64_t cycle, uint8_t star, uint16_t cs, uint16_t ip);
+
+private:
+	struct Block
+	{
+		uint64_t firstCycle;
+		uint32_t records;
+		std::vector<uint8_t> data;
+	};
+
+	//blocks waiting for the writer thread, the emulator waits when there are more
+	static const std::size_t MAX_PENDING_BLOCKS = 4;
+
+	std::ofstream m_file;
+	std::thread m_thread;
+	std::mutex m_mutex;
+	std::condition_variable m_condition;
+	std::deque<Block> m_pending;
+	bool m_closing;
+	//set by the writer thread when a block cannot be compressed, nothing else is written
+	bool m_failed;
+	std::vector<TraceFile::BlockIndex> m_index;
+
+	Block m_block;
+	TraceFile::Record m_current;
+	TraceFile::Record m_previous;
+
+	void Encode(const TraceFile::Record &record);
+	void Flush();
+	void WriterLoop();
+	void WriteBlock(const Block &block);
+};
+
+//Reads a trace file and seeks through the block index.
+class TraceReader
+{
+public:
+	TraceReader(const std::string &filename);
+	bool IsOpen() const;
+	uint64_t GetFirstCycle() const;
+	uint64_t GetLastCycle() const;
+	//the records from cycle from, at most count of them
+	std::vector<TraceFile::Record> Read(uint64_t from, uint64_t count);
+
+private:
+	std::ifstream m_file;
+	bool m_valid;
+	std::vector<TraceFile::BlockIndex> m_index;
+
+	bool ReadBlock(std::size_t block, std::vector<TraceFile::Record> &records);
+};
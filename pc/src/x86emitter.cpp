@@ -0,0 +1,341 @@
+#include "x86emitter.h"
+#include <cstring>
+
+void X86Emitter::SetBuffer(uint8_t *begin, uint8_t *end)
+{
+	m_position = begin;
+	m_end = end;
+}
+
+uint8_t *X86Emitter::GetPosition() const
+{
+	return m_position;
+}
+
+std::size_t X86Emitter::GetRoom() const
+{
+	return m_end - m_position;
+}
+
+void X86Emitter::Byte(uint8_t value)
+{
+	*m_position++ = value;
+}
+
+void X86Emitter::Word(uint16_t value)
+{
+	std::memcpy(m_position, &value, sizeof(value));
+	m_position += sizeof(value);
+}
+
+void X86Emitter::Dword(uint32_t value)
+{
+	std::memcpy(m_position, &value, sizeof(value));
+	m_position += sizeof(value);
+}
+
+void X86Emitter::Qword(uint64_t value)
+{
+	std::memcpy(m_position, &value, sizeof(value));
+	m_position += sizeof(value);
+}
+
+void X86Emitter::Rex(bool wide, int reg, int rm, bool byteRegs)
+{
+	uint8_t rex = 0x40 | (wide << 3) | ((reg & 8) >> 1) | ((rm & 8) >> 3);
+	if (rex != 0x40 || (byteRegs && (reg >= RSP || rm >= RSP)))
+	{
+		Byte(rex);
+	}
+}
+
+void X86Emitter::ModRm(int reg, int rm)
+{
+	Byte(0xC0 | ((reg & 7) << 3) | (rm & 7));
+}
+
+void X86Emitter::ModRmMemory(int reg, int base, int32_t disp)
+{
+	Byte(0x80 | ((reg & 7) << 3) | (base & 7));
+	if ((base & 7) == RSP)
+	{
+		//RSP and R12 as base need a SIB byte
+		Byte(0x24);
+	}
+	Dword(disp);
+}
+
+void X86Emitter::Load8(int reg, int base, int32_t disp)
+{
+	Rex(false, reg, base);
+	Byte(0x0F);
+	Byte(0xB6);
+	ModRmMemory(reg, base, disp);
+}
+
+void X86Emitter::Load16(int reg, int base, int32_t disp)
+{
+	Rex(false, reg, base);
+	Byte(0x0F);
+	Byte(0xB7);
+	ModRmMemory(reg, base, disp);
+}
+
+void X86Emitter::Load32(int reg, int base, int32_t disp)
+{
+	Rex(false, reg, base);
+	Byte(0x8B);
+	ModRmMemory(reg, base, disp);
+}
+
+void X86Emitter::Load64(int reg, int base, int32_t disp)
+{
+	Rex(true, reg, base);
+	Byte(0x8B);
+	ModRmMemory(reg, base, disp);
+}
+
+void X86Emitter::Store8(int base, int32_t disp, int reg)
+{
+	Rex(false, reg, base, true);
+	Byte(0x88);
+	ModRmMemory(reg, base, disp);
+}
+
+void X86Emitter::Store16(int base, int32_t disp, int reg)
+{
+	Byte(0x66);
+	Rex(false, reg, base);
+	Byte(0x89);
+	ModRmMemory(reg, base, disp);
+}
+
+void X86Emitter::Store32(int base, int32_t disp, int reg)
+{
+	Rex(false, reg, base);
+	Byte(0x89);
+	ModRmMemory(reg, base, disp);
+}
+
+void X86Emitter::Store64(int base, int32_t disp, int reg)
+{
+	Rex(true, reg, base);
+	Byte(0x89);
+	ModRmMemory(reg, base, disp);
+}
+
+void X86Emitter::StoreImm8(int base, int32_t disp, uint8_t value)
+{
+	Rex(false, 0, base);
+	Byte(0xC6);
+	ModRmMemory(0, base, disp);
+	Byte(value);
+}
+
+void X86Emitter::StoreImm16(int base, int32_t disp, uint16_t value)
+{
+	Byte(0x66);
+	Rex(false, 0, base);
+	Byte(0xC7);
+	ModRmMemory(0, base, disp);
+	Word(value);
+}
+
+void X86Emitter::StoreImm32(int base, int32_t disp, uint32_t value)
+{
+	Rex(false, 0, base);
+	Byte(0xC7);
+	ModRmMemory(0, base, disp);
+	Dword(value);
+}
+
+void X86Emitter::AddImm64(int base, int32_t disp, int32_t value)
+{
+	Rex(true, 0, base);
+	Byte(0x81);
+	ModRmMemory(0, base, disp);
+	Dword(value);
+}
+
+void X86Emitter::Cmp64(int reg, int base, int32_t disp)
+{
+	Rex(true, reg, base);
+	Byte(0x3B);
+	ModRmMemory(reg, base, disp);
+}
+
+void X86Emitter::Lea64(int reg, int base, int32_t disp)
+{
+	Rex(true, reg, base);
+	Byte(0x8D);
+	ModRmMemory(reg, base, disp);
+}
+
+void X86Emitter::MovImm32(int reg, uint32_t value)
+{
+	Rex(false, 0, reg);
+	Byte(0xB8 + (reg & 7));
+	Dword(value);
+}
+
+void X86Emitter::MovImm64(int reg, uint64_t value)
+{
+	Rex(true, 0, reg);
+	Byte(0xB8 + (reg & 7));
+	Qword(value);
+}
+
+void X86Emitter::Mov32(int dst, int src)
+{
+	Rex(false, dst, src);
+	Byte(0x8B);
+	ModRm(dst, src);
+}
+
+void X86Emitter::Mov64(int dst, int src)
+{
+	Rex(true, dst, src);
+	Byte(0x8B);
+	ModRm(dst, src);
+}
+
+void X86Emitter::Add32(int dst, int src)
+{
+	Rex(false, dst, src);
+	Byte(0x03);
+	ModRm(dst, src);
+}
+
+void X86Emitter::Or32(int dst, int src)
+{
+	Rex(false, dst, src);
+	Byte(0x0B);
+	ModRm(dst, src);
+}
+
+void X86Emitter::Group1(int operation, int reg, uint32_t value, bool wide)
+{
+	Rex(wide, 0, reg);
+	Byte(0x81);
+	ModRm(operation, reg);
+	Dword(value);
+}
+
+void X86Emitter::AddImm32(int reg, int32_t value)
+{
+	Group1(0, reg, value);
+}
+
+void X86Emitter::AddImm64(int reg, int32_t value)
+{
+	Group1(0, reg, value, true);
+}
+
+void X86Emitter::SubImm32(int reg, int32_t value)
+{
+	Group1(5, reg, value);
+}
+
+void X86Emitter::AndImm32(int reg, uint32_t value)
+{
+	Group1(4, reg, value);
+}
+
+void X86Emitter::OrImm32(int reg, uint32_t value)
+{
+	Group1(1, reg, value);
+}
+
+void X86Emitter::ShlImm32(int reg, uint8_t count)
+{
+	Rex(false, 0, reg);
+	Byte(0xC1);
+	ModRm(4, reg);
+	Byte(count);
+}
+
+void X86Emitter::ShrImm32(int reg, uint8_t count)
+{
+	Rex(false, 0, reg);
+	Byte(0xC1);
+	ModRm(5, reg);
+	Byte(count);
+}
+
+void X86Emitter::Bt32(int reg, int index)
+{
+	Rex(false, index, reg);
+	Byte(0x0F);
+	Byte(0xA3);
+	ModRm(index, reg);
+}
+
+void X86Emitter::LoadTable16(int reg, int base, int index)
+{
+	uint8_t rex = 0x40 | ((reg & 8) >> 1) | ((index & 8) >> 2) | ((base & 8) >> 3);
+	if (rex != 0x40)
+	{
+		Byte(rex);
+	}
+	Byte(0x0F);
+	Byte(0xB7);
+	Byte(0x04 | ((reg & 7) << 3));
+	//scale 2
+	Byte(0x40 | ((index & 7) << 3) | (base & 7));
+}
+
+void X86Emitter::Push(int reg)
+{
+	Rex(false, 0, reg);
+	Byte(0x50 + (reg & 7));
+}
+
+void X86Emitter::Pop(int reg)
+{
+	Rex(false, 0, reg);
+	Byte(0x58 + (reg & 7));
+}
+
+void X86Emitter::Call(int reg)
+{
+	Rex(false, 0, reg);
+	Byte(0xFF);
+	ModRm(2, reg);
+}
+
+void X86Emitter::Ret()
+{
+	Byte(0xC3);
+}
+
+void X86Emitter::JmpRegister(int reg)
+{
+	Rex(false, 0, reg);
+	Byte(0xFF);
+	ModRm(4, reg);
+}
+
+uint8_t *X86Emitter::Jmp(const uint8_t *target)
+{
+	Byte(0xE9);
+	auto displacement = m_position;
+	Dword(0);
+	Patch(displacement, target);
+	return displacement;
+}
+
+uint8_t *X86Emitter::Jcc(Condition condition, const uint8_t *target)
+{
+	Byte(0x0F);
+	Byte(0x80 | condition);
+	auto displacement = m_position;
+	Dword(0);
+	Patch(displacement, target);
+	return displacement;
+}
+
+void X86Emitter::Patch(uint8_t *displacement, const uint8_t *target)
+{
+	int32_t relative = target - (displacement + 4);
+	std::memcpy(displacement, &relative, sizeof(relative));
+}
@@ -0,0 +1,97 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+//Encoder for the few x86-64 instructions JitProcessor needs, writing into a buffer owned by the caller.
+//Registers are numbered as in the encoding, the memory operands are always [base + disp32].
+class X86Emitter
+{
+public:
+	enum Register
+	{
+		RAX = 0,
+		RCX,
+		RDX,
+		RBX,
+		RSP,
+		RBP,
+		RSI,
+		RDI,
+		R8,
+		R9,
+		R10,
+		R11,
+		R12,
+		R13,
+		R14,
+		R15
+	};
+
+	enum Condition
+	{
+		BELOW = 0x2, //carry set
+		ABOVE = 0x7
+	};
+
+	void SetBuffer(uint8_t *begin, uint8_t *end);
+	uint8_t *GetPosition() const;
+	std::size_t GetRoom() const;
+
+	//movzx/mov reg, [base + disp]
+	void Load8(int reg, int base, int32_t disp);
+	void Load16(int reg, int base, int32_t disp);
+	void Load32(int reg, int base, int32_t disp);
+	void Load64(int reg, int base, int32_t disp);
+	void Store8(int base, int32_t disp, int reg);
+	void Store16(int base, int32_t disp, int reg);
+	void Store32(int base, int32_t disp, int reg);
+	void Store64(int base, int32_t disp, int reg);
+	void StoreImm8(int base, int32_t disp, uint8_t value);
+	void StoreImm16(int base, int32_t disp, uint16_t value);
+	void StoreImm32(int base, int32_t disp, uint32_t value);
+	void AddImm64(int base, int32_t disp, int32_t value);
+	void Cmp64(int reg, int base, int32_t disp);
+	void Lea64(int reg, int base, int32_t disp);
+
+	void MovImm32(int reg, uint32_t value);
+	void MovImm64(int reg, uint64_t value);
+	void Mov32(int dst, int src);
+	void Mov64(int dst, int src);
+	void Add32(int dst, int src);
+	void Or32(int dst, int src);
+	void AddImm32(int reg, int32_t value);
+	void AddImm64(int reg, int32_t value);
+	void SubImm32(int reg, int32_t value);
+	void AndImm32(int reg, uint32_t value);
+	void OrImm32(int reg, uint32_t value);
+	void ShlImm32(int reg, uint8_t count);
+	void ShrImm32(int reg, uint8_t count);
+	//carry = bit number index of reg
+	void Bt32(int reg, int index);
+	//movzx reg, word [base + index * 2]
+	void LoadTable16(int reg, int base, int index);
+
+	void Push(int reg);
+	void Pop(int reg);
+	void Call(int reg);
+	void Ret();
+	void JmpRegister(int reg);
+	//rel32 jumps, they return the address of the displacement so that it can be patched later
+	uint8_t *Jmp(const uint8_t *target);
+	uint8_t *Jcc(Condition condition, const uint8_t *target);
+	static void Patch(uint8_t *displacement, const uint8_t *target);
+
+private:
+	uint8_t *m_position = nullptr;
+	uint8_t *m_end = nullptr;
+
+	void Byte(uint8_t value);
+	void Word(uint16_t value);
+	void Dword(uint32_t value);
+	void Qword(uint64_t value);
+	//the REX prefix, when any of its bits is needed; byteRegs also selects SPL..DIL over AH..BH
+	void Rex(bool wide, int reg, int rm, bool byteRegs = false);
+	void ModRm(int reg, int rm);
+	void ModRmMemory(int reg, int base, int32_t disp);
+	void Group1(int operation, int reg, uint32_t value, bool wide = false);
+};